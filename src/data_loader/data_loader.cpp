@@ -1,6 +1,7 @@
 #include "data_loader.h"
 
-int load_data(const std::string &filename, data &data, const execution_policy &policy) {
+template<typename Real>
+int load_data(const std::string &filename, data<Real> &data, const execution_policy &policy) {
     // open the file in binary mode
     FILE* file = nullptr;
     errno_t err = fopen_s(&file, filename.c_str(), "rb");
@@ -43,9 +44,8 @@ int load_data(const std::string &filename, data &data, const execution_policy &p
     data.x.resize(numLines);
     data.y.resize(numLines);
     data.z.resize(numLines);
-    std::visit([&](auto&& exec_policy) {
-    std::for_each(exec_policy, lines.begin(), lines.end(), [&](const std::string_view& line) {
-        auto i =static_cast <size_t> (&line - &lines[0]);  // get the index of the line
+    policy_for(policy, 0, lines.size(), [&](size_t i) {
+        const std::string_view &line = lines[i];
 
         char line_cstr[256];
 //        strncpy(line_cstr, line.data(), line.size());
@@ -58,18 +58,21 @@ int load_data(const std::string &filename, data &data, const execution_policy &p
 
         // Parse x, y, z
         char* token = strtok_s(nullptr, ",", &saveptr);
-        data.x[i] = str_to_real(token, nullptr); // parse x
+        data.x[i] = str_to_real<Real>(token); // parse x
 
         token = strtok_s(nullptr, ",", &saveptr);
-        data.y[i] = str_to_real(token, nullptr); // parse y
+        data.y[i] = str_to_real<Real>(token); // parse y
 
         token = strtok_s(nullptr, ",", &saveptr);
-        data.z[i] = str_to_real(token, nullptr); // parse z
+        data.z[i] = str_to_real<Real>(token); // parse z
     });
-    }, policy.get_policy());
 
     // clean up
     delete[] buffer;
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+template int load_data(const std::string &filename, data<float> &data, const execution_policy &policy);
+
+template int load_data(const std::string &filename, data<double> &data, const execution_policy &policy);
@@ -3,22 +3,27 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
-#include <execution>
 #include "my_utils.h"
-#include "data_processing/device_type.h"
+#include "data_processing/execution_policy.h"
 
-/** Data structure to store accelerometer data */
+/**
+ * Data structure to store accelerometer data
+ * @tparam Real - precision of the values (float or double)
+ */
+template<typename Real>
 struct data {
-    std::vector<real> x;
-    std::vector<real> y;
-    std::vector<real> z;
+    std::vector<Real> x;
+    std::vector<Real> y;
+    std::vector<Real> z;
 };
 
 /**
- * @brief Load accelerometer data from a file
+ * @brief Load accelerometer data from a file (instantiated for float and double in data_loader.cpp)
+ * @tparam Real - precision of the values
  * @param filename File to load data from
  * @param data Data structure to store the loaded data
  * @param policy Execution policy
  * @return EXIT_SUCCESS if the data was loaded successfully, EXIT_FAILURE otherwise
  */
-int load_data(const std::string &filename, data &data, const execution_policy &policy);
\ No newline at end of file
+template<typename Real>
+int load_data(const std::string &filename, data<Real> &data, const execution_policy &policy);
@@ -0,0 +1,56 @@
+#include "compressed_column.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simd_kernels.h"
+
+#define COMPRESS_BLOCK_SIZE 4096 // elements of one conversion task
+
+template<typename Real>
+void compress_column(const std::vector<Real> &column, storage_format format, compressed_column &compressed,
+                     const execution_policy &policy) {
+    const size_t n = column.size();
+    const size_t num_blocks = (n + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+    compressed.values.resize(n);
+    compressed.format = format;
+    std::vector<double> block_errors(num_blocks, 0);
+    policy_for(policy, 0, num_blocks, [&](size_t block) {
+        const size_t end = std::min<size_t>(n, (block + 1) * COMPRESS_BLOCK_SIZE);
+        for (size_t i = block * COMPRESS_BLOCK_SIZE; i < end; ++i) {
+            auto value = static_cast<float>(column[i]);
+            uint16_t bits = format == storage_format::Half ? float_to_half(value) : float_to_bfloat16(value);
+            float stored = format == storage_format::Half ? half_to_float(bits) : bfloat16_to_float(bits);
+            compressed.values[i] = bits;
+            block_errors[block] = std::max(block_errors[block], std::abs(static_cast<double>(column[i]) - stored));
+        }
+    });
+    compressed.max_error = block_errors.empty() ? 0 : *std::max_element(block_errors.begin(), block_errors.end());
+}
+
+template<typename Real>
+void widen_column(compressed_view compressed, std::vector<Real> &column, const execution_policy &policy) {
+    const size_t n = compressed.size();
+    const size_t num_blocks = (n + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+    column.resize(n);
+    policy_for(policy, 0, num_blocks, [&](size_t block) {
+        const size_t begin = block * COMPRESS_BLOCK_SIZE;
+        const size_t size = std::min<size_t>(COMPRESS_BLOCK_SIZE, n - begin);
+        const simd_kernels<Real> &kernels = simd_dispatch<Real>();
+        if (compressed.format() == storage_format::Half) {
+            kernels.widen_half(compressed.values() + begin, column.data() + begin, size);
+        } else {
+            kernels.widen_bfloat16(compressed.values() + begin, column.data() + begin, size);
+        }
+    });
+}
+
+template void compress_column(const std::vector<float> &, storage_format, compressed_column &,
+                              const execution_policy &);
+
+template void compress_column(const std::vector<double> &, storage_format, compressed_column &,
+                              const execution_policy &);
+
+template void widen_column(compressed_view, std::vector<float> &, const execution_policy &);
+
+template void widen_column(compressed_view, std::vector<double> &, const execution_policy &);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "half.h"
+#include "execution_policy.h"
+
+/**
+ * Column stored as 16-bit floats (a quarter of the memory of double) - the bounds of the errors of the statistics
+ * follow from the largest rounding error of an element: the median moves by at most max_error, the MAD by at most
+ * twice as much
+ */
+struct compressed_column {
+    std::vector<uint16_t> values; // bits of the halfs or bfloat16s
+    storage_format format = storage_format::Half;
+    double max_error = 0; // largest absolute rounding error of an element
+};
+
+/**
+ * compressed_view class - read-only view of a compressed column or of a prefix of it, the compressed counterpart of
+ * column_view. It converts implicitly from compressed_column, so the computations taking a view accept the columns
+ * without a copy.
+ */
+class compressed_view {
+public:
+    compressed_view() = default;
+
+    compressed_view(const compressed_column &column) // NOLINT
+            : values_(column.values.data()), size_(column.values.size()), format_(column.format),
+              max_error_(column.max_error) {}
+
+    [[nodiscard]] const uint16_t *values() const {
+        return values_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+
+    [[nodiscard]] storage_format format() const {
+        return format_;
+    }
+
+    [[nodiscard]] double max_error() const {
+        return max_error_;
+    }
+
+    /**
+     * @brief View of the first elements
+     * @param n - number of elements (at most the size of the view)
+     * @return view of the first n elements
+     */
+    [[nodiscard]] compressed_view prefix(size_t n) const {
+        compressed_view view = *this;
+        view.size_ = std::min(n, size_);
+        return view;
+    }
+
+    /**
+     * @brief View of consecutive elements
+     * @param begin - index of the first element
+     * @param end - index after the last element (at most the size of the view)
+     * @return view of the elements [begin, end)
+     */
+    [[nodiscard]] compressed_view slice(size_t begin, size_t end) const {
+        compressed_view view = *this;
+        view.values_ = values_ + begin;
+        view.size_ = std::min(end, size_) - begin;
+        return view;
+    }
+
+private:
+    const uint16_t *values_ = nullptr;
+    size_t size_ = 0;
+    storage_format format_ = storage_format::Half;
+    double max_error_ = 0;
+};
+
+/**
+ * @brief Round the elements to 16-bit floats (through float - the double rounding is exact for both formats)
+ * @param column - elements
+ * @param format - half or bfloat16
+ * @param compressed - compressed column (output)
+ * @param policy - execution policy - parallel or sequential
+ */
+template<typename Real>
+void compress_column(const std::vector<Real> &column, storage_format format, compressed_column &compressed,
+                     const execution_policy &policy);
+
+/**
+ * @brief Widen the compressed column by the SIMD kernels (instantiated for float and double in compressed_column.cpp)
+ * @param compressed - view of the compressed column
+ * @param column - elements (output)
+ * @param policy - execution policy - parallel or sequential
+ */
+template<typename Real>
+void widen_column(compressed_view compressed, std::vector<Real> &column, const execution_policy &policy);
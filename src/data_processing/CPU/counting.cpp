@@ -0,0 +1,342 @@
+#include "counting.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "reduction.h"
+#include "statistics.h"
+
+#define COUNTING_BINS 65536 // largest number of bins of the histogram - the range of 16-bit counts
+#define COUNTING_MIN_PART (1u << 16) // smallest part of a column with its own histogram
+#define COUNTING_MAX_PART (1ull << 31) // largest part of a column - the bins of a part are 32-bit
+#define SCALE_SAMPLE_SIZE 4096 // elements from the beginning of a column used to detect the scale
+#define SCALE_TOLERANCE 0.01 // largest distance of an element from a multiple of the scale, in counts
+#define MAX_COUNT 4503599627370496.0 // 2^52 - larger counts are not exact in double
+
+namespace {
+    /**
+     * @brief Number of parts of a column with their own histogram or bounds
+     */
+    template<execution_policy::e_type Type>
+    size_t num_parts(size_t n) {
+        size_t parts = std::clamp<size_t>(n / COUNTING_MIN_PART, 1, static_num_threads<Type>());
+        return std::max<size_t>(parts, n / COUNTING_MAX_PART + 1);
+    }
+
+    /**
+     * @brief Histogram of 16-bit values - one histogram per part of the column, then the parts added bin by bin
+     * @tparam Type - execution policy type - parallel or sequential
+     * @param values - values (smaller than bins)
+     * @param n - number of values
+     * @param bins - number of bins
+     * @return counts of the values
+     */
+    template<execution_policy::e_type Type>
+    std::vector<uint64_t> count_bins(const uint16_t *values, size_t n, size_t bins) {
+        const size_t parts = num_parts<Type>(n);
+        std::vector<std::vector<uint32_t>> part_histograms(parts);
+        static_for<Type>(0, parts, [&](size_t part) {
+            std::vector<uint32_t> &part_histogram = part_histograms[part];
+            part_histogram.assign(bins, 0);
+            for (size_t i = n * part / parts; i < n * (part + 1) / parts; ++i) {
+                ++part_histogram[values[i]];
+            }
+        });
+        std::vector<uint64_t> histogram(bins, 0);
+        static_for<Type>(0, bins, [&](size_t bin) {
+            for (const auto &part_histogram: part_histograms) {
+                histogram[bin] += part_histogram[bin];
+            }
+        });
+        return histogram;
+    }
+
+    /**
+     * @brief Bins of the two middle elements by the prefix sums of the histogram
+     * @param histogram - counts of the bins
+     * @param n - number of elements (at least one)
+     * @return bins of the elements of ranks (n - 1) / 2 and n / 2
+     */
+    std::pair<int64_t, int64_t> middle_bins(const std::vector<uint64_t> &histogram, uint64_t n) {
+        const uint64_t low_rank = (n - 1) / 2, high_rank = n / 2;
+        int64_t low = 0, high = 0;
+        uint64_t seen = 0;
+        for (size_t bin = 0; bin < histogram.size(); ++bin) {
+            if (seen <= low_rank && low_rank < seen + histogram[bin]) {
+                low = static_cast<int64_t>(bin);
+            }
+            seen += histogram[bin];
+            if (high_rank < seen) {
+                high = static_cast<int64_t>(bin);
+                break;
+            }
+        }
+        return {low, high};
+    }
+
+    /**
+     * @brief Absolute deviations of the two middle elements - the deviations grow to both sides of the median, so the
+     * bins are merged from the middle outwards like the bitonic array of find_median
+     * @param histogram - counts of the bins
+     * @param middle - last bin at or below the median
+     * @param n - number of elements
+     * @param deviation - absolute deviation of a bin from the median
+     * @return deviations of the elements of ranks (n - 1) / 2 and n / 2
+     */
+    template<typename Deviation>
+    auto middle_deviations(const std::vector<uint64_t> &histogram, int64_t middle, uint64_t n, Deviation deviation) {
+        using deviation_type = decltype(deviation(middle));
+        const uint64_t low_rank = (n - 1) / 2, high_rank = n / 2;
+        const auto bins = static_cast<int64_t>(histogram.size());
+        int64_t left = middle, right = middle + 1;
+        deviation_type deviation_low{}, deviation_high{};
+        uint64_t rank = 0;
+        while (left >= 0 || right < bins) {
+            bool take_left = left >= 0 && (right >= bins || deviation(left) <= deviation(right));
+            int64_t bin = take_left ? left-- : right++;
+            uint64_t count = histogram[static_cast<size_t>(bin)];
+            if (rank <= low_rank && low_rank < rank + count) {
+                deviation_low = deviation(bin);
+            }
+            if (high_rank < rank + count) {
+                deviation_high = deviation(bin);
+                break;
+            }
+            rank += count;
+        }
+        return std::make_pair(deviation_low, deviation_high);
+    }
+}
+
+template<typename Real>
+std::optional<double> detect_sensor_scale(const Real *data, size_t n) {
+    std::vector<double> sample;
+    for (size_t i = 0; i < std::min<size_t>(n, SCALE_SAMPLE_SIZE); ++i) {
+        if (std::isfinite(data[i])) {
+            sample.push_back(static_cast<double>(data[i]));
+        }
+    }
+    std::sort(sample.begin(), sample.end());
+    sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+    if (sample.size() < 2) {
+        return std::nullopt;
+    }
+    double step = std::numeric_limits<double>::infinity();
+    for (size_t i = 1; i < sample.size(); ++i) {
+        step = std::min(step, sample[i] - sample[i - 1]);
+    }
+    // the largest value is the most counts away from zero - its count gives the finest estimate of the scale
+    double largest = std::max(std::abs(sample.front()), std::abs(sample.back()));
+    double counts = std::nearbyint(largest / step);
+    for (double scale: {counts >= 1 ? largest / counts : step, step}) {
+        if (std::all_of(sample.begin(), sample.end(), [scale](double value) {
+            return std::abs(value / scale - std::nearbyint(value / scale)) <= SCALE_TOLERANCE;
+        })) {
+            return scale;
+        }
+    }
+    return std::nullopt;
+}
+
+template<typename Real, execution_policy::e_type Type>
+bool quantize(const Real *data, size_t n, double scale, quantized_column &column) {
+    if (n == 0 || !(scale > 0) || !std::isfinite(scale)) {
+        return false;
+    }
+    // the counts of the same scale are kept - only the elements beyond them are quantized
+    const size_t begin = column.scale == scale ? std::min(column.counts.size(), n) : 0;
+    if (begin == n) {
+        return true;
+    }
+    const double inverse = 1 / scale;
+    const size_t m = n - begin;
+    const size_t parts = num_parts<Type>(m);
+
+    // bounds of the counts of every part - fails if an element is not a multiple of the scale (NaN included)
+    std::vector<int64_t> part_min(parts, std::numeric_limits<int64_t>::max());
+    std::vector<int64_t> part_max(parts, std::numeric_limits<int64_t>::min());
+    std::vector<char> part_quantized(parts, 1);
+    static_for<Type>(0, parts, [&](size_t part) {
+        for (size_t i = begin + m * part / parts; i < begin + m * (part + 1) / parts; ++i) {
+            double value = static_cast<double>(data[i]) * inverse;
+            double count = std::nearbyint(value);
+            if (!(std::abs(value - count) <= SCALE_TOLERANCE) || std::abs(count) > MAX_COUNT) {
+                part_quantized[part] = 0;
+                return;
+            }
+            part_min[part] = std::min(part_min[part], static_cast<int64_t>(count));
+            part_max[part] = std::max(part_max[part], static_cast<int64_t>(count));
+        }
+    });
+    if (std::find(part_quantized.begin(), part_quantized.end(), 0) != part_quantized.end()) {
+        return false;
+    }
+    int64_t offset = *std::min_element(part_min.begin(), part_min.end());
+    int64_t last = *std::max_element(part_max.begin(), part_max.end());
+    if (begin > 0) { // the bounds of the kept counts
+        offset = std::min(offset, column.offset);
+        last = std::max(last, column.offset + static_cast<int64_t>(column.range) - 1);
+    }
+    const int64_t range = last - offset + 1;
+    if (range > COUNTING_BINS) {
+        return false;
+    }
+
+    // the kept counts are relative to the old offset - shifted if the new elements are smaller
+    const auto shift = static_cast<uint16_t>(begin > 0 ? column.offset - offset : 0);
+    if (shift != 0) {
+        const size_t kept_parts = num_parts<Type>(begin);
+        static_for<Type>(0, kept_parts, [&](size_t part) {
+            for (size_t i = begin * part / kept_parts; i < begin * (part + 1) / kept_parts; ++i) {
+                column.counts[i] = static_cast<uint16_t>(column.counts[i] + shift);
+            }
+        });
+    }
+    column.counts.resize(n);
+    column.offset = offset;
+    column.range = static_cast<size_t>(range);
+    column.scale = scale;
+    static_for<Type>(0, parts, [&](size_t part) {
+        for (size_t i = begin + m * part / parts; i < begin + m * (part + 1) / parts; ++i) {
+            auto count = static_cast<int64_t>(std::nearbyint(static_cast<double>(data[i]) * inverse));
+            column.counts[i] = static_cast<uint16_t>(count - offset);
+        }
+    });
+    return true;
+}
+
+template<typename Real, execution_policy::e_type Type>
+void counting_CV_MAD(const quantized_column &column, size_t n, Real &cv, Real &mad) {
+    const size_t bins = column.range;
+
+    std::vector<uint64_t> histogram = count_bins<Type>(column.counts.data(), n, bins);
+
+    // moments of the counts relative to the smallest one of the elements - integer sums over the bins, the offset
+    // and the scale cancel out in the variance (a prefix of kept counts gives the same sums as its own quantization)
+    uint64_t first = 0;
+    while (histogram[first] == 0) {
+        ++first;
+    }
+    uint64_t sum = 0, sum2 = 0;
+    for (uint64_t bin = first; bin < bins; ++bin) {
+        sum += histogram[bin] * (bin - first);
+        sum2 += histogram[bin] * (bin - first) * (bin - first);
+    }
+    double mean = static_cast<double>(sum) / static_cast<double>(n);
+    double variance = static_cast<double>(sum2) / static_cast<double>(n) - mean * mean;
+    cv = static_cast<Real>(std::sqrt(std::max(variance, 0.0)) /
+                           (static_cast<double>(column.offset + static_cast<int64_t>(first)) + mean));
+
+    auto [low, high] = middle_bins(histogram, n);
+
+    // the absolute deviations in half counts, |2 * bin - (low + high)|, grow to both sides of the median
+    const int64_t twice_median = low + high;
+    auto [deviation_low, deviation_high] = middle_deviations(histogram, twice_median / 2, n, [&](int64_t bin) {
+        return std::abs(2 * bin - twice_median);
+    });
+    mad = static_cast<Real>(static_cast<double>(deviation_low + deviation_high) * column.scale / 4);
+}
+
+template<typename Real, execution_policy::e_type Type, typename Acc>
+int compute_CV_MAD_counting(const Real *data, size_t n, double scale, Real &cv, Real &mad) {
+    quantized_column column;
+    return compute_CV_MAD_counting<Real, Type, Acc>(data, n, scale, column, cv, mad);
+}
+
+template<typename Real, execution_policy::e_type Type, typename Acc>
+int compute_CV_MAD_counting(const Real *data, size_t n, double scale, quantized_column &column, Real &cv,
+                            Real &mad) {
+    if (!quantize<Real, Type>(data, n, scale, column)) {
+        return EXIT_FAILURE;
+    }
+    counting_CV_MAD<Real, Type>(column, n, cv, mad);
+    if (selected_reduction_mode() != reduction_mode::Fast) { // the same sums as the other engines
+        Acc sum = 0, sum2 = 0;
+        reduce_sums_static<Real, Type, Acc>(data, n, sum, sum2);
+        cv = static_cast<Real>(CV(sum, sum2, n));
+    }
+    return EXIT_SUCCESS;
+}
+
+template<typename Real, execution_policy::e_type Type, typename Acc>
+int compute_CV_MAD_keys(compressed_view column, Real &cv, Real &mad) {
+    const size_t n = column.size();
+    if (n == 0) {
+        return EXIT_FAILURE;
+    }
+
+    // histogram of the raw bits, then the bins reordered by the order keys - the values of the keys grow
+    std::vector<uint64_t> raw_histogram = count_bins<Type>(column.values(), n, COUNTING_BINS);
+    std::vector<uint64_t> histogram(COUNTING_BINS);
+    for (size_t bits = 0; bits < COUNTING_BINS; ++bits) {
+        histogram[order_key(static_cast<uint16_t>(bits))] = raw_histogram[bits];
+    }
+    auto value = [format = column.format()](int64_t key) -> double {
+        uint16_t bits = key_bits(static_cast<uint16_t>(key));
+        return format == storage_format::Half ? half_to_float(bits) : bfloat16_to_float(bits);
+    };
+
+    if (selected_reduction_mode() == reduction_mode::Fast) {
+        // moments as sums over the bins in double - exact products of the counts and the 16-bit values
+        double sum = 0, sum2 = 0;
+        for (int64_t key = 0; key < COUNTING_BINS; ++key) {
+            if (histogram[key]) {
+                auto count = static_cast<double>(histogram[key]);
+                sum += count * value(key);
+                sum2 += count * value(key) * value(key);
+            }
+        }
+        cv = static_cast<Real>(CV(sum, sum2, n));
+    } else { // the same sums as the other engines
+        std::vector<Real> widened;
+        widen_column(column, widened, execution_policy(Type));
+        Acc sum = 0, sum2 = 0;
+        reduce_sums_static<Real, Type, Acc>(widened.data(), n, sum, sum2);
+        cv = static_cast<Real>(CV(sum, sum2, n));
+    }
+
+    auto [low, high] = middle_bins(histogram, n);
+    const double median = (value(low) + value(high)) / 2;
+    auto [deviation_low, deviation_high] = middle_deviations(histogram, low, n, [&](int64_t key) {
+        return std::abs(value(key) - median);
+    });
+    mad = static_cast<Real>((deviation_low + deviation_high) / 2);
+    return EXIT_SUCCESS;
+}
+
+#define INSTANTIATE_COUNTING_TYPE(Real, Type) \
+    template bool quantize<Real, Type>(const Real *, size_t, double, quantized_column &); \
+    template void counting_CV_MAD<Real, Type>(const quantized_column &, size_t, Real &, Real &);
+
+#define INSTANTIATE_COUNTING(Real, Acc) \
+    template int compute_CV_MAD_counting<Real, execution_policy::e_type::Sequential, Acc>(const Real *, size_t, \
+                                                                                          double, Real &, Real &); \
+    template int compute_CV_MAD_counting<Real, execution_policy::e_type::Parallel, Acc>(const Real *, size_t, \
+                                                                                        double, Real &, Real &); \
+    template int compute_CV_MAD_counting<Real, execution_policy::e_type::Sequential, Acc>( \
+            const Real *, size_t, double, quantized_column &, Real &, Real &); \
+    template int compute_CV_MAD_counting<Real, execution_policy::e_type::Parallel, Acc>( \
+            const Real *, size_t, double, quantized_column &, Real &, Real &); \
+    template int compute_CV_MAD_keys<Real, execution_policy::e_type::Sequential, Acc>(compressed_view, Real &, \
+                                                                                      Real &); \
+    template int compute_CV_MAD_keys<Real, execution_policy::e_type::Parallel, Acc>(compressed_view, Real &, Real &);
+
+template std::optional<double> detect_sensor_scale(const float *, size_t);
+
+template std::optional<double> detect_sensor_scale(const double *, size_t);
+
+INSTANTIATE_COUNTING_TYPE(float, execution_policy::e_type::Sequential)
+
+INSTANTIATE_COUNTING_TYPE(float, execution_policy::e_type::Parallel)
+
+INSTANTIATE_COUNTING_TYPE(double, execution_policy::e_type::Sequential)
+
+INSTANTIATE_COUNTING_TYPE(double, execution_policy::e_type::Parallel)
+
+INSTANTIATE_COUNTING(float, float)
+
+INSTANTIATE_COUNTING(float, double) // float storage with double accumulation
+
+INSTANTIATE_COUNTING(double, double)
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "execution_policy.h"
+#include "compressed_column.h"
+
+/**
+ * Column of quantized sensor data stored as 16-bit counts - the value of an element is
+ * (offset + counts[i]) * scale, offset is the smallest count of the column
+ */
+struct quantized_column {
+    std::vector<uint16_t> counts; // counts relative to the offset
+    int64_t offset = 0; // smallest count of the column
+    size_t range = 0; // largest relative count + 1 - the number of bins of the histogram
+    double scale = 1; // value of one count (ADC resolution in the units of the data)
+};
+
+/**
+ * @brief Detect the scale of quantized data - the smallest difference of the distinct values of a sample from the
+ * beginning of the column, refined by the largest sample value
+ * @param data - elements
+ * @param n - number of elements
+ * @return scale, empty if the sample has less than two distinct values or is not quantized
+ */
+template<typename Real>
+std::optional<double> detect_sensor_scale(const Real *data, size_t n);
+
+/**
+ * @brief Quantize the elements to 16-bit counts - the counts already in a column of the same scale are kept as the
+ * counts of the first elements and only the elements beyond them are quantized, so a growing prefix of a column is
+ * quantized once
+ * @tparam Type - execution policy type - parallel or sequential
+ * @param data - elements
+ * @param n - number of elements
+ * @param scale - value of one count
+ * @param column - quantized column (updated, unchanged on failure)
+ * @return true if every element is a multiple of the scale and the counts span at most 65536 values
+ */
+template<typename Real, execution_policy::e_type Type>
+bool quantize(const Real *data, size_t n, double scale, quantized_column &column);
+
+/**
+ * @brief Compute the coefficient of variance and median absolute deviation of quantized data without sorting -
+ * one pass builds the histogram of the counts, the median and the MAD are found by walking its bins and the moments
+ * are integer sums over the bins
+ * @tparam Type - execution policy type - parallel or sequential (one histogram per part of the column)
+ * @param column - quantized column
+ * @param n - number of the first counts of the column used (at least one)
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ */
+template<typename Real, execution_policy::e_type Type>
+void counting_CV_MAD(const quantized_column &column, size_t n, Real &cv, Real &mad);
+
+/**
+ * @brief Quantize the elements and compute the coefficient of variance and median absolute deviation by counting
+ * (the sums of the reproducible and exact reductions are reduced from the elements, so the CV matches the other
+ * engines)
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Acc - accumulator of the reproducible and exact sums
+ * @param data - elements (not modified)
+ * @param n - number of elements
+ * @param scale - value of one count
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the data are not quantized by the scale
+ */
+template<typename Real, execution_policy::e_type Type, typename Acc = Real>
+int compute_CV_MAD_counting(const Real *data, size_t n, double scale, Real &cv, Real &mad);
+
+/**
+ * @brief Compute the coefficient of variance and median absolute deviation by counting with the counts kept in the
+ * column - only the elements beyond its counts are quantized, so the repetitions and the growing partitions of a
+ * column reuse the counts
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Acc - accumulator of the reproducible and exact sums
+ * @param data - elements (not modified)
+ * @param n - number of elements
+ * @param scale - value of one count
+ * @param column - counts of the column (updated)
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the data are not quantized by the scale
+ */
+template<typename Real, execution_policy::e_type Type, typename Acc = Real>
+int compute_CV_MAD_counting(const Real *data, size_t n, double scale, quantized_column &column, Real &cv, Real &mad);
+
+/**
+ * @brief Compute the coefficient of variance and median absolute deviation of a compressed column without widening
+ * it - the 16-bit floats are counted in a histogram of 65536 keys ordered like the values, the median and the MAD
+ * are found by walking its bins
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Acc - accumulator of the reproducible and exact sums (reduced from the widened column)
+ * @param column - view of the compressed column
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the column is empty
+ */
+template<typename Real, execution_policy::e_type Type, typename Acc = Real>
+int compute_CV_MAD_keys(compressed_view column, Real &cv, Real &mad);
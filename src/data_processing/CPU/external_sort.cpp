@@ -0,0 +1,322 @@
+#include "external_sort.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <random>
+#include <string>
+
+#include "statistics.h"
+
+#define EXTERNAL_MIN_RUN (1u << 16) // smallest run sorted in memory, elements
+#define EXTERNAL_MIN_BUFFER 4096 // smallest read-ahead buffer of a run, elements - the budget may be exceeded by
+                                 // the buffers of very many runs
+
+namespace {
+    /**
+     * spill_file class - temporary file of elements, written once sequentially and then read at any offset,
+     * removed when destroyed
+     */
+    template<typename Real>
+    class spill_file {
+    public:
+        spill_file() {
+            static std::atomic<size_t> counter{0};
+            std::error_code error;
+            path = std::filesystem::temp_directory_path(error) /
+                   ("SP_spill_" + std::to_string(std::random_device()()) + "_" + std::to_string(counter++) + ".bin");
+            out.open(path, std::ios::binary | std::ios::trunc);
+        }
+
+        ~spill_file() {
+            out.close();
+            in.close();
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+
+        spill_file(const spill_file &) = delete;
+
+        spill_file &operator=(const spill_file &) = delete;
+
+        /**
+         * @brief Append elements to the file
+         * @return true if successful
+         */
+        bool write(const Real *data, size_t n) {
+            out.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(n * sizeof(Real)));
+            return out.good();
+        }
+
+        /**
+         * @brief Finish the writing and open the file for reading
+         * @return true if successful
+         */
+        bool finish() {
+            out.close();
+            if (out.fail()) {
+                return false;
+            }
+            in.open(path, std::ios::binary);
+            return in.good();
+        }
+
+        /**
+         * @brief Read elements at an offset
+         * @param offset - index of the first element
+         * @return true if successful
+         */
+        bool read(size_t offset, Real *data, size_t n) {
+            in.seekg(static_cast<std::streamoff>(offset * sizeof(Real)));
+            in.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(n * sizeof(Real)));
+            return in.good();
+        }
+
+        [[nodiscard]] bool is_open() const {
+            return out.is_open();
+        }
+
+    private:
+        std::filesystem::path path;
+        std::ofstream out;
+        std::ifstream in;
+    };
+
+    /**
+     * run_reader class - sequential reader of a range of a spill file through a read-ahead buffer, forwards or
+     * backwards
+     */
+    template<typename Real>
+    class run_reader {
+    public:
+        run_reader(spill_file<Real> &file, size_t begin, size_t end, size_t buffer_size, bool backward = false)
+                : file(file), begin(begin), end(end), buffer_size(buffer_size), backward(backward) {}
+
+        /**
+         * @brief Next element of the range
+         * @param value - element (output)
+         * @return false at the end of the range or if the read fails
+         */
+        bool next(Real &value) {
+            if (position == buffer.size() && !refill()) {
+                return false;
+            }
+            value = buffer[position++];
+            return true;
+        }
+
+        [[nodiscard]] bool failed() const {
+            return read_failed;
+        }
+
+    private:
+        bool refill() {
+            const size_t n = std::min(buffer_size, end - begin);
+            if (n == 0) {
+                return false;
+            }
+            buffer.resize(n);
+            if (!file.read(backward ? end - n : begin, buffer.data(), n)) {
+                read_failed = true;
+                return false;
+            }
+            if (backward) {
+                std::reverse(buffer.begin(), buffer.end());
+                end -= n;
+            } else {
+                begin += n;
+            }
+            position = 0;
+            return true;
+        }
+
+        spill_file<Real> &file;
+        size_t begin, end; // range not read yet
+        size_t buffer_size;
+        bool backward;
+        std::vector<Real> buffer;
+        size_t position = 0; // next element of the buffer
+        bool read_failed = false;
+    };
+
+    /**
+     * @brief External merge sort of a column loaded run by run
+     * @param n - number of elements of the column
+     * @param load_run - function loading the elements [begin, end) of the column into the vector of the run
+     */
+    template<typename Real, typename Acc, typename Load>
+    int external_sort(size_t n, Load &&load_run, size_t max_memory, Real &cv, Real &mad, bool is_vectorized,
+                      const execution_policy &policy) {
+        if (n == 0) {
+            return EXIT_FAILURE;
+        }
+        Acc sum = 0, sum2 = 0;
+        const bool deterministic = selected_reduction_mode() != reduction_mode::Fast;
+        streaming_sums<Real, Acc> input_sums; // the deterministic sums of the runs in the input order
+
+        // sort the runs and spill them - the sums of the runs are counted by their last merges, the runs are aligned to
+        // the blocks of the deterministic reductions
+        const size_t alignment = streaming_sums<Real, Acc>::part_alignment();
+        const size_t run_size = std::max<size_t>(EXTERNAL_MIN_RUN, max_memory / (2 * sizeof(Real))) / alignment *
+                                alignment;
+        spill_file<Real> runs;
+        if (!runs.is_open()) {
+            std::cerr << "Failed to create a temporary file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<size_t> run_offsets;
+        {
+            std::vector<Real> run;
+            for (size_t begin = 0; begin < n; begin += run_size) {
+                load_run(begin, std::min(n, begin + run_size), run);
+                if (deterministic) {
+                    input_sums.add(run.data(), run.size(), policy);
+                }
+                Acc run_sum = 0, run_sum2 = 0;
+                if (mergeSort(run, run_sum, run_sum2, is_vectorized, policy) != EXIT_SUCCESS) {
+                    return EXIT_FAILURE;
+                }
+                if (run.size() == 1) { // no merge - the sort counts nothing
+                    run_sum = static_cast<Acc>(run[0]);
+                    run_sum2 = static_cast<Acc>(run[0]) * static_cast<Acc>(run[0]);
+                }
+                if (!deterministic) {
+                    sum += run_sum;
+                    sum2 += run_sum2;
+                }
+                run_offsets.push_back(begin);
+                if (!runs.write(run.data(), run.size())) {
+                    std::cerr << "Failed to write a temporary file" << std::endl;
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        run_offsets.push_back(n);
+        const size_t num_runs = run_offsets.size() - 1;
+        if (!runs.finish()) {
+            std::cerr << "Failed to write a temporary file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (deterministic) {
+            input_sums.result(sum, sum2);
+        }
+        cv = static_cast<Real>(CV(sum, sum2, n));
+
+        // k-way merge of the runs into the merged file - one buffer per run and one for the output
+        const size_t buffer_size = std::max<size_t>(EXTERNAL_MIN_BUFFER, max_memory / sizeof(Real) / (num_runs + 1));
+        const size_t low_rank = (n - 1) / 2, high_rank = n / 2;
+        Real median_low = 0, median_high = 0;
+        spill_file<Real> merged;
+        {
+            std::vector<run_reader<Real>> readers;
+            readers.reserve(num_runs);
+            using head = std::pair<Real, size_t>;
+            std::priority_queue<head, std::vector<head>, std::greater<>> heads;
+            for (size_t r = 0; r < num_runs; ++r) {
+                readers.emplace_back(runs, run_offsets[r], run_offsets[r + 1], buffer_size);
+                Real value;
+                if (readers[r].next(value)) {
+                    heads.emplace(value, r);
+                }
+            }
+            std::vector<Real> output;
+            output.reserve(buffer_size);
+            size_t rank = 0;
+            while (!heads.empty()) {
+                auto [value, r] = heads.top();
+                heads.pop();
+                if (rank == low_rank) {
+                    median_low = value;
+                }
+                if (rank == high_rank) {
+                    median_high = value;
+                }
+                ++rank;
+                output.push_back(value);
+                if (output.size() == buffer_size) {
+                    merged.write(output.data(), output.size());
+                    output.clear();
+                }
+                if (readers[r].next(value)) {
+                    heads.emplace(value, r);
+                }
+            }
+            merged.write(output.data(), output.size());
+            bool read_failed = std::any_of(readers.begin(), readers.end(), [](const auto &reader) {
+                return reader.failed();
+            });
+            if (read_failed || rank != n || !merged.finish()) {
+                std::cerr << "Failed to merge the temporary files" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        // the deviations of the elements below the median grow backwards, above the median forwards
+        const Real median = (median_high + median_low) / static_cast<Real>(2.0);
+        const size_t side_buffer_size = std::max<size_t>(EXTERNAL_MIN_BUFFER, max_memory / sizeof(Real) / 2);
+        run_reader<Real> left(merged, 0, low_rank + 1, side_buffer_size, true);
+        run_reader<Real> right(merged, low_rank + 1, n, side_buffer_size);
+        Real left_value = 0, right_value = 0;
+        bool has_left = left.next(left_value), has_right = right.next(right_value);
+        Real deviation_low = 0, deviation_high = 0;
+        for (size_t rank = 0; rank <= high_rank && (has_left || has_right); ++rank) {
+            Real deviation;
+            if (has_left && (!has_right || median - left_value <= right_value - median)) {
+                deviation = median - left_value;
+                has_left = left.next(left_value);
+            } else {
+                deviation = right_value - median;
+                has_right = right.next(right_value);
+            }
+            if (rank == low_rank) {
+                deviation_low = deviation;
+            }
+            if (rank == high_rank) {
+                deviation_high = deviation;
+            }
+        }
+        if (left.failed() || right.failed()) {
+            std::cerr << "Failed to read a temporary file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        mad = (deviation_low + deviation_high) / static_cast<Real>(2.0);
+        std::cout << "Sorted externally in " << num_runs << " runs of " << run_size << " elements" << std::endl;
+        return EXIT_SUCCESS;
+    }
+}
+
+template<typename Real, typename Acc>
+int compute_CV_MAD_external(column_view<Real> column, size_t max_memory, Real &cv, Real &mad, bool is_vectorized,
+                            const execution_policy &policy) {
+    return external_sort<Real, Acc>(column.size(), [&](size_t begin, size_t end, std::vector<Real> &run) {
+        run.assign(column.begin() + begin, column.begin() + end);
+    }, max_memory, cv, mad, is_vectorized, policy);
+}
+
+template<typename Real, typename Acc>
+int compute_CV_MAD_external(compressed_view column, size_t max_memory, Real &cv, Real &mad, bool is_vectorized,
+                            const execution_policy &policy) {
+    // only the run being sorted is widened
+    return external_sort<Real, Acc>(column.size(), [&](size_t begin, size_t end, std::vector<Real> &run) {
+        widen_column(column.slice(begin, end), run, policy);
+    }, max_memory, cv, mad, is_vectorized, policy);
+}
+
+template int compute_CV_MAD_external<float, float>(column_view<float>, size_t, float &, float &, bool,
+                                                   const execution_policy &);
+
+template int compute_CV_MAD_external<float, double>(column_view<float>, size_t, float &, float &, bool,
+                                                    const execution_policy &); // float storage with double sums
+
+template int compute_CV_MAD_external<double, double>(column_view<double>, size_t, double &, double &, bool,
+                                                     const execution_policy &);
+
+template int compute_CV_MAD_external<float, float>(compressed_view, size_t, float &, float &, bool,
+                                                   const execution_policy &);
+
+template int compute_CV_MAD_external<float, double>(compressed_view, size_t, float &, float &, bool,
+                                                    const execution_policy &);
+
+template int compute_CV_MAD_external<double, double>(compressed_view, size_t, double &, double &, bool,
+                                                     const execution_policy &);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+
+#include "execution_policy.h"
+#include "column_view.h"
+#include "compressed_column.h"
+
+/**
+ * @brief Check if the merge sort of a column fits the memory budget - the sorted copy of the column and the scratch
+ * of its merges
+ * @param n - number of elements
+ * @param max_memory - memory budget in bytes
+ * @return true if the column can be sorted in memory
+ */
+template<typename Real>
+bool fits_memory(size_t n, size_t max_memory) {
+    return 2 * n * sizeof(Real) <= max_memory;
+}
+
+/**
+ * @brief Compute the coefficient of variance and median absolute deviation with the memory of the sort bounded by
+ * a budget - external merge sort through temporary files
+ *
+ * @details
+ *  1. runs of max_memory / (2 * sizeof(Real)) elements are merge sorted in memory (the sort needs as much scratch as
+ *     the run) and appended to a temporary file by large sequential writes - the runs are whole blocks of the
+ *     reproducible and exact reductions, which add the runs one by one (streaming_sums)
+ *  2. the runs are merged by a k-way merge, every run read through its own read-ahead buffer - the merged column is
+ *     written to a second temporary file and the middle elements give the median
+ *  3. the absolute deviations grow to both sides of the median - the merged file is read backwards and forwards from
+ *     the middle and the two sides are merged like the bitonic array of find_median up to the middle deviations
+ *
+ * @tparam Real - element type (float or double)
+ * @tparam Acc - accumulator of the sums
+ * @param column - column (not modified)
+ * @param max_memory - memory budget of the sort in bytes
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ * @param is_vectorized - flag to indicate if vectorization is enabled
+ * @param policy - execution policy of the sort of the runs - parallel or sequential
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the column is empty or a temporary file fails
+ */
+template<typename Real, typename Acc = Real>
+int compute_CV_MAD_external(column_view<Real> column, size_t max_memory, Real &cv, Real &mad, bool is_vectorized,
+                            const execution_policy &policy);
+
+/**
+ * @brief Compute the coefficient of variance and median absolute deviation of a compressed column with the memory
+ * of the sort bounded by a budget - every run is widened from the compressed column just before it is sorted, so
+ * the widened column is never held in memory
+ * @tparam Real - element type of the widened runs (float or double)
+ * @tparam Acc - accumulator of the sums
+ * @param column - view of the compressed column (not modified)
+ * @param max_memory - memory budget of the sort in bytes
+ * @param cv - coefficient of variance (output)
+ * @param mad - median absolute deviation (output)
+ * @param is_vectorized - flag to indicate if vectorization is enabled
+ * @param policy - execution policy of the widening and the sort of the runs - parallel or sequential
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the column is empty or a temporary file fails
+ */
+template<typename Real, typename Acc = Real>
+int compute_CV_MAD_external(compressed_view column, size_t max_memory, Real &cv, Real &mad, bool is_vectorized,
+                            const execution_policy &policy);
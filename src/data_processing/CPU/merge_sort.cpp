@@ -1,137 +1,121 @@
 #include "merge_sort.h"
 
 
-void sum_and_copy(const std::vector<real> &arr, std::vector<real> &halve_arr,
-                  size_t start, size_t size, real &sum, real &sum2,
-                  const execution_policy &policy) {
-
-    size_t max_num_threads = std::thread::hardware_concurrency();
+/**
+ * @brief Sums the elements of the array from start to start + size and copies them to halve_arr
+ * @tparam Real - element type
+ * @tparam Type - execution policy type
+ * @tparam Vectorized - SIMD vectorization
+ * @tparam Acc - accumulator of the sums (Real, or double for float storage)
+ */
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+static void sum_and_copy_static(const std::vector<Real> &arr, std::vector<Real> &halve_arr,
+                                size_t start, size_t size, Acc &sum, Acc &sum2) {
+
+    // one chunk per thread of the pool - the chunks of nested calls are executed by the same threads
+    size_t max_num_threads = static_num_threads<Type>();
     size_t chunk_size = size / max_num_threads;
 
     // local sums and sum of squares for each thread
-    std::vector<real> local_sums(max_num_threads, 0.0);
-    std::vector<real> local_sums2(max_num_threads, 0.0);
-
-    // vector to hold the chunk indices for each thread
-    std::vector<size_t> chunk_indices(max_num_threads);
-    std::iota(chunk_indices.begin(), chunk_indices.end(), 0); // pre-calculate chunk indices
-
-    std::visit([&](auto &&exec_policy) {
-        std::for_each(exec_policy, chunk_indices.begin(), chunk_indices.end(),
-                      [&](const auto &chunk_id) {
-                          size_t start_chunk = chunk_id * chunk_size;
-                          size_t end_chunk = (chunk_id == max_num_threads - 1) ? size : start_chunk + chunk_size;
-
-                          for (size_t i = start_chunk; i < end_chunk; i++) {
-                              real val = arr[i + start];  // get value from original array
-                              halve_arr[i] = val;  // copy value to halve array
-
-                              // accumulate sum and sum of squares for this chunk
-                              local_sums[chunk_id] += val;
-                              local_sums2[chunk_id] += val * val;
-                          }
-                      });
-    }, policy.get_policy());
+    std::vector<Acc> local_sums(max_num_threads, static_cast<Acc>(0.0));
+    std::vector<Acc> local_sums2(max_num_threads, static_cast<Acc>(0.0));
+
+    static_for<Type>(0, max_num_threads, [&](size_t chunk_id) {
+        size_t start_chunk = chunk_id * chunk_size;
+        size_t end_chunk = (chunk_id == max_num_threads - 1) ? size : start_chunk + chunk_size;
+
+        if constexpr (Vectorized) {
+            // kernel of the instruction set picked at startup
+            const simd_kernels<Real> &kernels = simd_dispatch<Real>();
+            if constexpr (std::is_same_v<Real, Acc>) {
+                kernels.sum_and_copy(arr.data() + start + start_chunk, halve_arr.data() + start_chunk,
+                                     end_chunk - start_chunk, local_sums[chunk_id], local_sums2[chunk_id]);
+            } else {
+                kernels.sum_and_copy_wide(arr.data() + start + start_chunk, halve_arr.data() + start_chunk,
+                                          end_chunk - start_chunk, local_sums[chunk_id], local_sums2[chunk_id]);
+            }
+        } else {
+            for (size_t i = start_chunk; i < end_chunk; i++) {
+                Real val = arr[i + start];  // get value from original array
+                halve_arr[i] = val;  // copy value to halve array
+
+                // accumulate sum and sum of squares for this chunk
+                local_sums[chunk_id] += static_cast<Acc>(val);
+                local_sums2[chunk_id] += static_cast<Acc>(val) * static_cast<Acc>(val);
+            }
+        }
+    });
 
     // combine results from all threads - reduction of local sums
-    sum += std::accumulate(local_sums.begin(), local_sums.end(), static_cast<real>(0.0));
-    sum2 += std::accumulate(local_sums2.begin(), local_sums2.end(), static_cast<real>(0.0));
+    sum += std::accumulate(local_sums.begin(), local_sums.end(), static_cast<Acc>(0.0));
+    sum2 += std::accumulate(local_sums2.begin(), local_sums2.end(), static_cast<Acc>(0.0));
 }
 
-void sum_and_copy_vec(const std::vector<real> &arr, std::vector<real> &halve_arr,
-                      size_t start, size_t size, real &sum, real &sum2,
-                      const execution_policy &policy) {
-
-    size_t max_num_threads = std::thread::hardware_concurrency();
-    size_t chunk_size = size / max_num_threads;
-    size_t stride = sizeof(STRIDE) / sizeof(real);
-
-    // local sums and sum of squares for each thread
-    std::vector<real> local_sums(max_num_threads, static_cast<real>(0.0));
-    std::vector<real> local_sums2(max_num_threads, static_cast<real>(0.0));
-
-    // vector to hold the chunk indices for each thread
-    std::vector<size_t> chunk_indices(max_num_threads);
-    std::iota(chunk_indices.begin(), chunk_indices.end(), 0); // pre-calculate chunk indices
-
-    std::visit([&](auto &&exec_policy) {
-        std::for_each(exec_policy, chunk_indices.begin(), chunk_indices.end(),
-                      [&](const auto &chunk_id) {
-                          size_t start_chunk = chunk_id * chunk_size;
-                          size_t end_chunk = (chunk_id == max_num_threads - 1) ? size : start_chunk + chunk_size;
-
-                          auto vec_sum = SETZERO();
-                          auto vec_sum2 = SETZERO();
-
-                          for (size_t i = start_chunk; i < end_chunk; i += stride) {
-                              auto vec_vals = LOAD(&arr[i + start]); // load elements
-                              STORE(&halve_arr[i], vec_vals); // store elements
-                              vec_sum = ADD(vec_sum, vec_vals); // accumulate sum
-                              vec_sum2 = ADD(vec_sum2, MUL(vec_vals, vec_vals)); // accumulate sum of squares
-                          }
-
-                          // horizontal sum - sum of vector elements
-                          std::vector<real> temp_sum(stride, static_cast<real>(0.0));
-                          std::vector<real> temp_sum2(stride, static_cast<real>(0.0));
-                          STORE(temp_sum.data(), vec_sum);
-                          STORE(temp_sum2.data(), vec_sum2);
-                          for (size_t k = 0; k < stride; k++) {
-                              local_sums[chunk_id] += temp_sum[k];
-                              local_sums2[chunk_id] += temp_sum2[k];
-                          }
-
-                          // handle any remaining elements (less than stride) in the tail
-                          for (size_t i = end_chunk - (end_chunk % stride); i < end_chunk; i++) {
-                              real val = arr[i + start];  // get value from original array
-                              halve_arr[i] = val;  // copy value to halve array
-
-                              // accumulate sum and sum of squares for this chunk
-                              local_sums[chunk_id] += val;
-                              local_sums2[chunk_id] += val * val;
-                          }
-                      });
-    }, policy.get_policy());
+template<typename Real, typename Acc>
+void sum_and_copy(const std::vector<Real> &arr, std::vector<Real> &halve_arr,
+                  size_t start, size_t size, Acc &sum, Acc &sum2,
+                  const execution_policy &policy) {
+    dispatch_static(policy, false, [&](auto type, auto vectorized) {
+        sum_and_copy_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, halve_arr, start, size, sum, sum2);
+    });
+}
 
-    // combine results from all threads - reduction of local sums
-    sum += std::accumulate(local_sums.begin(), local_sums.end(), static_cast<real>(0.0));
-    sum2 += std::accumulate(local_sums2.begin(), local_sums2.end(), static_cast<real>(0.0));
+template<typename Real, typename Acc>
+void sum_and_copy_vec(const std::vector<Real> &arr, std::vector<Real> &halve_arr,
+                      size_t start, size_t size, Acc &sum, Acc &sum2,
+                      const execution_policy &policy) {
+    dispatch_static(policy, true, [&](auto type, auto vectorized) {
+        sum_and_copy_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, halve_arr, start, size, sum, sum2);
+    });
 }
 
-void merge_and_count(std::vector<real> &arr, size_t l, size_t m, size_t r, real &sum, real &sum2,
-                     const bool is_vectorized, const execution_policy &policy) {
+/**
+ * @brief Merges two halves arr[l..m] and arr[m+1..r] of the array and counts the sum and sum of squared elements
+ * @tparam Real - element type
+ * @tparam Type - execution policy type
+ * @tparam Vectorized - SIMD vectorization
+ * @tparam Acc - accumulator of the sums
+ */
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+static void merge_and_count_static(std::vector<Real> &arr, size_t l, size_t m, size_t r, Acc &sum, Acc &sum2) {
     size_t n1 = m - l + 1;
     size_t n2 = r - m;
 
-    std::vector<real> L(n1);
-    std::vector<real> R(n2);
+    std::vector<Real> L(n1);
+    std::vector<Real> R(n2);
 
-    if (is_vectorized) {
-        sum_and_copy_vec(arr, L, l, n1, sum, sum2, policy);
-        sum_and_copy_vec(arr, R, m + 1, n2, sum, sum2, policy);
-    } else {
-        sum_and_copy(arr, L, l, n1, sum, sum2, policy);
-        sum_and_copy(arr, R, m + 1, n2, sum, sum2, policy);
-    }
+    sum_and_copy_static<Real, Type, Vectorized>(arr, L, l, n1, sum, sum2);
+    sum_and_copy_static<Real, Type, Vectorized>(arr, R, m + 1, n2, sum, sum2);
 
     merge(arr, l, n1, n2, L, R);
 }
 
-void merge_no_count(std::vector<real> &arr, size_t l, size_t m, size_t r) {
+template<typename Real, typename Acc>
+void merge_and_count(std::vector<Real> &arr, size_t l, size_t m, size_t r, Acc &sum, Acc &sum2,
+                     const bool is_vectorized, const execution_policy &policy) {
+    dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        merge_and_count_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, l, m, r, sum, sum2);
+    });
+}
+
+template<typename Real>
+void merge_no_count(std::vector<Real> &arr, size_t l, size_t m, size_t r) {
     size_t n1 = m - l + 1; // size of left half
     size_t n2 = r - m; // size of right half
 
     // copy data to temp arrays L[] and R[]
-    std::vector<real> L(arr.begin() + static_cast<int>(l),
+    std::vector<Real> L(arr.begin() + static_cast<int>(l),
                           arr.begin() + static_cast<int>(l) + static_cast<int>(n1));
-    std::vector<real> R(arr.begin() + static_cast<int>(m) + 1,
+    std::vector<Real> R(arr.begin() + static_cast<int>(m) + 1,
                           arr.begin() + static_cast<int>(m) + 1 + static_cast<int>(n2));
 
 
     merge(arr, l, n1, n2, L, R);
 }
 
-void merge(std::vector<real> &arr, size_t l, size_t n1, size_t n2, const std::vector<real> &L,
-           const std::vector<real> &R) {
+template<typename Real>
+void merge(std::vector<Real> &arr, size_t l, size_t n1, size_t n2, const std::vector<Real> &L,
+           const std::vector<Real> &R) {
     size_t i = 0, j = 0, k = l;
     while (i < n1 && j < n2) { // while there are elements in both halves
         arr[k++] = L[i] <= R[j] ? L[i++] : R[j++]; // copy the smaller element
@@ -147,41 +131,105 @@ void merge(std::vector<real> &arr, size_t l, size_t n1, size_t n2, const std::ve
     }
 }
 
-int mergeSort(std::vector<real> &arr, real &sum, real &sum2, const bool is_vectorized,
-              const execution_policy &policy) {
+template<typename Real>
+void merge_runs(std::vector<Real> &arr, size_t run_size) {
+    size_t n = arr.size();
+    if (run_size >= n) { // single run - already sorted
+        return;
+    }
+
+    // heap of the current heads of the runs - (value, run index), smallest value on top
+    using head = std::pair<Real, size_t>;
+    std::priority_queue<head, std::vector<head>, std::greater<>> heads;
+    std::vector<size_t> positions; // next unread element of each run
+    for (size_t start = 0; start < n; start += run_size) {
+        heads.emplace(arr[start], positions.size());
+        positions.push_back(start + 1);
+    }
+
+    std::vector<Real> merged;
+    merged.reserve(n);
+    while (!heads.empty()) {
+        auto [value, run] = heads.top();
+        heads.pop();
+        merged.push_back(value);
+
+        // push the next element of the same run
+        size_t run_end = std::min((run + 1) * run_size, n);
+        if (positions[run] < run_end) {
+            heads.emplace(arr[positions[run]++], run);
+        }
+    }
+    arr.swap(merged);
+}
+
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int merge_sort_static(std::vector<Real> &arr, Acc &sum, Acc &sum2) {
     size_t n = arr.size();
     size_t curr_size;
     // divide the array into halves of size 1, 2, 4, 8, ... until the size is less than half the array size
     for (curr_size = 1; curr_size <= (n - 1) / 2; curr_size = 2 * curr_size) {
-        // indices pre-calculation
-        std::vector<size_t> left_starts;
-        for (size_t left_start = 0; left_start < n - 1; left_start += 2 * curr_size) {
-            left_starts.push_back(left_start);
-        }
-        // merge the halves
-        std::visit([&](auto &&exec_policy) {
-            std::for_each(exec_policy, left_starts.begin(), left_starts.end(), [&](size_t left_start) {
-                size_t mid = std::min(left_start + curr_size - 1, n - 1);
-                size_t right_end = std::min(left_start + 2 * curr_size - 1, n - 1);
-                merge_no_count(arr, left_start, mid, right_end);
-            });
-        }, policy.get_policy());
-    }
-    // last iteration - merge and count the sum and sum of squares
-    // indices pre-calculation
-    std::vector<size_t> left_starts;
-    for (size_t left_start = 0; left_start < n - 1; left_start += 2 * curr_size) {
-        left_starts.push_back(left_start);
-    }
-    // merge the halves and count the sum and sum of squares
-    std::visit([&](auto &&exec_policy) {
-        std::for_each(exec_policy, left_starts.begin(), left_starts.end(), [&](size_t left_start) {
+        // merge the halves - the pool groups the small merges of the first passes into larger tasks
+        size_t num_merges = (n - 1 + 2 * curr_size - 1) / (2 * curr_size);
+        static_for<Type>(0, num_merges, [&](size_t merge_id) {
+            size_t left_start = merge_id * 2 * curr_size;
             size_t mid = std::min(left_start + curr_size - 1, n - 1);
             size_t right_end = std::min(left_start + 2 * curr_size - 1, n - 1);
-            merge_and_count(arr, left_start, mid, right_end, sum, sum2, is_vectorized, policy);
+            merge_no_count(arr, left_start, mid, right_end);
         });
-    }, policy.get_policy());
+    }
+    // last iteration - merge and count the sum and sum of squares
+    size_t num_merges = (n - 1 + 2 * curr_size - 1) / (2 * curr_size);
+    // merge the halves and count the sum and sum of squares
+    static_for<Type>(0, num_merges, [&](size_t merge_id) {
+        size_t left_start = merge_id * 2 * curr_size;
+        size_t mid = std::min(left_start + curr_size - 1, n - 1);
+        size_t right_end = std::min(left_start + 2 * curr_size - 1, n - 1);
+        merge_and_count_static<Real, Type, Vectorized>(arr, left_start, mid, right_end, sum, sum2);
+    });
 
     return EXIT_SUCCESS;
 }
 
+template<typename Real, typename Acc>
+int mergeSort(std::vector<Real> &arr, Acc &sum, Acc &sum2, const bool is_vectorized,
+              const execution_policy &policy) {
+    return dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        return merge_sort_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, sum, sum2);
+    });
+}
+
+// instantiations of both precisions - the engines use merge_sort_static with the policy and vectorization fixed
+// at compile time, the rest of the program the runtime dispatched functions
+#define INSTANTIATE_MERGE_SORT(Real) \
+    template void merge_no_count(std::vector<Real> &, size_t, size_t, size_t); \
+    template void merge(std::vector<Real> &, size_t, size_t, size_t, const std::vector<Real> &, \
+                        const std::vector<Real> &); \
+    template void merge_runs(std::vector<Real> &, size_t);
+
+// functions computing the sums - instantiated for every pair of the element type and the accumulator
+#define INSTANTIATE_MERGE_SORT_SUMS(Real, Acc) \
+    template void sum_and_copy(const std::vector<Real> &, std::vector<Real> &, size_t, size_t, Acc &, Acc &, \
+                               const execution_policy &); \
+    template void sum_and_copy_vec(const std::vector<Real> &, std::vector<Real> &, size_t, size_t, Acc &, Acc &, \
+                                   const execution_policy &); \
+    template void merge_and_count(std::vector<Real> &, size_t, size_t, size_t, Acc &, Acc &, bool, \
+                                  const execution_policy &); \
+    template int mergeSort(std::vector<Real> &, Acc &, Acc &, bool, const execution_policy &); \
+    template int merge_sort_static<Real, execution_policy::e_type::Sequential, false>(std::vector<Real> &, Acc &, \
+                                                                                      Acc &); \
+    template int merge_sort_static<Real, execution_policy::e_type::Sequential, true>(std::vector<Real> &, Acc &, \
+                                                                                     Acc &); \
+    template int merge_sort_static<Real, execution_policy::e_type::Parallel, false>(std::vector<Real> &, Acc &, \
+                                                                                    Acc &); \
+    template int merge_sort_static<Real, execution_policy::e_type::Parallel, true>(std::vector<Real> &, Acc &, Acc &);
+
+INSTANTIATE_MERGE_SORT(float)
+
+INSTANTIATE_MERGE_SORT(double)
+
+INSTANTIATE_MERGE_SORT_SUMS(float, float)
+
+INSTANTIATE_MERGE_SORT_SUMS(float, double) // float storage with double accumulation
+
+INSTANTIATE_MERGE_SORT_SUMS(double, double)
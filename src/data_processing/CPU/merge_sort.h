@@ -4,10 +4,10 @@
 #include <cmath>
 #include <iostream>
 #include <algorithm>
-#include <execution>
-#include <immintrin.h>
+#include <queue>
 
 #include "my_utils.h"
+#include "simd_kernels.h"
 
 /**
  * @brief Sums the elements of the array from start to start + size and copies them to halve_arr
@@ -19,13 +19,14 @@
  * @param sum2 - sum of squared elements (output)
  * @param policy - execution policy - parallel or sequential
  */
-void sum_and_copy(const std::vector<real> &arr, std::vector<real> &halve_arr,
-                  size_t start, size_t size, real &sum, real &sum2,
+template<typename Real, typename Acc>
+void sum_and_copy(const std::vector<Real> &arr, std::vector<Real> &halve_arr,
+                  size_t start, size_t size, Acc &sum, Acc &sum2,
                   const execution_policy &policy);
 
 
 /**
- * @brief Sums the elements of the array from start to start + size and copies them to halve_arr using AVX2
+ * @brief Sums the elements of the array from start to start + size and copies them to halve_arr using SIMD kernels
  * @param arr - vector to sum and copy the elements from
  * @param halve_arr - vector to copy the elements to
  * @param start - start index to sum and copy from
@@ -34,8 +35,9 @@ void sum_and_copy(const std::vector<real> &arr, std::vector<real> &halve_arr,
  * @param sum2 - sum of squared elements (output)
  * @param policy - execution policy - parallel or sequential
  */
-void sum_and_copy_vec(const std::vector<real> &arr, std::vector<real> &halve_arr,
-                      size_t start, size_t size, real &sum, real &sum2,
+template<typename Real, typename Acc>
+void sum_and_copy_vec(const std::vector<Real> &arr, std::vector<Real> &halve_arr,
+                      size_t start, size_t size, Acc &sum, Acc &sum2,
                       const execution_policy &policy);
 
 /**
@@ -49,8 +51,9 @@ void sum_and_copy_vec(const std::vector<real> &arr, std::vector<real> &halve_arr
  * @param is_vectorized - flag to indicate if vectorization is enabled
  * @param policy - execution policy - parallel or sequential
  */
-void merge_and_count(std::vector<real> &arr, size_t l, size_t m, size_t r,
-                     real &sum, real &sum2, bool is_vectorized, const execution_policy &policy);
+template<typename Real, typename Acc>
+void merge_and_count(std::vector<Real> &arr, size_t l, size_t m, size_t r,
+                     Acc &sum, Acc &sum2, bool is_vectorized, const execution_policy &policy);
 
 /**
  * @brief Merges two halves arr[l..m] and arr[m+1..r] of the array
@@ -59,7 +62,8 @@ void merge_and_count(std::vector<real> &arr, size_t l, size_t m, size_t r,
  * @param m - middle index - end index of the left half and start index of the right half
  * @param r - end index of the right half
  */
-void merge_no_count(std::vector<real> &arr, size_t l, size_t m, size_t r);
+template<typename Real>
+void merge_no_count(std::vector<Real> &arr, size_t l, size_t m, size_t r);
 
 
 /**
@@ -71,11 +75,22 @@ void merge_no_count(std::vector<real> &arr, size_t l, size_t m, size_t r);
  * @param L - left half (size n1) - ascending order
  * @param R - right half (size n2) - ascending order
  */
-void merge(std::vector<real> &arr, size_t l, size_t n1, size_t n2,
-           const std::vector<real> &L, const std::vector<real> &R);
+template<typename Real>
+void merge(std::vector<Real> &arr, size_t l, size_t n1, size_t n2,
+           const std::vector<Real> &L, const std::vector<Real> &R);
+
+/**
+ * @brief K-way merge of consecutive sorted runs of the array
+ * @param arr - vector consisting of sorted runs of run_size elements (the last one may be shorter) - sorted (output)
+ * @param run_size - number of elements of one run
+ */
+template<typename Real>
+void merge_runs(std::vector<Real> &arr, size_t run_size);
 
 /**
  * @brief Merge sort algorithm to sort the vector and calculate sum and sum of squared elements
+ * @tparam Real - element type (float or double)
+ * @tparam Acc - accumulator of the sums - Real, or double for float storage with double accumulation
  * @param arr - vector to sort
  * @param sum - sum of elements (output)
  * @param sum2 - sum of squared elements (output)
@@ -83,4 +98,20 @@ void merge(std::vector<real> &arr, size_t l, size_t n1, size_t n2,
  * @param policy - execution policy - parallel or sequential
  * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
  */
-int mergeSort(std::vector<real> &arr, real &sum, real &sum2, bool is_vectorized, const execution_policy &policy);
+template<typename Real, typename Acc>
+int mergeSort(std::vector<Real> &arr, Acc &sum, Acc &sum2, bool is_vectorized, const execution_policy &policy);
+
+/**
+ * @brief Merge sort with the execution policy and vectorization fixed at compile time (instantiated for all four
+ * combinations and all pairs of the element type and the accumulator in merge_sort.cpp)
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Vectorized - SIMD vectorization of the sums
+ * @tparam Acc - accumulator of the sums (deduced from the sums)
+ * @param arr - vector to sort
+ * @param sum - sum of elements (output)
+ * @param sum2 - sum of squared elements (output)
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ */
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int merge_sort_static(std::vector<Real> &arr, Acc &sum, Acc &sum2);
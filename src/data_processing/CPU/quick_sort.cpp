@@ -0,0 +1,366 @@
+#include "quick_sort.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#define QUICKSORT_INSERTION_SIZE 32 // largest range sorted by insertion sort
+#define QUICKSORT_NINTHER_SIZE 128 // smallest range with the pivot chosen as the ninther
+#define QUICKSORT_MIN_BLOCK (1u << 14) // smallest block of the parallel partition, elements
+#define QUICKSORT_MIN_TASK (1u << 16) // smallest range with its sides sorted as separate tasks
+#define QUICKSORT_SUM_TILE 2048 // elements summed by the SIMD kernels at once ahead of the partition
+
+namespace {
+    /**
+     * @brief Add an element to the sums if they are counted by the partition
+     */
+    template<bool Count, typename Real, typename Acc>
+    void add_sums(Real value, Acc &sum, Acc &sum2) {
+        if constexpr (Count) {
+            sum += static_cast<Acc>(value);
+            sum2 += static_cast<Acc>(value) * static_cast<Acc>(value);
+        }
+    }
+
+    /**
+     * @brief Sums of a range by the kernel of the instruction set picked at startup
+     */
+    template<typename Real, typename Acc>
+    void kernel_sums(const Real *data, size_t n, Acc &sum, Acc &sum2) {
+        const simd_kernels<Real> &kernels = simd_dispatch<Real>();
+        Acc range_sum = 0, range_sum2 = 0;
+        if constexpr (std::is_same_v<Real, Acc>) {
+            kernels.block_sums(data, n, range_sum, range_sum2);
+        } else {
+            kernels.block_sums_wide(data, n, range_sum, range_sum2);
+        }
+        sum += range_sum;
+        sum2 += range_sum2;
+    }
+
+    /**
+     * @brief Sums of the elements of a range counted while the range is partitioned - the scalar variant adds every
+     * element the partition reads, the vectorized one sums the untouched middle of the range by the SIMD kernels in
+     * tiles just before the partition reaches them from the front or from the back, so the tiles are read again
+     * from the cache and the range is read from memory once
+     * @tparam Count - count the sums (the first partition only)
+     * @tparam Vectorized - sum by the SIMD kernels
+     */
+    template<bool Count, bool Vectorized, typename Real, typename Acc>
+    class partition_sums {
+    public:
+        partition_sums(Real *first, Real *last, Acc &sum, Acc &sum2)
+                : front_summed(first), back_summed(last), sum(sum), sum2(sum2) {}
+
+        /**
+         * @brief The partition read the element
+         */
+        void read(Real value) {
+            if constexpr (Count && !Vectorized) {
+                add_sums<true>(value, sum, sum2);
+            }
+        }
+
+        /**
+         * @brief The partition is going to read the element at the position from the front
+         */
+        void reach_front(const Real *position) {
+            if constexpr (Count && Vectorized) {
+                if (position >= front_summed && front_summed < back_summed) {
+                    Real *end = back_summed - front_summed > QUICKSORT_SUM_TILE ? front_summed + QUICKSORT_SUM_TILE
+                                                                                : back_summed;
+                    kernel_sums(front_summed, static_cast<size_t>(end - front_summed), sum, sum2);
+                    front_summed = end;
+                }
+            } else {
+                (void) position;
+            }
+        }
+
+        /**
+         * @brief The partition is going to read (or move) the element at the position from the back
+         */
+        void reach_back(const Real *position) {
+            if constexpr (Count && Vectorized) {
+                if (position < back_summed && front_summed < back_summed) {
+                    Real *begin = back_summed - front_summed > QUICKSORT_SUM_TILE ? back_summed - QUICKSORT_SUM_TILE
+                                                                                  : front_summed;
+                    kernel_sums(begin, static_cast<size_t>(back_summed - begin), sum, sum2);
+                    back_summed = begin;
+                }
+            } else {
+                (void) position;
+            }
+        }
+
+    private:
+        Real *front_summed; // the elements before it are summed
+        Real *back_summed; // the elements from it on are summed - the ones between are not touched yet
+        Acc &sum;
+        Acc &sum2;
+    };
+
+    template<typename Real>
+    void insertion_sort(Real *first, Real *last) {
+        for (Real *i = first + 1; i < last; ++i) {
+            Real value = *i;
+            Real *j = i;
+            for (; j > first && value < *(j - 1); --j) {
+                *j = *(j - 1);
+            }
+            *j = value;
+        }
+    }
+
+    template<typename Real>
+    Real median_of_three(Real a, Real b, Real c) {
+        return std::max(std::min(a, b), std::min(std::max(a, b), c));
+    }
+
+    /**
+     * @brief Pivot of a range - median of the first, middle and last element, or of the medians of three triples
+     * spread over the range (ninther) if the range is long
+     */
+    template<typename Real>
+    Real choose_pivot(const Real *data, size_t n) {
+        if (n < QUICKSORT_NINTHER_SIZE) {
+            return median_of_three(data[0], data[n / 2], data[n - 1]);
+        }
+        const size_t step = n / 8;
+        return median_of_three(median_of_three(data[0], data[step], data[2 * step]),
+                               median_of_three(data[3 * step], data[n / 2], data[5 * step]),
+                               median_of_three(data[6 * step], data[7 * step], data[n - 1]));
+    }
+
+    /**
+     * @brief Three-way partition - every element is read once
+     * @param sums - sums of the range (counted by the partition)
+     * @return first element equal to the pivot and the first one greater than the pivot
+     */
+    template<typename Real, typename Sums>
+    std::pair<Real *, Real *> partition_three_way(Real *first, Real *last, Real pivot, Sums &sums) {
+        Real *less = first, *i = first, *greater = last;
+        while (i < greater) {
+            sums.reach_front(i);
+            const Real value = *i;
+            sums.read(value);
+            if (value < pivot) {
+                std::swap(*less++, *i++);
+            } else if (pivot < value) {
+                sums.reach_back(greater - 1);
+                std::swap(*i, *--greater); // the swapped element is read in the next step
+            } else {
+                ++i;
+            }
+        }
+        return {less, greater};
+    }
+
+    /**
+     * @brief Two-way partition of a block (Hoare) - every element is read once
+     * @param is_left - predicate of the elements moved to the beginning
+     * @param sums - sums of the block (counted by the partition)
+     * @return first element not satisfying the predicate
+     */
+    template<typename Real, typename Pred, typename Sums>
+    Real *partition_two_way(Real *first, Real *last, Pred is_left, Sums &sums) {
+        for (;;) {
+            while (first != last) {
+                sums.reach_front(first);
+                if (!is_left(*first)) {
+                    break;
+                }
+                sums.read(*first++);
+            }
+            if (first == last) {
+                return first;
+            }
+            // *first belongs to the right side - find an element of the left side from the end
+            for (;;) {
+                if (--last == first) {
+                    sums.read(*first);
+                    return first;
+                }
+                sums.reach_back(last);
+                sums.read(*last);
+                if (is_left(*last)) {
+                    break;
+                }
+            }
+            std::swap(*first, *last);
+            sums.read(*last);
+            ++first;
+        }
+    }
+
+    /**
+     * @brief Position of an element among the elements of consecutive ranges
+     * @param ranges - ranges of indices (first index and the index after the last one)
+     * @param k - index among the elements of all ranges (smaller than their number)
+     * @return range and the index of the element
+     */
+    std::pair<size_t, size_t> seek(const std::vector<std::pair<size_t, size_t>> &ranges, size_t k) {
+        size_t range = 0;
+        while (k >= ranges[range].second - ranges[range].first) {
+            k -= ranges[range].second - ranges[range].first;
+            ++range;
+        }
+        return {range, ranges[range].first + k};
+    }
+
+    /**
+     * @brief Parallel two-way partition in place - every block is partitioned by one task, then the elements of the
+     * right side found before the boundary are swapped with the elements of the left side found after it
+     * @param is_left - predicate of the elements moved to the beginning
+     * @return number of elements of the left side
+     */
+    template<typename Real, execution_policy::e_type Type, bool Count, bool Vectorized, typename Acc, typename Pred>
+    size_t partition_parallel(Real *data, size_t n, Pred is_left, Acc &sum, Acc &sum2) {
+        const size_t blocks = std::clamp<size_t>(n / QUICKSORT_MIN_BLOCK, 1, static_num_threads<Type>());
+        std::vector<size_t> left_sizes(blocks);
+        std::vector<Acc> local_sums(blocks, static_cast<Acc>(0.0));
+        std::vector<Acc> local_sums2(blocks, static_cast<Acc>(0.0));
+        static_for<Type>(0, blocks, [&](size_t block) {
+            Real *first = data + n * block / blocks, *last = data + n * (block + 1) / blocks;
+            partition_sums<Count, Vectorized, Real, Acc> sums(first, last, local_sums[block], local_sums2[block]);
+            left_sizes[block] = static_cast<size_t>(partition_two_way(first, last, is_left, sums) - first);
+        });
+        if constexpr (Count) {
+            sum += std::accumulate(local_sums.begin(), local_sums.end(), static_cast<Acc>(0.0));
+            sum2 += std::accumulate(local_sums2.begin(), local_sums2.end(), static_cast<Acc>(0.0));
+        }
+
+        // misplaced elements - the right side of the blocks before the boundary, the left side after it
+        const size_t boundary = std::accumulate(left_sizes.begin(), left_sizes.end(), static_cast<size_t>(0));
+        std::vector<std::pair<size_t, size_t>> right_before, left_after;
+        size_t misplaced = 0;
+        for (size_t block = 0; block < blocks; ++block) {
+            const size_t begin = n * block / blocks, middle = begin + left_sizes[block];
+            const size_t end = n * (block + 1) / blocks;
+            if (middle < std::min(end, boundary)) {
+                right_before.emplace_back(middle, std::min(end, boundary));
+                misplaced += std::min(end, boundary) - middle;
+            }
+            if (std::max(begin, boundary) < middle) {
+                left_after.emplace_back(std::max(begin, boundary), middle);
+            }
+        }
+
+        // both sides have the same number of misplaced elements - every task swaps an equal part of them
+        const size_t tasks = std::clamp<size_t>(misplaced / QUICKSORT_MIN_BLOCK, 1, blocks);
+        static_for<Type>(0, misplaced > 0 ? tasks : 0, [&](size_t task) {
+            const size_t k_begin = misplaced * task / tasks, k_end = misplaced * (task + 1) / tasks;
+            auto [right_range, i] = seek(right_before, k_begin);
+            auto [left_range, j] = seek(left_after, k_begin);
+            for (size_t k = k_begin; k < k_end; ++k) {
+                std::swap(data[i++], data[j++]);
+                if (i == right_before[right_range].second && right_range + 1 < right_before.size()) {
+                    i = right_before[++right_range].first;
+                }
+                if (j == left_after[left_range].second && left_range + 1 < left_after.size()) {
+                    j = left_after[++left_range].first;
+                }
+            }
+        });
+        return boundary;
+    }
+
+    /**
+     * @brief Sort a range in place
+     * @tparam Count - count the sums by the partition of the range (the first call only)
+     * @param depth - partitions left before switching to heap sort
+     */
+    template<typename Real, execution_policy::e_type Type, bool Vectorized, bool Count, typename Acc>
+    void sort_range(Real *data, size_t n, size_t depth, Acc &sum, Acc &sum2) {
+        if (n <= QUICKSORT_INSERTION_SIZE) {
+            if constexpr (Count) {
+                for (size_t i = 0; i < n; ++i) {
+                    add_sums<Count>(data[i], sum, sum2);
+                }
+            }
+            insertion_sort(data, data + n);
+            return;
+        }
+        if (depth == 0) { // degenerate pivots - heap sort keeps the recursion bounded
+            if constexpr (Count) {
+                for (size_t i = 0; i < n; ++i) {
+                    add_sums<Count>(data[i], sum, sum2);
+                }
+            }
+            std::make_heap(data, data + n);
+            std::sort_heap(data, data + n);
+            return;
+        }
+
+        const Real pivot = choose_pivot(data, n);
+        size_t less_end, greater_begin;
+        if (Type == execution_policy::e_type::Parallel && n >= 2 * QUICKSORT_MIN_BLOCK) {
+            less_end = partition_parallel<Real, Type, Count, Vectorized>(data, n, [pivot](Real value) {
+                return value < pivot;
+            }, sum, sum2);
+            greater_begin = less_end;
+            if (less_end == 0) { // the pivot is the smallest element - split off the elements equal to it
+                greater_begin = partition_parallel<Real, Type, false, false>(data, n, [pivot](Real value) {
+                    return !(pivot < value);
+                }, sum, sum2);
+            }
+        } else {
+            partition_sums<Count, Vectorized, Real, Acc> sums(data, data + n, sum, sum2);
+            auto [less, greater] = partition_three_way(data, data + n, pivot, sums);
+            less_end = static_cast<size_t>(less - data);
+            greater_begin = static_cast<size_t>(greater - data);
+        }
+
+        // the sides are sorted as two tasks if they are long enough to pay for them
+        Acc unused_sum = 0, unused_sum2 = 0;
+        auto sort_side = [&](size_t side) {
+            if (side == 0) {
+                sort_range<Real, Type, Vectorized, false>(data, less_end, depth - 1, unused_sum, unused_sum2);
+            } else {
+                sort_range<Real, Type, Vectorized, false>(data + greater_begin, n - greater_begin, depth - 1,
+                                                          unused_sum, unused_sum2);
+            }
+        };
+        if (n >= QUICKSORT_MIN_TASK) {
+            static_for<Type>(0, 2, sort_side);
+        } else {
+            sort_side(0);
+            sort_side(1);
+        }
+    }
+}
+
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int quick_sort_static(std::vector<Real> &arr, Acc &sum, Acc &sum2) {
+    const size_t n = arr.size();
+    size_t depth = 0; // 2 log2(n) like introsort
+    for (size_t size = n; size > 1; size >>= 1) {
+        depth += 2;
+    }
+    sort_range<Real, Type, Vectorized, true>(arr.data(), n, depth, sum, sum2);
+    return EXIT_SUCCESS;
+}
+
+template<typename Real, typename Acc>
+int quickSort(std::vector<Real> &arr, Acc &sum, Acc &sum2, const bool is_vectorized,
+              const execution_policy &policy) {
+    return dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        return quick_sort_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, sum, sum2);
+    });
+}
+
+#define INSTANTIATE_QUICK_SORT(Real, Acc) \
+    template int quickSort(std::vector<Real> &, Acc &, Acc &, bool, const execution_policy &); \
+    template int quick_sort_static<Real, execution_policy::e_type::Sequential, false>(std::vector<Real> &, Acc &, \
+                                                                                      Acc &); \
+    template int quick_sort_static<Real, execution_policy::e_type::Sequential, true>(std::vector<Real> &, Acc &, \
+                                                                                     Acc &); \
+    template int quick_sort_static<Real, execution_policy::e_type::Parallel, false>(std::vector<Real> &, Acc &, \
+                                                                                    Acc &); \
+    template int quick_sort_static<Real, execution_policy::e_type::Parallel, true>(std::vector<Real> &, Acc &, Acc &);
+
+INSTANTIATE_QUICK_SORT(float, float)
+
+INSTANTIATE_QUICK_SORT(float, double) // float storage with double accumulation
+
+INSTANTIATE_QUICK_SORT(double, double)
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "my_utils.h"
+#include "simd_kernels.h"
+
+/**
+ * @brief In-place quicksort calculating the sum and sum of squared elements - the extra memory is the recursion
+ * (O(log n)) and the bounds of the blocks of the parallel partitions (O(number of threads)), so it fits the nodes
+ * without the memory for the halves of the merge sort
+ *
+ * @details
+ *  - the ranges are split by the pivot chosen as the median of three (ninther for the long ones); the ranges longer
+ *    than the threshold of the parallel partition are split into one block per thread, every block partitioned in
+ *    place and the misplaced elements of the blocks swapped in parallel
+ *  - the ranges shorter than the threshold are split by the three-way partition, so the runs of equal elements of
+ *    the quantized columns are not sorted again
+ *  - the two sides of every partition are sorted as tasks of the thread pool, too deep recursion switches to heap
+ *    sort and the short ranges to insertion sort
+ *  - the sums are counted by the first partition, which reads every element once - if vectorized, the SIMD kernels
+ *    sum the untouched elements in tiles just before the partition reaches them, so the tiles are read again from the
+ *    cache, not from memory
+ *
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Vectorized - SIMD vectorization of the sums
+ * @tparam Acc - accumulator of the sums (deduced from the sums)
+ * @param arr - vector to sort
+ * @param sum - sum of elements (output)
+ * @param sum2 - sum of squared elements (output)
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ */
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int quick_sort_static(std::vector<Real> &arr, Acc &sum, Acc &sum2);
+
+/**
+ * @brief In-place quicksort calculating the sum and sum of squared elements
+ * @tparam Real - element type (float or double)
+ * @tparam Acc - accumulator of the sums - Real, or double for float storage with double accumulation
+ * @param arr - vector to sort
+ * @param sum - sum of elements (output)
+ * @param sum2 - sum of squared elements (output)
+ * @param is_vectorized - flag to indicate if vectorization is enabled
+ * @param policy - execution policy - parallel or sequential
+ * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+ */
+template<typename Real, typename Acc>
+int quickSort(std::vector<Real> &arr, Acc &sum, Acc &sum2, bool is_vectorized, const execution_policy &policy);
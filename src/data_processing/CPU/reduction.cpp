@@ -0,0 +1,338 @@
+#include "reduction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "simd_kernels.h"
+
+#define REDUCTION_BLOCK_SIZE 4096 // elements of one reproducible block - the blocks do not depend on the threads
+#define EXACT_BLOCK_SIZE (1u << 16) // elements of one exact block - every block has its own accumulator
+#define EXACT_DIGITS 72 // 32-bit digits of the exact accumulator - all doubles from 2^-1074 up and the carries
+#define EXACT_FLUSH (1u << 20) // additions between two carry propagations - the digits cannot overflow
+#define DEKKER_SPLIT 134217729.0 // 2^27 + 1 - splits a double into two halves of 26 bits
+
+namespace {
+    reduction_mode selected_mode = reduction_mode::Fast;
+
+    /**
+     * exact_accumulator class - superaccumulator holding the exact sum of doubles as a fixed-point number of
+     * 32-bit digits, digit i has the weight 2^(32 * i - 1074). The digits are kept in 64-bit integers, so the
+     * carries are propagated only once in a while. The sum does not depend on the order of the additions.
+     */
+    class exact_accumulator {
+    public:
+        void add(double x) {
+            if (x == 0) {
+                return;
+            }
+            if (!std::isfinite(x)) { // infinities and NaNs have no fixed-point value
+                special += x;
+                has_special = true;
+                return;
+            }
+            uint64_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            auto exponent = static_cast<unsigned>((bits >> 52) & 0x7ff);
+            uint64_t mantissa = bits & 0xfffffffffffffull;
+            if (exponent != 0) { // subnormal numbers have no implicit bit and the exponent of the smallest normal
+                mantissa |= 1ull << 52;
+            } else {
+                exponent = 1;
+            }
+            // x = mantissa * 2^(exponent - 1 - 1074) - the mantissa spans three digits from digit shift / 32
+            unsigned shift = exponent - 1;
+            size_t digit = shift / 32;
+            unsigned offset = shift % 32;
+            auto d0 = static_cast<int64_t>((mantissa << offset) & 0xffffffffu);
+            auto d1 = static_cast<int64_t>((offset ? mantissa >> (32 - offset) : mantissa >> 32) & 0xffffffffu);
+            auto d2 = static_cast<int64_t>(offset ? mantissa >> (64 - offset) : 0);
+            if (bits >> 63) {
+                digits[digit] -= d0;
+                digits[digit + 1] -= d1;
+                digits[digit + 2] -= d2;
+            } else {
+                digits[digit] += d0;
+                digits[digit + 1] += d1;
+                digits[digit + 2] += d2;
+            }
+            if (++pending == EXACT_FLUSH) {
+                normalize();
+            }
+        }
+
+        /**
+         * @brief Add the exact square of x - the product is split into two doubles by Dekker's algorithm
+         */
+        void add_square(double x) {
+            double product = x * x;
+            if (!std::isfinite(product)) { // the error term of an overflowed square would be NaN
+                add(product);
+                return;
+            }
+            double c = DEKKER_SPLIT * x;
+            double high = c - (c - x);
+            double low = x - high;
+            add(product);
+            add(((high * high - product) + 2 * high * low) + low * low);
+        }
+
+        void add(const exact_accumulator &other) {
+            for (size_t i = 0; i < EXACT_DIGITS; ++i) {
+                digits[i] += other.digits[i];
+            }
+            special += other.special;
+            has_special = has_special || other.has_special;
+            normalize();
+        }
+
+        /**
+         * @brief Round the exact sum to the nearest double (ties to even)
+         */
+        double round() {
+            if (has_special) {
+                return special;
+            }
+            normalize();
+            // magnitude of a negative sum - the digits of the negated number are positive again after the carries
+            bool negative = digits[EXACT_DIGITS - 1] < 0;
+            if (negative) {
+                for (auto &d: digits) {
+                    d = -d;
+                }
+                normalize();
+            }
+            size_t top = EXACT_DIGITS;
+            while (top > 0 && digits[top - 1] == 0) {
+                --top;
+            }
+            if (top == 0) {
+                return 0;
+            }
+            size_t k = top - 1; // highest nonzero digit
+            auto w2 = static_cast<uint64_t>(digits[k]);
+            auto w1 = static_cast<uint64_t>(k >= 1 ? digits[k - 1] : 0);
+            auto w0 = static_cast<uint64_t>(k >= 2 ? digits[k - 2] : 0);
+            bool sticky = false; // any nonzero bit below the 64 leading ones
+            for (size_t i = 0; i + 2 < k; ++i) {
+                sticky = sticky || digits[i] != 0;
+            }
+            unsigned leading_zeros = 0;
+            while (!(w2 & (0x80000000u >> leading_zeros))) {
+                ++leading_zeros;
+            }
+            // the 64 leading bits of the sum
+            uint64_t leading;
+            if (leading_zeros == 0) {
+                leading = (w2 << 32) | w1;
+                sticky = sticky || w0 != 0;
+            } else {
+                leading = (w2 << (32 + leading_zeros)) | (w1 << leading_zeros) | (w0 >> (32 - leading_zeros));
+                sticky = sticky || (w0 & ((1ull << (32 - leading_zeros)) - 1)) != 0;
+            }
+            // round the 64 bits to the 53 bits of the mantissa
+            uint64_t mantissa = leading >> 11;
+            uint64_t rest = leading & 0x7ff;
+            if (rest > 0x400 || (rest == 0x400 && (sticky || (mantissa & 1)))) {
+                ++mantissa;
+            }
+            // the leading bit has the weight 2^(32 * k + 31 - leading_zeros - 1074), the mantissa 52 bits less
+            int exponent = static_cast<int>(32 * k + 31 - leading_zeros) - 1074 - 52;
+            double value = std::ldexp(static_cast<double>(mantissa), exponent);
+            return negative ? -value : value;
+        }
+
+    private:
+        /**
+         * @brief Propagate the carries - every digit but the highest one in [0, 2^32), the highest one has the sign
+         */
+        void normalize() {
+            for (size_t i = 0; i + 1 < EXACT_DIGITS; ++i) {
+                int64_t carry = digits[i] >> 32; // arithmetic shift - floor division of negative digits
+                digits[i] -= carry * (static_cast<int64_t>(1) << 32);
+                digits[i + 1] += carry;
+            }
+            pending = 0;
+        }
+
+        int64_t digits[EXACT_DIGITS] = {};
+        double special = 0; // sum of the infinities and NaNs
+        bool has_special = false;
+        unsigned pending = 0; // additions since the last carry propagation
+    };
+
+    /**
+     * @brief Sum of the values by a pairwise tree - the shape depends only on the number of values
+     */
+    template<typename Acc>
+    Acc pairwise_sum(const Acc *values, size_t count) {
+        if (count == 0) {
+            return 0;
+        }
+        if (count == 1) {
+            return values[0];
+        }
+        size_t half = count / 2;
+        return pairwise_sum(values, half) + pairwise_sum(values + half, count - half);
+    }
+
+    /**
+     * @brief Add the exact sums of the elements - one accumulator per block, the blocks added in any order
+     */
+    template<typename Real, execution_policy::e_type Type>
+    void add_exact_blocks(const Real *data, size_t n, exact_accumulator &total, exact_accumulator &total2) {
+        size_t num_blocks = (n + EXACT_BLOCK_SIZE - 1) / EXACT_BLOCK_SIZE;
+        std::vector<exact_accumulator> block_sums(num_blocks);
+        std::vector<exact_accumulator> block_sums2(num_blocks);
+        static_for<Type>(0, num_blocks, [&](size_t block) {
+            size_t end = std::min<size_t>(n, (block + 1) * EXACT_BLOCK_SIZE);
+            for (size_t i = block * EXACT_BLOCK_SIZE; i < end; ++i) {
+                block_sums[block].add(static_cast<double>(data[i]));
+                if constexpr (std::is_same_v<Real, float>) { // the square of a float is exact in double
+                    block_sums2[block].add(static_cast<double>(data[i]) * static_cast<double>(data[i]));
+                } else {
+                    block_sums2[block].add_square(data[i]);
+                }
+            }
+        });
+        // the exact sums of the blocks can be added in any order
+        for (size_t block = 0; block < num_blocks; ++block) {
+            total.add(block_sums[block]);
+            total2.add(block_sums2[block]);
+        }
+    }
+
+    /**
+     * @brief Append the sums of the fixed blocks of the elements, summed by the lanes of the kernel
+     */
+    template<typename Real, execution_policy::e_type Type, typename Acc>
+    void append_reproducible_blocks(const Real *data, size_t n, std::vector<Acc> &block_sums,
+                                    std::vector<Acc> &block_sums2) {
+        size_t first = block_sums.size();
+        size_t num_blocks = (n + REDUCTION_BLOCK_SIZE - 1) / REDUCTION_BLOCK_SIZE;
+        block_sums.resize(first + num_blocks);
+        block_sums2.resize(first + num_blocks);
+        static_for<Type>(0, num_blocks, [&](size_t block) {
+            size_t begin = block * REDUCTION_BLOCK_SIZE;
+            size_t size = std::min<size_t>(REDUCTION_BLOCK_SIZE, n - begin);
+            const simd_kernels<Real> &kernels = simd_dispatch<Real>();
+            if constexpr (std::is_same_v<Real, Acc>) {
+                kernels.block_sums(data + begin, size, block_sums[first + block], block_sums2[first + block]);
+            } else {
+                kernels.block_sums_wide(data + begin, size, block_sums[first + block], block_sums2[first + block]);
+            }
+        });
+    }
+}
+
+
+void set_reduction_mode(reduction_mode mode) {
+    selected_mode = mode;
+}
+
+reduction_mode selected_reduction_mode() {
+    return selected_mode;
+}
+
+const char *reduction_mode_name(reduction_mode mode) {
+    switch (mode) {
+        case reduction_mode::Reproducible:
+            return "reproducible";
+        case reduction_mode::Exact:
+            return "exact";
+        default:
+            return "fast";
+    }
+}
+
+template<typename Real, execution_policy::e_type Type, typename Acc>
+void reduce_sums_static(const Real *data, size_t n, Acc &sum, Acc &sum2) {
+    if (selected_mode == reduction_mode::Exact) {
+        exact_accumulator total;
+        exact_accumulator total2;
+        add_exact_blocks<Real, Type>(data, n, total, total2);
+        sum = static_cast<Acc>(total.round());
+        sum2 = static_cast<Acc>(total2.round());
+        return;
+    }
+
+    // fixed blocks summed by the lanes of the kernel, then a fixed tree over the blocks
+    std::vector<Acc> block_sums;
+    std::vector<Acc> block_sums2;
+    append_reproducible_blocks<Real, Type, Acc>(data, n, block_sums, block_sums2);
+    sum = pairwise_sum(block_sums.data(), block_sums.size());
+    sum2 = pairwise_sum(block_sums2.data(), block_sums2.size());
+}
+
+template<typename Real, typename Acc>
+void reduce_sums(const Real *data, size_t n, Acc &sum, Acc &sum2, const execution_policy &policy) {
+    dispatch_static(policy, false, [&](auto type, auto) {
+        reduce_sums_static<Real, decltype(type)::value, Acc>(data, n, sum, sum2);
+    });
+}
+
+template<typename Real, typename Acc>
+struct streaming_sums<Real, Acc>::state {
+    exact_accumulator total;
+    exact_accumulator total2;
+    std::vector<Acc> block_sums;
+    std::vector<Acc> block_sums2;
+    bool unaligned = false; // a part of a size not aligned to the blocks was added - it must be the last one
+};
+
+template<typename Real, typename Acc>
+streaming_sums<Real, Acc>::streaming_sums() : impl(std::make_unique<state>()) {}
+
+template<typename Real, typename Acc>
+streaming_sums<Real, Acc>::~streaming_sums() = default;
+
+template<typename Real, typename Acc>
+size_t streaming_sums<Real, Acc>::part_alignment() {
+    return EXACT_BLOCK_SIZE; // a multiple of REDUCTION_BLOCK_SIZE as well
+}
+
+template<typename Real, typename Acc>
+void streaming_sums<Real, Acc>::add(const Real *data, size_t n, const execution_policy &policy) {
+    if (impl->unaligned) {
+        throw std::runtime_error("Only the last part of the streamed sums may be unaligned to the blocks");
+    }
+    impl->unaligned = n % part_alignment() != 0;
+    dispatch_static(policy, false, [&](auto type, auto) {
+        constexpr execution_policy::e_type Type = decltype(type)::value;
+        if (selected_mode == reduction_mode::Exact) {
+            add_exact_blocks<Real, Type>(data, n, impl->total, impl->total2);
+        } else {
+            append_reproducible_blocks<Real, Type, Acc>(data, n, impl->block_sums, impl->block_sums2);
+        }
+    });
+}
+
+template<typename Real, typename Acc>
+void streaming_sums<Real, Acc>::result(Acc &sum, Acc &sum2) {
+    if (selected_mode == reduction_mode::Exact) {
+        sum = static_cast<Acc>(impl->total.round());
+        sum2 = static_cast<Acc>(impl->total2.round());
+        return;
+    }
+    sum = pairwise_sum(impl->block_sums.data(), impl->block_sums.size());
+    sum2 = pairwise_sum(impl->block_sums2.data(), impl->block_sums2.size());
+}
+
+// instantiations of all pairs of the element type and the accumulator
+#define INSTANTIATE_REDUCTION(Real, Acc) \
+    template void reduce_sums_static<Real, execution_policy::e_type::Sequential, Acc>(const Real *, size_t, Acc &, \
+                                                                                      Acc &); \
+    template void reduce_sums_static<Real, execution_policy::e_type::Parallel, Acc>(const Real *, size_t, Acc &, \
+                                                                                    Acc &); \
+    template void reduce_sums(const Real *, size_t, Acc &, Acc &, const execution_policy &); \
+    template class streaming_sums<Real, Acc>;
+
+INSTANTIATE_REDUCTION(float, float)
+
+INSTANTIATE_REDUCTION(float, double) // float storage with double accumulation
+
+INSTANTIATE_REDUCTION(double, double)
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "execution_policy.h"
+
+/**
+ * @brief Reduction of the sum and sum of squares of a column
+ *
+ * @details
+ *  - Fast - fused with the copy of the last merge, split by the number of threads (the last digits depend on
+ *    the machine and the engine)
+ *  - Reproducible - fixed blocks of the input summed in fixed lanes and combined by a fixed pairwise tree,
+ *    the same bits for any number of threads, instruction set and engine
+ *  - Exact - exact sums of the input by a superaccumulator rounded once, the same bits as well
+ */
+enum class reduction_mode {
+    Fast,
+    Reproducible,
+    Exact
+};
+
+/**
+ * @brief Select the reduction of the sums used by all engines
+ * @param mode - reduction mode
+ */
+void set_reduction_mode(reduction_mode mode);
+
+/**
+ * @brief Reduction of the sums used by all engines
+ * @return reduction mode (Fast by default)
+ */
+reduction_mode selected_reduction_mode();
+
+/**
+ * @brief Name of the reduction mode
+ * @param mode - reduction mode
+ * @return name (fast, reproducible, exact)
+ */
+const char *reduction_mode_name(reduction_mode mode);
+
+/**
+ * @brief Sum and sum of squares of the elements in the input order by the reproducible or exact reduction
+ * (instantiated for all pairs of the element type and the accumulator in reduction.cpp)
+ * @tparam Real - element type (float or double)
+ * @tparam Type - execution policy type - parallel or sequential
+ * @tparam Acc - accumulator of the sums
+ * @param data - elements
+ * @param n - number of elements
+ * @param sum - sum of the elements (output)
+ * @param sum2 - sum of the squared elements (output)
+ */
+template<typename Real, execution_policy::e_type Type, typename Acc>
+void reduce_sums_static(const Real *data, size_t n, Acc &sum, Acc &sum2);
+
+/**
+ * @brief Sum and sum of squares of the elements in the input order by the reproducible or exact reduction
+ * @param data - elements
+ * @param n - number of elements
+ * @param sum - sum of the elements (output)
+ * @param sum2 - sum of the squared elements (output)
+ * @param policy - execution policy - parallel or sequential
+ */
+template<typename Real, typename Acc>
+void reduce_sums(const Real *data, size_t n, Acc &sum, Acc &sum2, const execution_policy &policy);
+
+/**
+ * streaming_sums class - the reproducible or exact reduction of a column passed in consecutive parts (e.g. the runs
+ * of the external sort), the same bits as reduce_sums of the whole column. Every part but the last one must hold
+ * a multiple of part_alignment() elements, so the parts split no block of the reduction.
+ * @tparam Real - element type (float or double)
+ * @tparam Acc - accumulator of the sums
+ */
+template<typename Real, typename Acc>
+class streaming_sums {
+public:
+    streaming_sums();
+
+    ~streaming_sums();
+
+    streaming_sums(const streaming_sums &) = delete;
+
+    streaming_sums &operator=(const streaming_sums &) = delete;
+
+    /**
+     * @brief Number of elements every part but the last one is a multiple of
+     * @return alignment of the parts
+     */
+    static size_t part_alignment();
+
+    /**
+     * @brief Add the next part of the column - throws std::runtime_error after an unaligned part
+     * @param data - elements of the part
+     * @param n - number of elements
+     * @param policy - execution policy - parallel or sequential
+     */
+    void add(const Real *data, size_t n, const execution_policy &policy);
+
+    /**
+     * @brief Sums of all added parts
+     * @param sum - sum of the elements (output)
+     * @param sum2 - sum of the squared elements (output)
+     */
+    void result(Acc &sum, Acc &sum2);
+
+private:
+    struct state;
+    std::unique_ptr<state> impl;
+};
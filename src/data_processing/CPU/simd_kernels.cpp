@@ -0,0 +1,55 @@
+#include "simd_kernels.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    simd_isa forced_isa = simd_isa::Scalar;
+    bool forced = false;
+    std::atomic<bool> selected{false};
+
+    template<typename Real>
+    simd_kernels<Real> make_kernels(simd_isa isa) {
+        switch (isa) {
+            case simd_isa::AVX512:
+                return simd_kernels_avx512<Real>();
+            case simd_isa::AVX2:
+                return simd_kernels_avx2<Real>();
+            case simd_isa::SSE42:
+                return simd_kernels_sse42<Real>();
+            default:
+                return simd_kernels_scalar<Real>();
+        }
+    }
+}
+
+void set_simd_isa(simd_isa isa) {
+    if (selected.load()) {
+        throw std::runtime_error("The instruction set must be set before the SIMD kernels are used");
+    }
+    if (isa > detect_simd_isa()) {
+        throw std::runtime_error(std::string("The processor does not support the instruction set ")
+                                 + simd_isa_name(isa));
+    }
+    forced_isa = isa;
+    forced = true;
+}
+
+simd_isa selected_simd_isa() {
+    static const simd_isa isa = [] {
+        selected = true;
+        return forced ? forced_isa : detect_simd_isa();
+    }();
+    return isa;
+}
+
+template<typename Real>
+const simd_kernels<Real> &simd_dispatch() {
+    static const simd_kernels<Real> kernels = make_kernels<Real>(selected_simd_isa());
+    return kernels;
+}
+
+template const simd_kernels<float> &simd_dispatch();
+
+template const simd_kernels<double> &simd_dispatch();
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simd.h"
+
+#define REDUCTION_LANES 16 // lanes of the reproducible block sums - one register of floats of the widest instruction set
+
+/**
+ * @brief Vectorized kernels of one instruction set - the table is picked once at startup
+ * @tparam Real - element type (float or double)
+ */
+template<typename Real>
+struct simd_kernels {
+    simd_isa isa;
+
+    /**
+     * @brief Copy n elements and compute their sum and sum of squares
+     * @param src - elements to copy
+     * @param dst - destination of the copy
+     * @param n - number of elements
+     * @param sum - sum of the elements (output)
+     * @param sum2 - sum of the squared elements (output)
+     */
+    void (*sum_and_copy)(const Real *src, Real *dst, size_t n, Real &sum, Real &sum2);
+
+    /**
+     * @brief Copy n elements and compute their sum and sum of squares accumulated in double (the elements are
+     * widened before they are added - float storage keeps double accuracy of the sums)
+     * @param src - elements to copy
+     * @param dst - destination of the copy
+     * @param n - number of elements
+     * @param sum - sum of the elements (output)
+     * @param sum2 - sum of the squared elements (output)
+     */
+    void (*sum_and_copy_wide)(const Real *src, Real *dst, size_t n, double &sum, double &sum2);
+
+    /**
+     * @brief Sum and sum of squares of n elements in a fixed order - element i is added to lane i % REDUCTION_LANES
+     * and the lanes are combined by a fixed pairwise tree, so all instruction sets return the same bits
+     * @param src - elements
+     * @param n - number of elements
+     * @param sum - sum of the elements (output)
+     * @param sum2 - sum of the squared elements (output)
+     */
+    void (*block_sums)(const Real *src, size_t n, Real &sum, Real &sum2);
+
+    /**
+     * @brief block_sums accumulated in double
+     * @param src - elements
+     * @param n - number of elements
+     * @param sum - sum of the elements (output)
+     * @param sum2 - sum of the squared elements (output)
+     */
+    void (*block_sums_wide)(const Real *src, size_t n, double &sum, double &sum2);
+
+    /**
+     * @brief Absolute difference of n elements from the median
+     * @param src - elements
+     * @param dst - absolute differences (may be src)
+     * @param median - median of the elements
+     * @param n - number of elements
+     */
+    void (*abs_diff)(const Real *src, Real *dst, Real median, size_t n);
+
+    /**
+     * @brief Widen n halfs of the compressed storage (F16C on AVX2 and AVX-512)
+     * @param src - bits of the halfs
+     * @param dst - elements (output)
+     * @param n - number of elements
+     */
+    void (*widen_half)(const uint16_t *src, Real *dst, size_t n);
+
+    /**
+     * @brief Widen n bfloat16s of the compressed storage
+     * @param src - bits of the bfloat16s
+     * @param dst - elements (output)
+     * @param n - number of elements
+     */
+    void (*widen_bfloat16)(const uint16_t *src, Real *dst, size_t n);
+};
+
+/**
+ * @brief Force the instruction set of the kernels - must be called before the first use of the kernels
+ * @param isa - instruction set, throws std::runtime_error if the processor does not support it
+ */
+void set_simd_isa(simd_isa isa);
+
+/**
+ * @brief Instruction set of the kernels - the widest one supported by the processor or the one forced by set_simd_isa
+ * @return instruction set
+ */
+simd_isa selected_simd_isa();
+
+/**
+ * @brief Kernels of the selected instruction set (instantiated for float and double in simd_kernels.cpp)
+ * @tparam Real - element type
+ * @return kernel table
+ */
+template<typename Real>
+const simd_kernels<Real> &simd_dispatch();
+
+// kernel tables of the instruction sets - every one is compiled in its own translation unit with its own flags
+template<typename Real>
+simd_kernels<Real> simd_kernels_scalar();
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_sse42();
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_avx2();
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_avx512();
@@ -0,0 +1,10 @@
+#include "simd_kernels_impl.h"
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_avx2() {
+    return make_simd_kernels<simd_isa::AVX2, Real>();
+}
+
+template simd_kernels<float> simd_kernels_avx2();
+
+template simd_kernels<double> simd_kernels_avx2();
@@ -0,0 +1,10 @@
+#include "simd_kernels_impl.h"
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_avx512() {
+    return make_simd_kernels<simd_isa::AVX512, Real>();
+}
+
+template simd_kernels<float> simd_kernels_avx512();
+
+template simd_kernels<double> simd_kernels_avx512();
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "half.h"
+#include "simd_kernels.h"
+
+// Kernel templates shared by the translation units of the instruction sets. The functions have internal linkage
+// and use only the simd<ISA, Real> operations and plain arithmetic, so no inline code compiled with the wide
+// instructions is shared with the other translation units.
+
+template<simd_isa ISA, typename Real, typename Acc>
+static void sum_and_copy_kernel(const Real *src, Real *dst, size_t n, Acc &sum, Acc &sum2) {
+    using S = simd<ISA, Real>;
+    using A = simd<ISA, Acc>; // accumulator - Real or the wider double
+    auto vec_sum = A::zero();
+    auto vec_sum2 = A::zero();
+    size_t i = 0;
+    for (; i + S::width <= n; i += S::width) {
+        auto vec_vals = S::load(src + i); // load elements
+        S::store(dst + i, vec_vals); // store elements
+        if constexpr (std::is_same_v<Real, Acc>) {
+            vec_sum = A::add(vec_sum, vec_vals); // accumulate sum
+            vec_sum2 = A::add(vec_sum2, A::mul(vec_vals, vec_vals)); // accumulate sum of squares
+        } else {
+            // the elements converted to double - one register of floats fills two registers of doubles
+            for (size_t h = 0; h < S::width; h += A::width) {
+                auto wide_vals = A::load_widen(src + i + h);
+                vec_sum = A::add(vec_sum, wide_vals);
+                vec_sum2 = A::add(vec_sum2, A::mul(wide_vals, wide_vals));
+            }
+        }
+    }
+    // horizontal sum - sum of vector elements
+    sum = A::reduce_add(vec_sum);
+    sum2 = A::reduce_add(vec_sum2);
+
+    // handle any remaining elements (less than the width) in the tail
+    for (; i < n; ++i) {
+        Real val = src[i];
+        dst[i] = val;
+        sum += static_cast<Acc>(val);
+        sum2 += static_cast<Acc>(val) * static_cast<Acc>(val);
+    }
+}
+
+template<simd_isa ISA, typename Real, typename Acc>
+static void block_sums_kernel(const Real *src, size_t n, Acc &sum, Acc &sum2) {
+    using A = simd<ISA, Acc>;
+    constexpr size_t num_registers = REDUCTION_LANES / A::width; // registers holding the lanes
+    typename A::vec vec_sum[num_registers];
+    typename A::vec vec_sum2[num_registers];
+    for (size_t r = 0; r < num_registers; ++r) {
+        vec_sum[r] = A::zero();
+        vec_sum2[r] = A::zero();
+    }
+    size_t i = 0;
+    for (; i + REDUCTION_LANES <= n; i += REDUCTION_LANES) {
+        for (size_t r = 0; r < num_registers; ++r) {
+            typename A::vec vec_vals;
+            if constexpr (std::is_same_v<Real, Acc>) {
+                vec_vals = A::load(src + i + r * A::width);
+            } else {
+                vec_vals = A::load_widen(src + i + r * A::width);
+            }
+            vec_sum[r] = A::add(vec_sum[r], vec_vals);
+            vec_sum2[r] = A::add(vec_sum2[r], A::mul(vec_vals, vec_vals));
+        }
+    }
+    Acc lanes[REDUCTION_LANES];
+    Acc lanes2[REDUCTION_LANES];
+    for (size_t r = 0; r < num_registers; ++r) {
+        A::store(lanes + r * A::width, vec_sum[r]);
+        A::store(lanes2 + r * A::width, vec_sum2[r]);
+    }
+    // the tail goes to the lanes of the same positions as in the vector loop
+    for (size_t lane = 0; i + lane < n; ++lane) {
+        auto val = static_cast<Acc>(src[i + lane]);
+        lanes[lane] += val;
+        lanes2[lane] += val * val;
+    }
+    // fixed pairwise tree over the lanes
+    for (size_t half = REDUCTION_LANES / 2; half > 0; half /= 2) {
+        for (size_t lane = 0; lane < half; ++lane) {
+            lanes[lane] += lanes[lane + half];
+            lanes2[lane] += lanes2[lane + half];
+        }
+    }
+    sum = lanes[0];
+    sum2 = lanes2[0];
+}
+
+template<simd_isa ISA, typename Real>
+static void abs_diff_kernel(const Real *src, Real *dst, Real median, size_t n) {
+    using S = simd<ISA, Real>;
+    auto med = S::set1(median); // broadcast median to all elements of the vector
+    size_t i = 0;
+    for (; i + S::width <= n; i += S::width) {
+        S::store(dst + i, S::abs(S::sub(S::load(src + i), med)));
+    }
+    // process remaining elements
+    for (; i < n; ++i) {
+        Real diff = src[i] - median;
+        dst[i] = diff < 0 ? -diff : diff;
+    }
+}
+
+// scalar widening of the tails - own copies of half_to_float and bfloat16_to_float of half.h, whose inline
+// definitions (and std::ldexp) would be emitted as weak symbols compiled with the wide instructions
+static float widen_half_scalar(uint16_t bits) {
+    uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1f;
+    uint32_t mantissa = bits & 0x3ff;
+    if (exponent == 0) { // zero and subnormal numbers - multiples of 2^-24 (exact in float)
+        float value = static_cast<float>(static_cast<int>(mantissa)) * 5.9604644775390625e-08f;
+        return sign ? -value : value;
+    }
+    uint32_t result = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) // infinity and NaN
+                                       : sign | ((exponent + 112) << 23) | (mantissa << 13); // rebias 15 to 127
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+static float widen_bfloat16_scalar(uint16_t bits) {
+    uint32_t result = static_cast<uint32_t>(bits) << 16;
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+template<simd_isa ISA, typename Real, storage_format Format>
+static void widen_kernel(const uint16_t *src, Real *dst, size_t n) {
+    using S = simd<ISA, Real>;
+    size_t i = 0;
+    if constexpr (S::has_16bit_loads) {
+        for (; i + S::width <= n; i += S::width) {
+            S::store(dst + i, Format == storage_format::Half ? S::load_half(src + i) : S::load_bfloat16(src + i));
+        }
+    }
+    // the instruction sets without the 16-bit loads and the tail - one element at a time
+    for (; i < n; ++i) {
+        dst[i] = static_cast<Real>(Format == storage_format::Half ? widen_half_scalar(src[i])
+                                                                  : widen_bfloat16_scalar(src[i]));
+    }
+}
+
+template<simd_isa ISA, typename Real>
+static simd_kernels<Real> make_simd_kernels() {
+    return {ISA, sum_and_copy_kernel<ISA, Real, Real>, sum_and_copy_kernel<ISA, Real, double>,
+            block_sums_kernel<ISA, Real, Real>, block_sums_kernel<ISA, Real, double>, abs_diff_kernel<ISA, Real>,
+            widen_kernel<ISA, Real, storage_format::Half>, widen_kernel<ISA, Real, storage_format::BFloat16>};
+}
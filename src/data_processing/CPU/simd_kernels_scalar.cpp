@@ -0,0 +1,10 @@
+#include "simd_kernels_impl.h"
+
+template<typename Real>
+simd_kernels<Real> simd_kernels_scalar() {
+    return make_simd_kernels<simd_isa::Scalar, Real>();
+}
+
+template simd_kernels<float> simd_kernels_scalar();
+
+template simd_kernels<double> simd_kernels_scalar();
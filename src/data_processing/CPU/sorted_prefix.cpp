@@ -0,0 +1,126 @@
+#include "sorted_prefix.h"
+
+#include "statistics.h"
+
+namespace {
+    /**
+     * @brief Number of elements of the first run among the first k elements of the merge of two sorted runs (equal
+     * elements are taken from the first run first, like merge)
+     * @param k - number of merged elements
+     * @param a - first run
+     * @param n1 - size of the first run
+     * @param b - second run
+     * @param n2 - size of the second run
+     * @return number of elements of the first run
+     */
+    template<typename Real>
+    size_t co_rank(size_t k, const Real *a, size_t n1, const Real *b, size_t n2) {
+        size_t low = k > n2 ? k - n2 : 0, high = std::min(k, n1);
+        while (low < high) {
+            size_t i = low + (high - low) / 2;
+            if (a[i] <= b[k - i - 1]) { // a[i] is merged before b[k - i - 1] - more elements of the first run
+                low = i + 1;
+            } else {
+                high = i;
+            }
+        }
+        return low;
+    }
+
+    /**
+     * @brief Merge two sorted runs - every thread merges an equal part of the output, its inputs are found by
+     * a binary search of the co-ranks
+     * @tparam Type - execution policy type - parallel or sequential
+     * @param a - first run
+     * @param b - second run
+     * @param out - merged runs (output, size of both runs)
+     */
+    template<typename Real, execution_policy::e_type Type>
+    void merge_runs_static(const std::vector<Real> &a, const std::vector<Real> &b, std::vector<Real> &out) {
+        const size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+        const size_t parts = std::max<size_t>(1, std::min(static_num_threads<Type>(), n));
+        static_for<Type>(0, parts, [&](size_t part) {
+            size_t k_begin = n * part / parts, k_end = n * (part + 1) / parts;
+            size_t i_begin = co_rank(k_begin, a.data(), n1, b.data(), n2);
+            size_t i_end = co_rank(k_end, a.data(), n1, b.data(), n2);
+            std::merge(a.begin() + static_cast<std::ptrdiff_t>(i_begin), a.begin() + static_cast<std::ptrdiff_t>(i_end),
+                       b.begin() + static_cast<std::ptrdiff_t>(k_begin - i_begin),
+                       b.begin() + static_cast<std::ptrdiff_t>(k_end - i_end),
+                       out.begin() + static_cast<std::ptrdiff_t>(k_begin));
+        });
+    }
+}
+
+template<typename Real, typename Acc>
+sorted_prefix<Real, Acc>::sorted_prefix(bool is_vectorized, const execution_policy &policy)
+        : is_vectorized(is_vectorized), policy_type(policy.get_type()) {}
+
+template<typename Real, typename Acc>
+std::string sorted_prefix<Real, Acc>::name() const {
+    return std::string("CPU_incremental_") +
+           (policy_type == execution_policy::e_type::Parallel ? "parallel" : "sequential") + "_" +
+           (is_vectorized ? "vectorized" : "no_vectorized") + (std::is_same_v<Real, Acc> ? "" : "_mixed");
+}
+
+template<typename Real, typename Acc>
+int sorted_prefix<Real, Acc>::extend(column_view<Real> column, size_t end) {
+    const size_t begin = sorted.size();
+    if (end < begin || end > column.size()) {
+        std::cerr << "The prefix can only grow within the column" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (end == begin) {
+        return EXIT_SUCCESS;
+    }
+    return dispatch_static(execution_policy(policy_type), is_vectorized, [&](auto type, auto vectorized) {
+        constexpr execution_policy::e_type Type = decltype(type)::value;
+        // sort only the new slice - its sums are counted by the last merge of the sort
+        std::vector<Real> slice(column.begin() + static_cast<std::ptrdiff_t>(begin),
+                                column.begin() + static_cast<std::ptrdiff_t>(end));
+        Acc slice_sum = 0, slice_sum2 = 0;
+        if (merge_sort_static<Real, Type, decltype(vectorized)::value>(slice, slice_sum, slice_sum2) !=
+            EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        if (slice.size() == 1) { // no merge - the sort counts nothing
+            slice_sum = static_cast<Acc>(slice[0]);
+            slice_sum2 = static_cast<Acc>(slice[0]) * static_cast<Acc>(slice[0]);
+        }
+        if (selected_reduction_mode() == reduction_mode::Fast) {
+            sum += slice_sum;
+            sum2 += slice_sum2;
+        } else { // the deterministic sums depend on the blocks of the whole prefix
+            sum = 0;
+            sum2 = 0;
+            reduce_sums_static<Real, Type, Acc>(column.data(), end, sum, sum2);
+        }
+
+        std::vector<Real> previous;
+        previous.swap(sorted);
+        sorted.resize(end);
+        merge_runs_static<Real, Type>(previous, slice, sorted);
+        return EXIT_SUCCESS;
+    });
+}
+
+template<typename Real, typename Acc>
+int sorted_prefix<Real, Acc>::compute_CV_MAD(Real &cv, Real &mad) {
+    const size_t n = sorted.size();
+    if (n == 0) {
+        std::cerr << "The prefix is empty" << std::endl;
+        return EXIT_FAILURE;
+    }
+    cv = static_cast<Real>(CV(sum, sum2, n));
+    // the deviations are written to the second buffer - the sorted prefix stays for the next slice
+    Real median = (sorted[n / 2] + sorted[(n - 1) / 2]) / static_cast<Real>(2.0);
+    abs_diff.resize(n);
+    abs_diff_calc(sorted, abs_diff, median, n, is_vectorized, execution_policy(policy_type));
+    mad = find_median(abs_diff, n);
+    return EXIT_SUCCESS;
+}
+
+template class sorted_prefix<float, float>;
+
+template class sorted_prefix<float, double>; // float storage with double accumulation
+
+template class sorted_prefix<double, double>;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "execution_policy.h"
+#include "column_view.h"
+
+/**
+ * sorted_prefix class - growing prefix of a column kept sorted between the evaluations, so a prefix that grows by
+ * one slice costs the sort of the slice and one merge instead of the sort of the whole prefix. The sums of the CV are
+ * the sums of the prefix plus the sums of the slice (the reproducible and exact reductions reduce the whole prefix
+ * in the input order, so the CV matches the other engines).
+ * @tparam Real - element type (float or double)
+ * @tparam Acc - accumulator of the sums - Real, or double for float storage with double accumulation
+ */
+template<typename Real, typename Acc = Real>
+class sorted_prefix {
+public:
+    /**
+     * @param is_vectorized - flag to indicate if vectorization is enabled
+     * @param policy - execution policy - parallel or sequential
+     */
+    sorted_prefix(bool is_vectorized, const execution_policy &policy);
+
+    /**
+     * @brief Name of the computation for the results
+     * @return CPU_incremental_ with the policy and vectorization like the CPU engines
+     */
+    [[nodiscard]] std::string name() const;
+
+    /**
+     * @brief Number of elements of the prefix
+     * @return end of the prefix in the column
+     */
+    [[nodiscard]] size_t size() const {
+        return sorted.size();
+    }
+
+    /**
+     * @brief Extend the prefix to column[0, end) - sorts the new slice column[size(), end) and merges it into the
+     * sorted prefix
+     * @param column - column of the prefix (not modified)
+     * @param end - new end of the prefix (not smaller than size())
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int extend(column_view<Real> column, size_t end);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of the prefix (the sorted prefix is
+     * kept for the next slice)
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE if the prefix is empty
+     */
+    int compute_CV_MAD(Real &cv, Real &mad);
+
+private:
+    bool is_vectorized;
+    execution_policy::e_type policy_type; // the policy itself is not assignable
+    std::vector<Real> sorted; // elements of the prefix in ascending order
+    std::vector<Real> abs_diff; // absolute deviations of the MAD - reused by the next prefix
+    Acc sum = 0, sum2 = 0; // sums of the prefix
+};
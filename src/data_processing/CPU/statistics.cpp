@@ -1,92 +1,101 @@
 #include "statistics.h"
 
+#include <stdexcept>
 
-real find_median(std::vector<real> &arr, size_t n) {
+#define SMALL_SORT_SIZE 32 // largest segment sorted by insertion sort
+#define SIMD_BLOCK_SIZE 4096 // elements of one vectorized abs diff task
+
+
+template<typename Real>
+Real find_median(std::vector<Real> &arr, size_t n) {
     size_t left_middle = (n - 1) / 2, right_middle = n / 2; // find the middle of the array
     // move from the middle to the beginning and end of the array n/2 times == median
-    real prev = 0, curr = 0;
+    Real prev = 0, curr = 0;
     for (size_t i = 0; i <= n / 2; i++) {
         prev = curr;
         curr = arr[left_middle] >= arr[right_middle] ? arr[right_middle++]
                                                      : arr[left_middle--]; // move to the next element
     }
-    return n & 1 ? curr : (prev + curr) / static_cast<real>(2.0); // if n is odd return the current element, else return the average
+    return n & 1 ? curr : (prev + curr) / static_cast<Real>(2.0); // if n is odd return the current element, else return the average
 }
 
 
-void abs_diff_calc(std::vector<real> &arr, std::vector<real> &abs_diff, real median, size_t n,
-                   const bool is_vectorized, const execution_policy &policy) {
-    size_t i = 0;
-    if (is_vectorized) {
-
-        // broadcast median to all elements of the vector
-        auto med = SET1(median);
-
-        // create a mask with the sign bit cleared
-        auto sign_mask = SET1(-0.0);
-
-        size_t step = sizeof(STRIDE) / sizeof(real);
-
-        std::vector<size_t> indices;
-        for (i = 0; i <= n - step; i += step) {
-            indices.push_back(i);
-        }
-
-        // process 4 elements at a time using AVX2
-        std::visit([&](auto &&exec_policy) {
-            std::for_each(exec_policy, indices.begin(), indices.end(), [&](size_t i) {
-                auto vec = LOAD(&arr[i]); // load 4 elements
-                auto diff = SUB(vec, med); // subtract median from elements
-                auto abs_diff_vec = ANDNOT(sign_mask, diff); // clear the sign bit
-                STORE(&abs_diff[i], abs_diff_vec); // store result
-            });
-        }, policy.get_policy());
-    }
-
-    // process remaining elements
-    int j = static_cast<int>(i);
-    std::visit([&](auto &&exec_policy) {
-        std::for_each(exec_policy, arr.begin() + j, arr.begin() + static_cast<int>(n), [&](real &value) {
-            abs_diff[&value - &arr[0]] = std::abs(value - median);
+template<typename Real, execution_policy::e_type Type, bool Vectorized>
+void abs_diff_calc_static(std::vector<Real> &arr, std::vector<Real> &abs_diff, Real median, size_t n) {
+    if constexpr (Vectorized) {
+        // blocks processed by the kernel of the instruction set picked at startup
+        size_t num_blocks = (n + SIMD_BLOCK_SIZE - 1) / SIMD_BLOCK_SIZE;
+        static_for<Type>(0, num_blocks, [&](size_t block_id) {
+            size_t begin = block_id * SIMD_BLOCK_SIZE;
+            size_t size = std::min<size_t>(SIMD_BLOCK_SIZE, n - begin);
+            simd_dispatch<Real>().abs_diff(arr.data() + begin, abs_diff.data() + begin, median, size);
+        });
+    } else {
+        static_for<Type>(0, n, [&](size_t k) {
+            abs_diff[k] = std::abs(arr[k] - median);
         });
-    }, policy.get_policy());
+    }
 }
 
+template<typename Real>
+void abs_diff_calc(std::vector<Real> &arr, std::vector<Real> &abs_diff, Real median, size_t n,
+                   const bool is_vectorized, const execution_policy &policy) {
+    dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        abs_diff_calc_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, abs_diff, median, n);
+    });
+}
 
 // coefficient of variance
-real CV(real &sum, real &sum2, size_t n) {
-    real mean = sum / (real) n; // calculate the mean
-    real variance = sum2 / (real) n - mean * mean; // calculate the variance
-    real cv = sqrt(variance) / mean;
+template<typename Real>
+Real CV(Real &sum, Real &sum2, size_t n) {
+    Real mean = sum / (Real) n; // calculate the mean
+    Real variance = sum2 / (Real) n - mean * mean; // calculate the variance
+    Real cv = std::sqrt(variance) / mean;
 
     return cv;
 }
 
 // median absolute deviation
-real MAD(std::vector<real> &arr, size_t n, const bool is_vectorized, const execution_policy &policy) {
+template<typename Real, execution_policy::e_type Type, bool Vectorized>
+Real MAD_static(std::vector<Real> &arr, size_t n) {
 
-    real median = (arr[n / 2] + arr[(n - 1) / 2]) / static_cast<real>(2.0);
+    Real median = (arr[n / 2] + arr[(n - 1) / 2]) / static_cast<Real>(2.0);
 
     // compute array of absolute differences from the median
-    abs_diff_calc(arr, arr, median, n, is_vectorized, policy);
+    abs_diff_calc_static<Real, Type, Vectorized>(arr, arr, median, n);
 
     return find_median(arr, n);
 }
 
-int CPU_data_processing::compute_CV_MAD(std::vector<real> &vec, real &cv, real &mad, const bool is_vectorized,
-                   const execution_policy &policy) {
-    real sum = 0;
-    real sum2 = 0;
+template<typename Real>
+Real MAD(std::vector<Real> &arr, size_t n, const bool is_vectorized, const execution_policy &policy) {
+    return dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        return MAD_static<Real, decltype(type)::value, decltype(vectorized)::value>(arr, n);
+    });
+}
+
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int CPU_data_processing::compute_CV_MAD_static(std::vector<Real> &vec, Real &cv, Real &mad) {
+    Acc sum = 0;
+    Acc sum2 = 0;
     size_t n = vec.size();
+    // the deterministic sums are reduced from the input order - the sums fused with the sort are thrown away
+    const bool deterministic = selected_reduction_mode() != reduction_mode::Fast;
+    if (deterministic) {
+        reduce_sums_static<Real, Type, Acc>(vec.data(), n, sum, sum2);
+    }
+    Acc sort_sum = 0;
+    Acc sort_sum2 = 0;
     // sort the data
-    auto [sort_time, sort_ret] = measure_time(mergeSort, vec, sum, sum2, is_vectorized, policy);
+    auto [sort_time, sort_ret] = measure_time(merge_sort_static<Real, Type, Vectorized, Acc>, vec,
+                                              deterministic ? sort_sum : sum, deterministic ? sort_sum2 : sum2);
 
     // if sorting was successful calculate the coefficient of variance and median absolute deviation
     if (sort_ret == EXIT_SUCCESS && std::is_sorted(vec.begin(), vec.end())) {
         std::cout << "Sorted in " << sort_time << " seconds" << std::endl;
-        cv = CV(sum, sum2, n);
+        cv = static_cast<Real>(CV(sum, sum2, n));
 
-        auto [mad_time, mad_ret] = measure_time(MAD, vec, n, is_vectorized, policy);
+        auto [mad_time, mad_ret] = measure_time(MAD_static<Real, Type, Vectorized>, vec, n);
 
         mad = mad_ret;
         return EXIT_SUCCESS;
@@ -97,3 +106,143 @@ int CPU_data_processing::compute_CV_MAD(std::vector<real> &vec, real &cv, real &
     }
 }
 
+template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+int CPU_data_processing::compute_CV_MAD_in_place_static(std::vector<Real> &vec, Real &cv, Real &mad) {
+    const size_t n = vec.size();
+    if (n == 0) {
+        std::cerr << "Failed to sort data" << std::endl;
+        return EXIT_FAILURE;
+    }
+    Acc sum = 0, sum2 = 0;
+    const bool deterministic = selected_reduction_mode() != reduction_mode::Fast;
+    if (deterministic) {
+        reduce_sums_static<Real, Type, Acc>(vec.data(), n, sum, sum2);
+    }
+    Acc sort_sum = 0, sort_sum2 = 0;
+    auto [sort_time, sort_ret] = measure_time(quick_sort_static<Real, Type, Vectorized, Acc>, vec,
+                                              deterministic ? sort_sum : sum, deterministic ? sort_sum2 : sum2);
+    if (sort_ret != EXIT_SUCCESS || !std::is_sorted(vec.begin(), vec.end())) {
+        std::cerr << "Failed to sort data" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Sorted in place in " << sort_time << " seconds" << std::endl;
+    cv = static_cast<Real>(CV(sum, sum2, n));
+    mad = MAD_static<Real, Type, Vectorized>(vec, n);
+    return EXIT_SUCCESS;
+}
+
+template<typename Real, typename Acc>
+int CPU_data_processing::compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, const bool is_vectorized,
+                   const execution_policy &policy) {
+    return dispatch_static(policy, is_vectorized, [&](auto type, auto vectorized) {
+        return compute_CV_MAD_static<Real, decltype(type)::value, decltype(vectorized)::value, Acc>(vec, cv, mad);
+    });
+}
+
+void check_segments(const std::vector<size_t> &offsets, size_t size) {
+    if (offsets.size() < 2 || offsets.front() != 0 || offsets.back() != size) {
+        throw std::runtime_error("Segment offsets must start at 0 and end at the size of the data");
+    }
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        if (offsets[i] <= offsets[i - 1]) {
+            throw std::runtime_error("Segment offsets must be increasing (no empty segments)");
+        }
+    }
+}
+
+template<typename Real, typename Acc>
+int CPU_data_processing::compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                                  std::vector<Real> &cv, std::vector<Real> &mad,
+                                                  const execution_policy &policy) {
+    check_segments(offsets, data.size());
+    const size_t num_segments = offsets.size() - 1;
+    cv.assign(num_segments, 0);
+    mad.assign(num_segments, 0);
+
+    policy_for(policy, 0, num_segments, [&](size_t s) {
+        const size_t n = offsets[s + 1] - offsets[s];
+        std::vector<Real> segment(data.begin() + static_cast<std::ptrdiff_t>(offsets[s]),
+                                  data.begin() + static_cast<std::ptrdiff_t>(offsets[s + 1]));
+
+        Acc sum = 0, sum2 = 0;
+        if (selected_reduction_mode() != reduction_mode::Fast) { // the same sums as the whole-column engines
+            reduce_sums_static<Real, execution_policy::e_type::Sequential, Acc>(data.data() + offsets[s], n, sum,
+                                                                                 sum2);
+        }
+
+        // sort - insertion sort beats the general sort on the short windows
+        if (n <= SMALL_SORT_SIZE) {
+            for (size_t i = 1; i < n; ++i) {
+                Real value = segment[i];
+                size_t j = i;
+                for (; j > 0 && value < segment[j - 1]; --j) {
+                    segment[j] = segment[j - 1];
+                }
+                segment[j] = value;
+            }
+        } else {
+            std::sort(segment.begin(), segment.end());
+        }
+
+        if (selected_reduction_mode() == reduction_mode::Fast) {
+            for (Real value: segment) {
+                sum += static_cast<Acc>(value);
+                sum2 += static_cast<Acc>(value) * static_cast<Acc>(value);
+            }
+        }
+        cv[s] = static_cast<Real>(CV(sum, sum2, n));
+
+        // the absolute differences of the sorted segment are V-shaped
+        Real median = (segment[n / 2] + segment[(n - 1) / 2]) / static_cast<Real>(2.0);
+        for (Real &value: segment) {
+            value = std::abs(value - median);
+        }
+        mad[s] = find_median(segment, n);
+    });
+
+    return EXIT_SUCCESS;
+}
+
+// instantiations of both precisions - the engines use compute_CV_MAD_static with the policy and vectorization fixed
+// at compile time, the rest of the program the runtime dispatched functions
+#define INSTANTIATE_STATISTICS(Real) \
+    template Real find_median(std::vector<Real> &, size_t); \
+    template void abs_diff_calc(std::vector<Real> &, std::vector<Real> &, Real, size_t, bool, \
+                                const execution_policy &); \
+    template Real CV(Real &, Real &, size_t); \
+    template Real MAD(std::vector<Real> &, size_t, bool, const execution_policy &);
+
+// functions computing the sums - instantiated for every pair of the element type and the accumulator
+#define INSTANTIATE_STATISTICS_SUMS(Real, Acc) \
+    template int CPU_data_processing::compute_CV_MAD<Real, Acc>(std::vector<Real> &, Real &, Real &, bool, \
+                                                                const execution_policy &); \
+    template int CPU_data_processing::compute_CV_MAD_segmented<Real, Acc>(column_view<Real>, \
+                                                                          const std::vector<size_t> &, \
+                                                                          std::vector<Real> &, std::vector<Real> &, \
+                                                                          const execution_policy &); \
+    template int CPU_data_processing::compute_CV_MAD_static<Real, execution_policy::e_type::Sequential, false, Acc>( \
+            std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_static<Real, execution_policy::e_type::Sequential, true, Acc>( \
+            std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_static<Real, execution_policy::e_type::Parallel, false, Acc>( \
+            std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_static<Real, execution_policy::e_type::Parallel, true, Acc>( \
+            std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_in_place_static<Real, execution_policy::e_type::Sequential, \
+                                                                     false, Acc>(std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_in_place_static<Real, execution_policy::e_type::Sequential, \
+                                                                     true, Acc>(std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_in_place_static<Real, execution_policy::e_type::Parallel, \
+                                                                     false, Acc>(std::vector<Real> &, Real &, Real &); \
+    template int CPU_data_processing::compute_CV_MAD_in_place_static<Real, execution_policy::e_type::Parallel, \
+                                                                     true, Acc>(std::vector<Real> &, Real &, Real &);
+
+INSTANTIATE_STATISTICS(float)
+
+INSTANTIATE_STATISTICS(double)
+
+INSTANTIATE_STATISTICS_SUMS(float, float)
+
+INSTANTIATE_STATISTICS_SUMS(float, double) // float storage with double accumulation
+
+INSTANTIATE_STATISTICS_SUMS(double, double)
@@ -2,11 +2,13 @@
 
 #include <vector>
 #include <algorithm>
-#include <execution>
-#include <immintrin.h>
 
 #include "my_utils.h"
+#include "simd_kernels.h"
 #include "merge_sort.h"
+#include "quick_sort.h"
+#include "reduction.h"
+#include "column_view.h"
 
 
 /**
@@ -15,7 +17,8 @@
  * @param n - size of the array
  * @return median of the array
  */
-real find_median(std::vector<real> &arr, size_t n);
+template<typename Real>
+Real find_median(std::vector<Real> &arr, size_t n);
 
 /**
  * @brief Calculate the absolute difference of each element in the array from the median
@@ -26,7 +29,8 @@ real find_median(std::vector<real> &arr, size_t n);
  * @param is_vectorized - flag to indicate if vectorization is enabled
  * @param policy - execution policy - parallel or sequential
  */
-void abs_diff_calc(std::vector<real> &arr, std::vector<real> &abs_diff, real median, size_t n,
+template<typename Real>
+void abs_diff_calc(std::vector<Real> &arr, std::vector<Real> &abs_diff, Real median, size_t n,
                    bool is_vectorized, const execution_policy &policy);
 
 /**
@@ -36,7 +40,8 @@ void abs_diff_calc(std::vector<real> &arr, std::vector<real> &abs_diff, real med
  * @param n size of the array
  * @return coefficient of variance
  */
-real CV(real &sum, real &sum2, size_t n);
+template<typename Real>
+Real CV(Real &sum, Real &sum2, size_t n);
 
 /**
  * @brief Calculate the median absolute deviation
@@ -46,7 +51,15 @@ real CV(real &sum, real &sum2, size_t n);
  * @param policy - execution policy - parallel or sequential
  * @return median absolute deviation
  */
-real MAD(std::vector<real> &arr, size_t n, bool is_vectorized, const execution_policy &policy);
+template<typename Real>
+Real MAD(std::vector<Real> &arr, size_t n, bool is_vectorized, const execution_policy &policy);
+
+/**
+ * @brief Check the segment offsets of a flat buffer - throws std::runtime_error if they are invalid
+ * @param offsets - start of each segment followed by the end of the last one (non-decreasing, no empty segment)
+ * @param size - size of the flat buffer
+ */
+void check_segments(const std::vector<size_t> &offsets, size_t size);
 
 /**
  * CPU_data_processing class used to compute the coefficient of variance and median absolute deviation.
@@ -60,6 +73,8 @@ public:
 
     /**
      * @brief Compute the coefficient of variance and median absolute deviation
+     * @tparam Real - element type (float or double)
+     * @tparam Acc - accumulator of the sums - Real, or double for float storage with double accumulation
      * @param vec - vector of reals
      * @param cv - coefficient of variance (output)
      * @param mad - median absolute deviation (output)
@@ -67,7 +82,58 @@ public:
      * @param policy - execution policy - parallel or sequential
      * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
      */
-    static int compute_CV_MAD(std::vector<real> &vec, real &cv, real &mad, bool is_vectorized,
+    template<typename Real, typename Acc = Real>
+    static int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, bool is_vectorized,
                        const execution_policy &policy);
 
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation with the execution policy and
+     * vectorization fixed at compile time (instantiated for all four combinations and all pairs of the element type
+     * and the accumulator in statistics.cpp)
+     * @tparam Real - element type (float or double)
+     * @tparam Type - execution policy type - parallel or sequential
+     * @tparam Vectorized - SIMD vectorization
+     * @tparam Acc - accumulator of the sums
+     * @param vec - vector of reals
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc = Real>
+    static int compute_CV_MAD_static(std::vector<Real> &vec, Real &cv, Real &mad);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation by the in-place quicksort - the
+     * deviations overwrite the sorted vector, so the memory beyond the vector is O(log n) (instantiated like
+     * compute_CV_MAD_static)
+     * @tparam Real - element type (float or double)
+     * @tparam Type - execution policy type - parallel or sequential
+     * @tparam Vectorized - SIMD vectorization
+     * @tparam Acc - accumulator of the sums
+     * @param vec - vector of reals
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc = Real>
+    static int compute_CV_MAD_in_place_static(std::vector<Real> &vec, Real &cv, Real &mad);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of many short segments
+     * The segments are processed in parallel (with the parallel policy), each one sorted by insertion sort
+     * if it is short or by std::sort otherwise
+     * @tparam Real - element type (float or double)
+     * @tparam Acc - accumulator of the sums
+     * @param data - flat buffer of all segments (not modified)
+     * @param offsets - start of each segment followed by the end of the last one
+     * @param cv - coefficient of variance of each segment (output)
+     * @param mad - median absolute deviation of each segment (output)
+     * @param policy - execution policy - parallel or sequential
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    template<typename Real, typename Acc = Real>
+    static int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                        std::vector<Real> &cv, std::vector<Real> &mad,
+                                        const execution_policy &policy);
+
 };
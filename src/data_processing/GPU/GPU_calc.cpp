@@ -1,6 +1,12 @@
 #include "GPU_calc.h"
 
-cl::Device GPU_data_processing::try_select_first_gpu() {
+#include <random>
+
+#define WORK_GROUP_CACHE "work_group_sizes.cache" // cache file of the tuned workgroup sizes
+#define CALIBRATION_SIZE (1 << 22) // number of elements of the calibration buffer
+
+template<typename Real>
+cl::Device GPU_data_processing<Real>::try_select_first_gpu() {
     std::vector<cl::Platform> platforms;
     cl::Platform::get(&platforms);
 
@@ -25,30 +31,73 @@ cl::Device GPU_data_processing::try_select_first_gpu() {
     return device;
 }
 
-void GPU_data_processing::set_buffer(std::vector<real> &arr) {
-    size_t n = arr.size();
-    // pad the input to the nearest power of 2
-    size_t power = 1;
-    while (power < n) {
-        power <<= 1;
+template<typename Real>
+cl::Device GPU_data_processing<Real>::select_device(size_t index) {
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+
+    size_t count = 0;
+    for (auto &platform: platforms) {
+        std::vector<cl::Device> devices;
+        platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+
+        if (index < count + devices.size()) {
+            auto &device = devices[index - count];
+            std::cout << "Selected device " << device.getInfo<CL_DEVICE_NAME>() << " on platform "
+                      << platform.getInfo<CL_PLATFORM_NAME>() << std::endl;
+            return device;
+        }
+        count += devices.size();
     }
-    arr.resize(power, std::numeric_limits<real>::max());
-    padded_size = power;
 
-    padded_buffer_arr =cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(real) * power, arr.data());
+    throw std::runtime_error("OpenCL device " + std::to_string(index) + " does not exist (" +
+                             std::to_string(count) + " devices found)");
+}
+
+template<typename Real>
+void GPU_data_processing<Real>::set_buffer(column_view<Real> arr) {
+    buffer_size = arr.size();
 
+    // copy the input to the GPU - no padding, the sort kernels treat the missing elements as +infinity
+    release_buffer();
+    buffer_arr = pool->acquire(sizeof(Real) * buffer_size);
+    pool->upload(buffer_arr.buffer, arr.data(), sizeof(Real) * buffer_size, profiler->next(profile_stage::Upload));
 }
 
-GPU_data_processing::GPU_data_processing() : context(), program(), queue(), padded_size() {
-    cl::Device device = try_select_first_gpu();
+template<typename Real>
+void GPU_data_processing<Real>::release_buffer() {
+    if (buffer_arr.size_class != 0) {
+        pool->release(buffer_arr);
+        buffer_arr = pooled_buffer();
+    }
+}
 
-    std::vector<std::pair<const char *, size_t>> source_codes{{kernel_source, strlen(kernel_source)}};
+template<typename Real>
+GPU_data_processing<Real>::GPU_data_processing(gpu_strategy strategy)
+        : GPU_data_processing(try_select_first_gpu(), strategy) {}
+
+template<typename Real>
+GPU_data_processing<Real>::GPU_data_processing(const cl::Device &device, gpu_strategy strategy)
+        : device(device), context(), queue(), program(), buffer_size(), max_chunk_size(), strategy(strategy) {
+
+    const char *types = gpu_real_traits<Real>::kernel_types;
+    if constexpr (std::is_same_v<Real, double>) {
+        // devices without fp64 run the double precision in float-float arithmetic
+        if (device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>() == 0) {
+            std::cout << "Device has no double precision support - using double-single arithmetic" << std::endl;
+            double_single = true;
+            types = gpu_real_traits<double>::kernel_types_double_single;
+        }
+    }
+
+    std::vector<std::pair<const char *, size_t>> source_codes{{types,         strlen(types)},
+                                                              {kernel_source, strlen(kernel_source)}};
     const cl::Program::Sources &sources(source_codes);
     context = cl::Context{device};
     program = cl::Program{context, sources};
 
     try {
-        program.build({device});
+        program.build({device}, ("-D RADIX_BUCKETS=" + std::to_string(RADIX_BUCKETS)).c_str());
         if (program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) != CL_BUILD_SUCCESS)
             std::cerr << "Build Log:\n" << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
     } catch (const std::exception &e) {
@@ -57,150 +106,566 @@ GPU_data_processing::GPU_data_processing() : context(), program(), queue(), padd
         throw std::runtime_error("Failed to build OpenCL program");
     }
 
-    queue = cl::CommandQueue{context, device};
+    queue = cl::CommandQueue{context, device, CL_QUEUE_PROFILING_ENABLE};
+    upload_queue = cl::CommandQueue{context, device, CL_QUEUE_PROFILING_ENABLE};
+    download_queue = cl::CommandQueue{context, device, CL_QUEUE_PROFILING_ENABLE};
+    profiler = std::make_shared<gpu_profiler>();
+    // the buffers of one computation fit the device memory together, so a warm repetition reuses all of them
+    pool = std::make_shared<buffer_pool>(context, queue, device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>());
+
+    // largest chunk sorted at once - two chunks are on the device at the same time (double buffering), with the merge
+    // sort also their two temporaries, and half of the memory is left for the sums, partials and other buffers
+    const size_t chunk_buffers = strategy == gpu_strategy::Merge_sort ? 8 : 4;
+    // the pool rounds the chunks up to their size class, which must stay within the largest allocation
+    size_t chunk_bytes = buffer_pool::largest_class(std::min<size_t>(
+            device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>(),
+            device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / chunk_buffers));
+    max_chunk_size = chunk_bytes / sizeof(Real);
+
+    // partial sums and partial sums of squares of the largest grid of vector_sums
+    buffer_partials = pool->acquire(sizeof(Real) * 2 * SUM_MAX_GROUPS);
+
+    // create the kernels once - they are reused by all computations
+    kernel_vector_sums = cl::Kernel(program, "vector_sums");
+    kernel_reduce_partials = cl::Kernel(program, "reduce_partials");
+    kernel_merge_sort = cl::Kernel(program, "merge_sort");
+    kernel_bitonic_sort = cl::Kernel(program, "bitonic_sort_kernel");
+    kernel_radix_histogram = cl::Kernel(program, "radix_histogram");
+    kernel_radix_filter = cl::Kernel(program, "radix_filter");
+    if (!double_single) { // kernels with real arithmetic are not built for the double-single fallback
+        kernel_abs_diff = cl::Kernel(program, "abs_diff_calc");
+        kernel_median_of_sorted = cl::Kernel(program, "median_of_sorted");
+        kernel_abs_diff_from_buffer = cl::Kernel(program, "abs_diff_from_buffer");
+        kernel_segmented_statistics = cl::Kernel(program, "segmented_statistics");
+    }
 
+    tune_work_group_sizes();
 }
 
-void GPU_data_processing::abs_diff_calc(std::vector<real> &abs_diff, real median, size_t n) {
+template<typename Real>
+void GPU_data_processing<Real>::tune_work_group_sizes() {
+    work_group_tuner tuner(device, queue, WORK_GROUP_CACHE);
+    // the kernels of both precisions are tuned separately
+    auto tuned_name = [](const char *kernel) {
+        return std::string(kernel) + " " + gpu_real_traits<Real>::name;
+    };
+
+    // calibration data - the tuned kernels are data oblivious, the values only need to be valid reals
+    const size_t n = std::min<size_t>(CALIBRATION_SIZE, max_chunk_size);
+    std::vector<Real> data(n);
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<Real> distribution(-1000, 1000);
+    std::generate(data.begin(), data.end(), [&]() { return distribution(generator); });
+    pooled_buffer calibration = pool->acquire(sizeof(Real) * n);
+    pooled_buffer sums = pool->acquire(sizeof(Real) * 2);
+    pool->upload(calibration.buffer, data.data(), sizeof(Real) * n);
+
+    // vector_sums and reduce_partials share the size - the smaller limit of the two kernels applies
+    const cl::Kernel &sum_kernel =
+            kernel_reduce_partials.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) <
+            kernel_vector_sums.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) ? kernel_reduce_partials
+                                                                                  : kernel_vector_sums;
+    sum_work_group_size = tuner.tune(tuned_name("vector_sums"), sum_kernel, [&](size_t local_size) {
+        sum_work_group_size = local_size;
+        enqueue_vector_sums(queue, calibration.buffer, n, sums.buffer);
+    });
+    bitonic_work_group_size = tuner.tune(tuned_name("bitonic_sort_kernel"), kernel_bitonic_sort,
+                                         [&](size_t local_size) {
+                                             bitonic_work_group_size = local_size;
+                                             enqueue_bitonic_sort(queue, calibration.buffer, n);
+                                         });
+    if (!double_single) {
+        abs_diff_work_group_size = tuner.tune(tuned_name("abs_diff_calc"), kernel_abs_diff, [&](size_t local_size) {
+            abs_diff_work_group_size = local_size;
+            enqueue_abs_diff(calibration.buffer, 0, n);
+        });
+    }
+
+    // the radix-select kernels are not tuned - the default size within the limits of both kernels on the device
+    radix_work_group_size = std::min<size_t>(
+            {WORK_GROUP_SIZE, kernel_radix_histogram.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+             kernel_radix_filter.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device)});
 
-    // create sub-buffer - array without the padding
-    cl_buffer_region region = {0, sizeof(real) * n};
-    cl::Buffer sub_buffer = padded_buffer_arr.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region);
+    pool->release(calibration);
+    pool->release(sums);
+
+    // the calibration runs are not part of any computation
+    profiler->clear();
+}
+
+template<typename Real>
+gpu_profile GPU_data_processing<Real>::take_profile() {
+    gpu_profile profile = profiler->take();
+    profile.allocations = pool->take_allocations();
+    return profile;
+}
 
-    // create kernel
-    cl::Kernel kernel_abs_diff(program, "abs_diff_calc");
+template<typename Real>
+void GPU_data_processing<Real>::enqueue_abs_diff(const cl::Buffer &buffer, Real median, size_t n) {
+    if (double_single) {
+        // no double arithmetic on the device - compute on the host and upload the differences back
+        std::vector<Real> values(n);
+        pool->download(buffer, values.data(), sizeof(Real) * n, profiler->next(profile_stage::Readback));
+        for (auto &value: values) {
+            value = std::fabs(value - median);
+        }
+        pool->upload(buffer, values.data(), sizeof(Real) * n, profiler->next(profile_stage::Upload));
+        return;
+    }
 
     // set kernel arguments
-    kernel_abs_diff.setArg(0, sub_buffer);
+    kernel_abs_diff.setArg(0, buffer);
     kernel_abs_diff.setArg(1, median);
+    kernel_abs_diff.setArg(2, static_cast<cl_ulong>(n));
 
     // execute kernel
-    cl::NDRange global(n);
-    queue.enqueueNDRangeKernel(kernel_abs_diff, cl::NullRange, global);
+    cl::NDRange global((n + abs_diff_work_group_size - 1) / abs_diff_work_group_size * abs_diff_work_group_size);
+    cl::NDRange local(abs_diff_work_group_size);
+    queue.enqueueNDRangeKernel(kernel_abs_diff, cl::NullRange, global, local, nullptr,
+                               profiler->next(profile_stage::Abs_diff));
     queue.finish();
-
-    // read the result back to the host
-    queue.enqueueReadBuffer(sub_buffer, CL_TRUE, 0, sizeof(real) * n, abs_diff.data());
 }
 
-void GPU_data_processing::sum_vector(real &sum, real &sum2, size_t n) {
+template<typename Real>
+void GPU_data_processing<Real>::abs_diff_calc(std::vector<Real> &abs_diff, Real median, size_t n) {
 
-    // calculate the global size and number of workgroups
-    const size_t global_size = ((n + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE) * WORK_GROUP_SIZE;
-    const size_t num_workgroups = global_size / WORK_GROUP_SIZE;
+    enqueue_abs_diff(buffer_arr.buffer, median, n);
 
-    // create buffers for partial sums and partial sums of squares
-    cl::Buffer buffer_partial_sums(context, CL_MEM_WRITE_ONLY, sizeof(real) * num_workgroups);
-    cl::Buffer buffer_partial_sums_squares(context, CL_MEM_WRITE_ONLY, sizeof(real) * num_workgroups);
+    // read the result back to the host
+    pool->download(buffer_arr.buffer, abs_diff.data(), sizeof(Real) * n, profiler->next(profile_stage::Readback));
+}
+
+template<typename Real>
+size_t GPU_data_processing<Real>::num_sum_workgroups(size_t n) const {
+    const size_t per_workgroup = sum_work_group_size * gpu_real_traits<Real>::vector_width * 2;
+    return std::clamp<size_t>((n + per_workgroup - 1) / per_workgroup, 1, SUM_MAX_GROUPS);
+}
 
-    // create sub-buffer - array without the padding
-    cl_buffer_region region = {0, sizeof(real) * n};
-    cl::Buffer sub_buffer = padded_buffer_arr.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region);
+template<typename Real>
+void GPU_data_processing<Real>::enqueue_vector_sums(const cl::CommandQueue &command_queue, const cl::Buffer &buffer,
+                                                    size_t n, const cl::Buffer &sums,
+                                                    const std::vector<cl::Event> *wait_events) {
 
-    // create kernel
-    cl::Kernel kernel_vector_sum(program, "vector_sums");
+    // calculate the global size - the kernel loops over the rest of the vector
+    const size_t num_workgroups = num_sum_workgroups(n);
+    const size_t global_size = num_workgroups * sum_work_group_size;
 
     // set kernel arguments
-    kernel_vector_sum.setArg(0, sub_buffer);
-    kernel_vector_sum.setArg(1, buffer_partial_sums);
-    kernel_vector_sum.setArg(2, buffer_partial_sums_squares);
-    kernel_vector_sum.setArg(3, cl::Local(sizeof(real) * WORK_GROUP_SIZE)); // local memory for partial sums
-    kernel_vector_sum.setArg(4, cl::Local(sizeof(real) * WORK_GROUP_SIZE)); // local memory for partial sums of squares
+    kernel_vector_sums.setArg(0, buffer);
+    kernel_vector_sums.setArg(1, buffer_partials.buffer);
+    kernel_vector_sums.setArg(2, cl::Local(sizeof(Real) * sum_work_group_size)); // local memory for partial sums
+    kernel_vector_sums.setArg(3, cl::Local(sizeof(Real) * sum_work_group_size)); // local memory for partial sums of squares
+    kernel_vector_sums.setArg(4, static_cast<cl_ulong>(n));
 
     // execute kernel
     cl::NDRange global(global_size);
-    cl::NDRange local(WORK_GROUP_SIZE);
-    queue.enqueueNDRangeKernel(kernel_vector_sum, cl::NullRange, global, local);
-    queue.finish();
+    cl::NDRange local(sum_work_group_size);
+    command_queue.enqueueNDRangeKernel(kernel_vector_sums, cl::NullRange, global, local, wait_events,
+                                       profiler->next(profile_stage::Reduce));
+
+    // reduce the partial sums of the workgroups on the device - only two values are read back
+    kernel_reduce_partials.setArg(0, buffer_partials.buffer);
+    kernel_reduce_partials.setArg(1, static_cast<cl_uint>(num_workgroups));
+    kernel_reduce_partials.setArg(2, sums);
+    kernel_reduce_partials.setArg(3, cl::Local(sizeof(Real) * sum_work_group_size));
+    kernel_reduce_partials.setArg(4, cl::Local(sizeof(Real) * sum_work_group_size));
+    command_queue.enqueueNDRangeKernel(kernel_reduce_partials, cl::NullRange, local, local, nullptr,
+                                       profiler->next(profile_stage::Reduce));
+}
 
-    // read the partial sums back to the host
-    std::vector<real> partial_sums(num_workgroups);
-    std::vector<real> partial_sums_squares(num_workgroups);
-    queue.enqueueReadBuffer(buffer_partial_sums, CL_TRUE, 0, sizeof(real) * num_workgroups, partial_sums.data());
-    queue.enqueueReadBuffer(buffer_partial_sums_squares, CL_TRUE, 0, sizeof(real) * num_workgroups, partial_sums_squares.data());
+template<typename Real>
+void GPU_data_processing<Real>::sum_vector(Real &sum, Real &sum2, size_t n) {
 
-    // calculate the total sum and sum of squares - reduce the partial sums
-    sum = std::accumulate(partial_sums.begin(), partial_sums.end(), static_cast<real>(0.0));
-    sum2 = std::accumulate(partial_sums_squares.begin(), partial_sums_squares.end(), static_cast<real>(0.0));
-}
+    // borrow a buffer for the sum and sum of squares
+    pooled_buffer buffer_sums = pool->acquire(sizeof(Real) * 2);
 
-[[maybe_unused]] // not used in the current implementation, bitonic sort is faster
-void GPU_data_processing::merge_sort(std::vector<real> &arr, size_t n) {
+    enqueue_vector_sums(queue, buffer_arr.buffer, n, buffer_sums.buffer);
+    queue.finish();
 
-    // create buffers - copy of the whole array here to make it functional with the current implementation with bitonic sort
-    cl::Buffer buffer_arr(context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, sizeof(real) * n, arr.data());
-    cl::Buffer buffer_temp(context, CL_MEM_READ_WRITE, sizeof(real) * n);
+    // read the sums back to the host
+    Real sums[2];
+    pool->download(buffer_sums.buffer, sums, sizeof(Real) * 2, profiler->next(profile_stage::Readback));
+    pool->release(buffer_sums);
+
+    decode_sums(sums, sum, sum2);
+}
 
-    // create kernel
-    cl::Kernel kernel_merge_sort(program, "merge_sort");
+template<typename Real>
+void GPU_data_processing<Real>::decode_sums(const Real *sums, Real &sum, Real &sum2) const {
+    if (!double_single) {
+        sum = sums[0];
+        sum2 = sums[1];
+        return;
+    }
+    // (hi, lo) float pairs of the sum and the sum of squares
+    cl_float parts[4];
+    std::memcpy(parts, sums, sizeof(parts));
+    sum = static_cast<Real>(parts[0]) + static_cast<Real>(parts[1]);
+    sum2 = static_cast<Real>(parts[2]) + static_cast<Real>(parts[3]);
+}
 
+template<typename Real>
+void GPU_data_processing<Real>::enqueue_merge_sort(const cl::CommandQueue &command_queue, const cl::Buffer &buffer,
+                                                   const cl::Buffer &temp, size_t n,
+                                                   const std::vector<cl::Event> *wait_events) {
     // execute the kernel
     for (size_t width = 1; width < n; width *= 2) { // for each width
-        kernel_merge_sort.setArg(0, buffer_arr);
-        kernel_merge_sort.setArg(1, buffer_temp);
-        kernel_merge_sort.setArg(2, static_cast<unsigned int>(width));
-        kernel_merge_sort.setArg(3, static_cast<unsigned int>(n));
+        kernel_merge_sort.setArg(0, buffer);
+        kernel_merge_sort.setArg(1, temp);
+        kernel_merge_sort.setArg(2, static_cast<cl_ulong>(width));
+        kernel_merge_sort.setArg(3, static_cast<cl_ulong>(n));
 
         cl::NDRange global((n+2*width-1) / (width * 2));
-        queue.enqueueNDRangeKernel(kernel_merge_sort, cl::NullRange, global);
-        queue.finish();
+        command_queue.enqueueNDRangeKernel(kernel_merge_sort, cl::NullRange, global, cl::NullRange,
+                                           width == 1 ? wait_events : nullptr, profiler->next(profile_stage::Sort));
     }
+}
+
+template<typename Real>
+void GPU_data_processing<Real>::merge_sort(std::vector<Real> &arr, size_t n) {
+
+    // borrow temporary buffer
+    pooled_buffer buffer_temp = pool->acquire(sizeof(Real) * n);
+
+    enqueue_merge_sort(queue, buffer_arr.buffer, buffer_temp.buffer, n);
+    queue.finish();
+
+    pool->release(buffer_temp);
 
     // read the sorted data back to the host
-    queue.enqueueReadBuffer(buffer_arr, CL_TRUE, 0, sizeof(real) * n, arr.data());
+    pool->download(buffer_arr.buffer, arr.data(), sizeof(Real) * n, profiler->next(profile_stage::Readback));
+}
+
+template<typename Real>
+Real GPU_data_processing<Real>::from_ordered_key(real_key key) {
+    constexpr real_key sign_bit = static_cast<real_key>(1) << (sizeof(real_key) * 8 - 1);
+    real_key bits = (key & sign_bit) ? (key & ~sign_bit) : ~key;
+    Real value;
+    std::memcpy(&value, &bits, sizeof(Real));
+    return value;
+}
+
+template<typename Real>
+void GPU_data_processing<Real>::set_max_chunk_size(size_t chunk_size) {
+    max_chunk_size = chunk_size;
+}
+
+template<typename Real>
+int GPU_data_processing<Real>::chunked_sort(std::vector<Real> &arr, Real &sum, Real &sum2) {
+    const size_t n = arr.size();
+    const size_t num_chunks = (n + max_chunk_size - 1) / max_chunk_size;
+
+    // two chunks in flight - one is sorted while the other one is transferred
+    pooled_buffer chunks[2] = {pool->acquire(sizeof(Real) * max_chunk_size),
+                               pool->acquire(sizeof(Real) * max_chunk_size)};
+    pooled_buffer temps[2];
+    if (strategy == gpu_strategy::Merge_sort) {
+        temps[0] = pool->acquire(sizeof(Real) * max_chunk_size);
+        temps[1] = pool->acquire(sizeof(Real) * max_chunk_size);
+    }
+    std::vector<pooled_buffer> sums(num_chunks);
+    std::vector<Real> host_sums(2 * num_chunks);
+    std::vector<cl::Event> downloaded(num_chunks);
+
+    for (size_t c = 0; c < num_chunks; ++c) {
+        const size_t offset = c * max_chunk_size;
+        const size_t size = std::min(max_chunk_size, n - offset);
+        const cl::Buffer &chunk = chunks[c % 2].buffer;
+
+        // upload - the device buffer is free once the readback of the chunk before the previous one finished
+        std::vector<cl::Event> wait_free;
+        if (c >= 2) {
+            wait_free.push_back(downloaded[c - 2]);
+        }
+        cl::Event uploaded;
+        upload_queue.enqueueWriteBuffer(chunk, CL_FALSE, 0, sizeof(Real) * size, arr.data() + offset,
+                                        wait_free.empty() ? nullptr : &wait_free, &uploaded);
+        *profiler->next(profile_stage::Upload) = uploaded;
+        upload_queue.flush();
+
+        // sum and sort the chunk
+        const std::vector<cl::Event> wait_upload{uploaded};
+        sums[c] = pool->acquire(sizeof(Real) * 2);
+        enqueue_vector_sums(queue, chunk, size, sums[c].buffer, &wait_upload);
+        if (strategy == gpu_strategy::Merge_sort) {
+            enqueue_merge_sort(queue, chunk, temps[c % 2].buffer, size);
+        } else {
+            enqueue_bitonic_sort(queue, chunk, size);
+        }
+        cl::Event sorted;
+        queue.enqueueMarkerWithWaitList(nullptr, &sorted);
+        queue.flush();
+
+        // read the sorted run back to its place in the host array
+        const std::vector<cl::Event> wait_sort{sorted};
+        download_queue.enqueueReadBuffer(sums[c].buffer, CL_FALSE, 0, sizeof(Real) * 2, host_sums.data() + 2 * c,
+                                         &wait_sort, profiler->next(profile_stage::Readback));
+        download_queue.enqueueReadBuffer(chunk, CL_FALSE, 0, sizeof(Real) * size, arr.data() + offset, &wait_sort,
+                                         &downloaded[c]);
+        *profiler->next(profile_stage::Readback) = downloaded[c];
+        download_queue.flush();
+    }
+    download_queue.finish();
+
+    // add up the sums of all chunks and return the buffers to the pool
+    for (size_t c = 0; c < num_chunks; ++c) {
+        Real chunk_sum, chunk_sum2;
+        decode_sums(host_sums.data() + 2 * c, chunk_sum, chunk_sum2);
+        sum += chunk_sum;
+        sum2 += chunk_sum2;
+        pool->release(sums[c]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        pool->release(chunks[i]);
+        if (temps[i].size_class != 0) {
+            pool->release(temps[i]);
+        }
+    }
+
+    // k-way merge of the sorted runs on the host
+    merge_runs(arr, max_chunk_size);
+
+    return EXIT_SUCCESS;
+}
+
+template<typename Real>
+Real GPU_data_processing<Real>::radix_select(size_t k, size_t n) {
+    if (n > std::numeric_limits<cl_uint>::max()) {
+        throw std::runtime_error("Radix-select histogram counts are limited to 2^32 elements");
+    }
+
+    // borrow buffers for the histogram of one digit and the number of surviving keys
+    pooled_buffer buffer_histogram = pool->acquire(sizeof(cl_uint) * RADIX_BUCKETS);
+    pooled_buffer buffer_survivors_count = pool->acquire(sizeof(cl_uint));
+    // ping-pong buffers for the surviving keys - borrowed by the first filtering
+    pooled_buffer buffer_survivors[2];
+    int current = -1; // index of the buffer with the surviving keys, -1 for the input array
+
+    auto release_buffers = [&]() {
+        pool->release(buffer_histogram);
+        pool->release(buffer_survivors_count);
+        if (current >= 0) {
+            pool->release(buffer_survivors[0]);
+            pool->release(buffer_survivors[1]);
+        }
+    };
+
+    const std::vector<cl_uint> zeros(RADIX_BUCKETS, 0);
+    std::vector<cl_uint> histogram(RADIX_BUCKETS);
+    real_key prefix = 0; // already selected digits of the key
+    real_key prefix_mask = 0; // mask of the already selected digits
+    size_t count = n; // number of surviving keys
+
+    // resolve the key digit by digit - from the most significant one
+    for (cl_uint shift = sizeof(real_key) * 8 - RADIX_BITS;; shift -= RADIX_BITS) {
+        const cl::Buffer &input = current < 0 ? buffer_arr.buffer : buffer_survivors[current].buffer;
+        const size_t global_size = std::min<size_t>((count + radix_work_group_size - 1) / radix_work_group_size,
+                                                    RADIX_MAX_GROUPS) * radix_work_group_size;
+
+        // build the histogram of the current digit
+        queue.enqueueWriteBuffer(buffer_histogram.buffer, CL_FALSE, 0, sizeof(cl_uint) * RADIX_BUCKETS, zeros.data(),
+                                 nullptr, profiler->next(profile_stage::Upload));
+        kernel_radix_histogram.setArg(0, input);
+        kernel_radix_histogram.setArg(1, static_cast<cl_ulong>(count));
+        kernel_radix_histogram.setArg(2, shift);
+        kernel_radix_histogram.setArg(3, buffer_histogram.buffer);
+        kernel_radix_histogram.setArg(4, cl::Local(sizeof(cl_uint) * RADIX_BUCKETS));
+        queue.enqueueNDRangeKernel(kernel_radix_histogram, cl::NullRange, cl::NDRange(global_size),
+                                   cl::NDRange(radix_work_group_size), nullptr, profiler->next(profile_stage::Sort));
+        queue.enqueueReadBuffer(buffer_histogram.buffer, CL_TRUE, 0, sizeof(cl_uint) * RADIX_BUCKETS, histogram.data(),
+                                nullptr, profiler->next(profile_stage::Readback));
+
+        // find the bucket containing rank k - the histogram holds all surviving keys, so it runs out only if the
+        // rank is not below their count
+        cl_uint bucket = 0;
+        while (bucket < RADIX_BUCKETS && k >= histogram[bucket]) {
+            k -= histogram[bucket++];
+        }
+        if (bucket == RADIX_BUCKETS) {
+            release_buffers();
+            throw std::runtime_error("Radix-select rank is beyond the histogram of the keys");
+        }
+        prefix |= static_cast<real_key>(bucket) << shift;
+        prefix_mask |= static_cast<real_key>(RADIX_BUCKETS - 1) << shift;
+
+        if (shift == 0) { // all digits resolved
+            break;
+        }
+
+        // keep only the keys of the selected bucket - skipped if all keys survive
+        if (histogram[bucket] < count) {
+            if (current < 0) { // the first filtering produces the most survivors
+                buffer_survivors[0] = pool->acquire(sizeof(real_key) * histogram[bucket]);
+                buffer_survivors[1] = pool->acquire(sizeof(real_key) * histogram[bucket]);
+            }
+            const int next = current == 0 ? 1 : 0;
+            const cl_uint zero = 0;
+            queue.enqueueWriteBuffer(buffer_survivors_count.buffer, CL_FALSE, 0, sizeof(cl_uint), &zero, nullptr,
+                                     profiler->next(profile_stage::Upload));
+            kernel_radix_filter.setArg(0, input);
+            kernel_radix_filter.setArg(1, static_cast<cl_ulong>(count));
+            kernel_radix_filter.setArg(2, prefix);
+            kernel_radix_filter.setArg(3, prefix_mask);
+            kernel_radix_filter.setArg(4, buffer_survivors[next].buffer);
+            kernel_radix_filter.setArg(5, buffer_survivors_count.buffer);
+            queue.enqueueNDRangeKernel(kernel_radix_filter, cl::NullRange, cl::NDRange(global_size),
+                                       cl::NDRange(radix_work_group_size), nullptr,
+                                       profiler->next(profile_stage::Sort));
+            queue.finish();
+
+            current = next;
+            count = histogram[bucket];
+        }
+    }
+
+    // return the buffers to the pool
+    release_buffers();
+
+    return from_ordered_key(prefix);
+}
+
+template<typename Real>
+Real GPU_data_processing<Real>::radix_median(size_t n) {
+    Real right_middle = radix_select(n / 2, n);
+    if (n & 1) { // odd number of elements - single middle element
+        return right_middle;
+    }
+    return (radix_select((n - 1) / 2, n) + right_middle) / static_cast<Real>(2.0);
 }
 
-void GPU_data_processing::bitonic_sort(std::vector<real> &arr, size_t n) {
+template<typename Real>
+void GPU_data_processing<Real>::enqueue_bitonic_sort(const cl::CommandQueue &command_queue, const cl::Buffer &buffer,
+                                                     size_t n, const std::vector<cl::Event> *wait_events) {
 
-    // create the kernel
-    cl::Kernel bitonic_sort_kernel(program, "bitonic_sort_kernel");
-    bitonic_sort_kernel.setArg(0, padded_buffer_arr);
+    kernel_bitonic_sort.setArg(0, buffer);
+    kernel_bitonic_sort.setArg(1, static_cast<cl_ulong>(n));
 
-    // calculate the number of stages
+    // calculate the number of stages - the array is virtually padded to the nearest power of 2
     unsigned int num_stages = 0;
-    for (size_t i = padded_size; i > 1; i >>= 1)
+    size_t power = 1;
+    while (power < n) {
+        power <<= 1;
         ++num_stages;
+    }
 
-    size_t local_size = WORK_GROUP_SIZE;
-    size_t global_size = ((padded_size >> 1) + local_size - 1) / local_size * local_size;
+    size_t local_size = bitonic_work_group_size;
+    size_t global_size = ((power >> 1) + local_size - 1) / local_size * local_size;
 
-    // execute the bitonic sort kernel
+    // execute the bitonic sort kernel - the queue is in-order so the passes do not need to be synchronized
     for (unsigned int stage = 0; stage < num_stages; ++stage) { // for each stage
-        bitonic_sort_kernel.setArg(1, stage);
+        kernel_bitonic_sort.setArg(2, stage);
         for (unsigned int pass_of_stage = 0; pass_of_stage <= stage; ++pass_of_stage) { // for each pass of the stage
-            bitonic_sort_kernel.setArg(2, pass_of_stage);
-            queue.enqueueNDRangeKernel(bitonic_sort_kernel, cl::NullRange, cl::NDRange(global_size), cl::NDRange(local_size));
-            queue.finish();
+            kernel_bitonic_sort.setArg(3, pass_of_stage);
+            command_queue.enqueueNDRangeKernel(kernel_bitonic_sort, cl::NullRange, cl::NDRange(global_size),
+                                               cl::NDRange(local_size), stage == 0 ? wait_events : nullptr,
+                                               profiler->next(profile_stage::Sort));
         }
     }
+}
 
-    // read the sorted data back to the host
-    queue.enqueueReadBuffer(padded_buffer_arr, CL_TRUE, 0, sizeof(real) * padded_size, arr.data());
+template<typename Real>
+void GPU_data_processing<Real>::bitonic_sort(std::vector<Real> &arr, size_t n) {
+
+    enqueue_bitonic_sort(queue, buffer_arr.buffer, n);
+    queue.finish();
 
-    // remove the padding - padding is at the end of the array
-    arr.resize(n);
+    // read the sorted data back to the host
+    pool->download(buffer_arr.buffer, arr.data(), sizeof(Real) * n, profiler->next(profile_stage::Readback));
 }
 
-int GPU_data_processing::compute_CV_MAD(std::vector<real> &vec, real &cv, real &mad, bool is_vectorized,
-                                        const execution_policy &policy) {
-    // to avoid warnings
-    (void) is_vectorized;
-    (void) policy;
+template<typename Real>
+int GPU_data_processing<Real>::sort_and_sum(std::vector<Real> &arr, Real &sum, Real &sum2) {
+    const size_t n = arr.size();
+    sum = 0;
+    sum2 = 0;
+    if (n == 0) {
+        return EXIT_SUCCESS;
+    }
+    if (n > max_chunk_size) {
+        return chunked_sort(arr, sum, sum2);
+    }
+
+    set_buffer(arr);
+    sum_vector(sum, sum2, n);
+    if (strategy == gpu_strategy::Merge_sort) {
+        merge_sort(arr, n);
+    } else {
+        bitonic_sort(arr, n);
+    }
+    release_buffer();
+    return EXIT_SUCCESS;
+}
 
+template<typename Real>
+int GPU_data_processing<Real>::compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, bool is_vectorized,
+                                              const execution_policy &policy) {
     // initialize the variables
-    real sum = 0;
-    real sum2 = 0;
+    Real sum = 0;
+    Real sum2 = 0;
     size_t n = vec.size();
+    if (n == 0) { // no median of an empty column (e.g. the first partition of a short column)
+        std::cerr << "Empty column" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // the deterministic sums are reduced on the host from the input order - the device sums depend on the
+    // work group size, so they are not computed at all
+    const bool deterministic = selected_reduction_mode() != reduction_mode::Fast;
+    Real host_sum = 0;
+    Real host_sum2 = 0;
+    if (deterministic) {
+        reduce_sums(vec.data(), n, host_sum, host_sum2, policy);
+    }
+    Real &cv_sum = deterministic ? host_sum : sum;
+    Real &cv_sum2 = deterministic ? host_sum2 : sum2;
+
+    if (n > max_chunk_size || (strategy == gpu_strategy::Radix_select && n > std::numeric_limits<cl_uint>::max())) {
+        // the column does not fit the device - sort it chunk by chunk and merge the runs on the host
+        auto [sort_time, sort_ret] = measure_time([this, &vec, &sum, &sum2]() {
+            return this->chunked_sort(vec, sum, sum2);
+        });
+        if (sort_ret != EXIT_SUCCESS || !std::is_sorted(vec.begin(), vec.end())) {
+            std::cerr << "Failed to sort data" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Sorted in " << sort_time << " seconds (" << (n + max_chunk_size - 1) / max_chunk_size
+                  << " chunks)" << std::endl;
+
+        cv = CV(cv_sum, cv_sum2, n);
+        mad = MAD(vec, n, is_vectorized, policy);
+        return EXIT_SUCCESS;
+    }
 
     // set the buffer
     set_buffer(vec);
 
     // compute sums
-    sum_vector(sum, sum2, n);
+    if (!deterministic) {
+        sum_vector(sum, sum2, n);
+    }
+
+    if (strategy == gpu_strategy::Radix_select) {
+        // select the median and the median of the absolute differences without sorting
+        auto [select_time, median] = measure_time([this, n]() {
+            return this->radix_median(n);
+        });
+        std::cout << "Selected in " << select_time << " seconds" << std::endl;
+
+        enqueue_abs_diff(buffer_arr.buffer, median, n);
+        mad = radix_median(n);
+        cv = CV(cv_sum, cv_sum2, n);
+
+        release_buffer();
+        return EXIT_SUCCESS;
+    }
 
     // sort the data
     auto [sort_time, _] = measure_time([this, &vec, n]() {
-        this->bitonic_sort(vec, n);
+        if (this->strategy == gpu_strategy::Merge_sort) {
+            this->merge_sort(vec, n);
+        } else {
+            this->bitonic_sort(vec, n);
+        }
         return EXIT_SUCCESS; // Ensure the lambda returns a value
     });
 
@@ -208,17 +673,215 @@ int GPU_data_processing::compute_CV_MAD(std::vector<real> &vec, real &cv, real &
     if (std::is_sorted(vec.begin(), vec.end())) {
         std::cout << "Sorted in " << sort_time << " seconds" << std::endl;
 
-        mad = (vec[n / 2] + vec[(n - 1) / 2]) / static_cast<real>(2.0);
+        mad = (vec[n / 2] + vec[(n - 1) / 2]) / static_cast<Real>(2.0);
         abs_diff_calc(vec, mad, n);
         mad = find_median(vec, n);
-        cv = CV(sum, sum2, n);
+        cv = CV(cv_sum, cv_sum2, n);
 
+        release_buffer();
         return EXIT_SUCCESS;
 
     } else {
+        release_buffer();
         std::cerr << "Failed to sort data" << std::endl;
         return EXIT_FAILURE;
     }
 
 }
 
+template<typename Real>
+int GPU_data_processing<Real>::compute_CV_MAD_batch(const std::vector<column_view<Real>> &columns,
+                                                    std::vector<Real> &cv, std::vector<Real> &mad) {
+    cv.assign(columns.size(), 0);
+    mad.assign(columns.size(), 0);
+    // an empty column has no median and would be launched with an empty grid - rejected before any buffer is taken
+    if (std::any_of(columns.begin(), columns.end(), [](const auto &column) { return column.size() == 0; })) {
+        std::cerr << "Empty column in the batch" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool fits_device = std::all_of(columns.begin(), columns.end(), [this](const auto &column) {
+        return column.size() <= max_chunk_size;
+    });
+    if (strategy == gpu_strategy::Radix_select || !fits_device || double_single) {
+        // radix-select reads the histogram back after every pass, oversized columns are sorted chunk
+        // by chunk and the double-single fallback computes the MAD on the host - nothing to overlap,
+        // compute one by one
+        execution_policy policy(execution_policy::e_type::Sequential);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            std::vector<Real> column(columns[i].begin(), columns[i].end());
+            if (compute_CV_MAD(column, cv[i], mad[i], false, policy) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // state of one column in the pipeline
+    struct column_state {
+        size_t n = 0;
+        pooled_buffer staging, data, temp, median, sums;
+        cl::Event uploaded, computed;
+        std::vector<Real> abs_diff;
+        Real host_sums[2] = {0, 0};
+    };
+    std::vector<column_state> states(columns.size());
+
+    for (size_t i = 0; i < columns.size(); ++i) {
+        column_view<Real> column = columns[i];
+        column_state &state = states[i];
+        state.n = column.size();
+        const size_t bytes = sizeof(Real) * state.n;
+
+        // upload - the pinned staging buffer of one transfer chunk is filled while the previous column is being
+        // computed, the event of the last chunk marks the whole column uploaded
+        state.staging = pool->acquire_staging(bytes);
+        state.data = pool->acquire(bytes);
+        buffer_pool::upload(upload_queue, state.staging, state.data.buffer, column.data(), bytes, &state.uploaded);
+        *profiler->next(profile_stage::Upload) = state.uploaded;
+        upload_queue.flush();
+
+        // compute - waits only for the upload of this column
+        const std::vector<cl::Event> wait_upload{state.uploaded};
+        state.median = pool->acquire(sizeof(Real));
+        state.sums = pool->acquire(sizeof(Real) * 2);
+        enqueue_vector_sums(queue, state.data.buffer, state.n, state.sums.buffer, &wait_upload);
+        if (strategy == gpu_strategy::Merge_sort) {
+            state.temp = pool->acquire(bytes);
+            enqueue_merge_sort(queue, state.data.buffer, state.temp.buffer, state.n);
+        } else {
+            enqueue_bitonic_sort(queue, state.data.buffer, state.n);
+        }
+        // the median is taken from the sorted buffer on the GPU, the absolute differences replace the data
+        kernel_median_of_sorted.setArg(0, state.data.buffer);
+        kernel_median_of_sorted.setArg(1, static_cast<cl_ulong>(state.n));
+        kernel_median_of_sorted.setArg(2, state.median.buffer);
+        queue.enqueueNDRangeKernel(kernel_median_of_sorted, cl::NullRange, cl::NDRange(1), cl::NullRange, nullptr,
+                                   profiler->next(profile_stage::Abs_diff));
+        kernel_abs_diff_from_buffer.setArg(0, state.data.buffer);
+        kernel_abs_diff_from_buffer.setArg(1, state.median.buffer);
+        queue.enqueueNDRangeKernel(kernel_abs_diff_from_buffer, cl::NullRange, cl::NDRange(state.n), cl::NullRange,
+                                   nullptr, &state.computed);
+        *profiler->next(profile_stage::Abs_diff) = state.computed;
+        queue.flush();
+
+        // readback - waits only for the computation of this column, overlaps the computation of the next one
+        const std::vector<cl::Event> wait_compute{state.computed};
+        state.abs_diff.resize(state.n);
+        download_queue.enqueueReadBuffer(state.sums.buffer, CL_FALSE, 0, sizeof(Real) * 2, state.host_sums,
+                                         &wait_compute, profiler->next(profile_stage::Readback));
+        download_queue.enqueueReadBuffer(state.data.buffer, CL_FALSE, 0, bytes, state.abs_diff.data(), &wait_compute,
+                                         profiler->next(profile_stage::Readback));
+        download_queue.flush();
+    }
+    download_queue.finish();
+
+    // finish the statistics on the host and return the buffers to the pool
+    for (size_t i = 0; i < columns.size(); ++i) {
+        column_state &state = states[i];
+        if (selected_reduction_mode() != reduction_mode::Fast) { // the same sums as the other engines
+            reduce_sums(columns[i].data(), state.n, state.host_sums[0], state.host_sums[1],
+                        execution_policy(execution_policy::e_type::Parallel));
+        }
+        cv[i] = CV(state.host_sums[0], state.host_sums[1], state.n);
+        mad[i] = find_median(state.abs_diff, state.n);
+
+        pool->release_staging(state.staging);
+        pool->release(state.data);
+        pool->release(state.median);
+        pool->release(state.sums);
+        if (state.temp.size_class != 0) {
+            pool->release(state.temp);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+template<typename Real>
+int GPU_data_processing<Real>::compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                                        std::vector<Real> &cv, std::vector<Real> &mad,
+                                                        const execution_policy &policy) {
+    check_segments(offsets, data.size());
+    if (double_single) { // the segmented kernel needs double arithmetic on the device
+        return CPU_data_processing::compute_CV_MAD_segmented(data, offsets, cv, mad, policy);
+    }
+    const size_t num_segments = offsets.size() - 1;
+    cv.assign(num_segments, 0);
+    mad.assign(num_segments, 0);
+
+    // local memory length - the longest segment handled by the kernel rounded up to a power of 2
+    size_t longest = 0;
+    for (size_t s = 0; s < num_segments; ++s) {
+        size_t n = offsets[s + 1] - offsets[s];
+        if (n <= SEGMENT_MAX_LENGTH) {
+            longest = std::max(longest, n);
+        }
+    }
+    cl_uint padded_length = 1;
+    while (padded_length < longest) {
+        padded_length <<= 1;
+    }
+    const size_t local_size = std::min<size_t>(WORK_GROUP_SIZE, padded_length);
+
+    if (longest > 0) {
+        // upload the data and the offsets, compute all short segments by one launch
+        std::vector<cl_ulong> device_offsets(offsets.begin(), offsets.end());
+        pooled_buffer buffer_data = pool->acquire(sizeof(Real) * data.size());
+        pooled_buffer buffer_offsets = pool->acquire(sizeof(cl_ulong) * device_offsets.size());
+        pooled_buffer buffer_sums = pool->acquire(sizeof(Real) * 2 * num_segments);
+        pooled_buffer buffer_mads = pool->acquire(sizeof(Real) * num_segments);
+        pool->upload(buffer_data.buffer, data.data(), sizeof(Real) * data.size(),
+                     profiler->next(profile_stage::Upload));
+        pool->upload(buffer_offsets.buffer, device_offsets.data(), sizeof(cl_ulong) * device_offsets.size(),
+                     profiler->next(profile_stage::Upload));
+
+        kernel_segmented_statistics.setArg(0, buffer_data.buffer);
+        kernel_segmented_statistics.setArg(1, buffer_offsets.buffer);
+        kernel_segmented_statistics.setArg(2, buffer_sums.buffer);
+        kernel_segmented_statistics.setArg(3, buffer_mads.buffer);
+        kernel_segmented_statistics.setArg(4, cl::Local(sizeof(Real) * padded_length));
+        kernel_segmented_statistics.setArg(5, cl::Local(sizeof(Real) * local_size));
+        kernel_segmented_statistics.setArg(6, cl::Local(sizeof(Real) * local_size));
+        kernel_segmented_statistics.setArg(7, padded_length);
+        queue.enqueueNDRangeKernel(kernel_segmented_statistics, cl::NullRange,
+                                   cl::NDRange(num_segments * local_size), cl::NDRange(local_size), nullptr,
+                                   profiler->next(profile_stage::Sort));
+
+        std::vector<Real> sums(2 * num_segments);
+        pool->download(buffer_sums.buffer, sums.data(), sizeof(Real) * sums.size(),
+                       profiler->next(profile_stage::Readback));
+        pool->download(buffer_mads.buffer, mad.data(), sizeof(Real) * num_segments,
+                       profiler->next(profile_stage::Readback));
+        for (size_t s = 0; s < num_segments; ++s) {
+            if (selected_reduction_mode() != reduction_mode::Fast) { // the same sums as the other engines
+                reduce_sums_static<Real, execution_policy::e_type::Sequential>(data.data() + offsets[s],
+                                                                                offsets[s + 1] - offsets[s],
+                                                                                sums[2 * s], sums[2 * s + 1]);
+            }
+            cv[s] = CV(sums[2 * s], sums[2 * s + 1], offsets[s + 1] - offsets[s]);
+        }
+
+        pool->release(buffer_data);
+        pool->release(buffer_offsets);
+        pool->release(buffer_sums);
+        pool->release(buffer_mads);
+    }
+
+    // segments too long for the local memory are computed one by one
+    for (size_t s = 0; s < num_segments; ++s) {
+        if (offsets[s + 1] - offsets[s] > SEGMENT_MAX_LENGTH) {
+            std::vector<Real> segment(data.begin() + static_cast<std::ptrdiff_t>(offsets[s]),
+                                      data.begin() + static_cast<std::ptrdiff_t>(offsets[s + 1]));
+            if (compute_CV_MAD(segment, cv[s], mad[s], false, policy) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+template class GPU_data_processing<float>;
+
+template class GPU_data_processing<double>;
@@ -3,193 +3,378 @@
 #include <iostream>
 #include <limits>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <functional>
+#include <algorithm>
 
 #include <CL/cl.hpp>
 #include "my_utils.h"
+#include "column_view.h"
 #include "statistics.h"
+#include "buffer_pool.h"
+#include "work_group_tuner.h"
+#include "gpu_profiler.h"
 
 #ifdef _MSC_VER
 #pragma comment(lib, "opencl.lib")
 #endif
 
 #define WORK_GROUP_SIZE 256
+#define SUM_MAX_GROUPS 1024 // maximal number of workgroups of the grid-stride sum kernel
+#define SEGMENT_MAX_LENGTH 2048 // longest segment sorted in local memory by segmented_statistics
+#define RADIX_BITS 8 // number of key bits resolved by one radix-select pass
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_MAX_GROUPS 256 // maximal number of workgroups building the radix histogram
 #undef max
 
-#include <limits>
+/**
+ * @brief Host and kernel types of one precision - the kernels are written once for both precisions, the type
+ * definitions of the precision are prepended to the kernel source
+ * @tparam Real - float or double
+ */
+template<typename Real>
+struct gpu_real_traits;
+
+template<>
+struct gpu_real_traits<float> {
+    using key = cl_uint; // unsigned integer of the same width as the real
+    static constexpr size_t vector_width = 8; // elements loaded by one work-item of vector_sums
+    static constexpr auto name = "float";
+    static constexpr auto kernel_types = R"(
+        typedef float real;
+        typedef uint real_key; // unsigned integer of the same width as real
+        #define KEY_SIGN_BIT 0x80000000u
+        #define REAL_LESS(a, b) ((a) < (b))
+
+        typedef float real_acc; // accumulator of the sums
+        #define ACC_ADD(a, b) ((a) + (b))
+
+        typedef float8 real_vec; // vector type loaded by one work-item
+        #define VEC_WIDTH 8
+        #define VLOAD vload8
+        inline float vec_sum(float8 v) {
+            float4 a = v.lo + v.hi;
+            float2 b = a.lo + a.hi;
+            return b.x + b.y;
+        }
+    )";
+};
+
+template<>
+struct gpu_real_traits<double> {
+    using key = cl_ulong; // unsigned integer of the same width as the real
+    static constexpr size_t vector_width = 4; // elements loaded by one work-item of vector_sums
+    static constexpr auto name = "double";
+    static constexpr auto kernel_types = R"(
+        #pragma OPENCL EXTENSION cl_khr_fp64 : enable
+        typedef double real;
+        typedef ulong real_key; // unsigned integer of the same width as real
+        #define KEY_SIGN_BIT 0x8000000000000000ul
+        #define REAL_LESS(a, b) ((a) < (b))
+
+        typedef double real_acc; // accumulator of the sums
+        #define ACC_ADD(a, b) ((a) + (b))
+
+        typedef double4 real_vec; // vector type loaded by one work-item
+        #define VEC_WIDTH 4
+        #define VLOAD vload4
+        inline double vec_sum(double4 v) {
+            double2 a = v.lo + v.hi;
+            return a.x + a.y;
+        }
+    )";
+
+    // fallback for devices without cl_khr_fp64 - the doubles are kept as their bit patterns, sorted by the order
+    // preserving integer keys and summed in float-float (double-single) arithmetic with ~48 bits of mantissa
+    static constexpr auto kernel_types_double_single = R"(
+        #pragma OPENCL FP_CONTRACT OFF // the error-free transformations must not be contracted
+        #define DOUBLE_SINGLE
+        typedef ulong real; // bit pattern of the double
+        typedef ulong real_key; // unsigned integer of the same width as real
+        #define KEY_SIGN_BIT 0x8000000000000000ul
+        #define REAL_LESS(a, b) (to_ordered_key(a) < to_ordered_key(b))
+
+        typedef float2 real_acc; // accumulator of the sums - (hi, lo) float-float value
+        #define ACC_ADD(a, b) ds_add(a, b)
+
+        // float-float addition (two-sum of the high parts plus the low parts)
+        inline float2 ds_add(float2 a, float2 b) {
+            float s = a.x + b.x;
+            float v = s - a.x;
+            float e = (a.x - (s - v)) + (b.x - v) + a.y + b.y;
+            float hi = s + e;
+            return (float2) (hi, e - (hi - s));
+        }
+
+        // float-float multiplication (exact product of the high parts by fma)
+        inline float2 ds_mul(float2 a, float2 b) {
+            float p = a.x * b.x;
+            float e = fma(a.x, b.x, -p) + a.x * b.y + a.y * b.x;
+            float hi = p + e;
+            return (float2) (hi, e - (hi - p));
+        }
+
+        // split the bit pattern of a double into the float-float value - 24 + 29 bits of the mantissa
+        // (subnormal doubles are flushed to zero, values out of the float range overflow)
+        inline float2 ds_from_bits(ulong bits) {
+            int exponent = (int) ((bits >> 52) & 0x7ff);
+            if (exponent == 0) {
+                return (float2) (0.0f, 0.0f);
+            }
+            ulong mantissa = (bits & 0xffffffffffffful) | (1ul << 52);
+            float sign = (bits & KEY_SIGN_BIT) ? -1.0f : 1.0f;
+            float hi = ldexp((float) (mantissa >> 29), exponent - 1075 + 29);
+            float lo = ldexp((float) (mantissa & 0x1ffffffful), exponent - 1075);
+            return (float2) (sign * hi, sign * lo);
+        }
+    )";
+};
 
-#ifdef _FLOAT
 constexpr auto kernel_source = R"(
-    __kernel void abs_diff_calc(__global float *arr, float median) {
-        int i = get_global_id(0);
-        arr[i] = fabs(arr[i] - median);
+#if defined(cl_khr_subgroups)
+    #pragma OPENCL EXTENSION cl_khr_subgroups : enable
+    #define HAS_SUBGROUPS
+#elif defined(cl_intel_subgroups)
+    #define HAS_SUBGROUPS
+#endif
+
+    // map the bit pattern of a real to an unsigned key with the same ordering
+    // (negative numbers have all bits flipped, positive numbers only the sign bit)
+    inline real_key to_ordered_key(real_key bits) {
+        return (bits & KEY_SIGN_BIT) ? ~bits : (bits | KEY_SIGN_BIT);
     }
 
-    __kernel void vector_sums(
-        __global const float* input,
-        __global float* partial_sums,
-        __global float* partial_sums_squares,
-        __local float* local_sums,
-        __local float* local_sums_squares) {
+#ifndef DOUBLE_SINGLE // kernels with real arithmetic - computed on the host by the double-single fallback
+    __kernel void abs_diff_calc(__global real *arr, real median, const ulong n) {
+        size_t i = get_global_id(0);
+        if (i < n) { // the global size is rounded up to a multiple of the workgroup size
+            arr[i] = fabs(arr[i] - median);
+        }
+    }
 
-        uint global_id = get_global_id(0);
-        uint local_id = get_local_id(0);
-        uint group_size = get_local_size(0);
-        uint group_id = get_group_id(0);
+    __kernel void median_of_sorted(__global const real *arr, const ulong n, __global real *median) {
+        median[0] = (arr[n / 2] + arr[(n - 1) / 2]) / 2;
+    }
 
-        // initialize local memory
-        float value = (global_id < get_global_size(0)) ? input[global_id] : 0.0;
-        local_sums[local_id] = value;
-        local_sums_squares[local_id] = value * value;
+    __kernel void abs_diff_from_buffer(__global real *arr, __global const real *median) {
+        size_t i = get_global_id(0);
+        arr[i] = fabs(arr[i] - median[0]);
+    }
+#endif
+
+    // reduce the values of the workgroup - result in local_id 0 (the workgroup size is a power of 2)
+    inline void workgroup_sums(real_acc *sum, real_acc *sum2, __local real_acc *local_sums,
+                               __local real_acc *local_sums_squares) {
+        uint local_id = get_local_id(0);
+#if defined(HAS_SUBGROUPS) && !defined(DOUBLE_SINGLE)
+        // reduction within the sub-group without local memory, then over the sub-groups
+        real group_sum = sub_group_reduce_add(*sum);
+        real group_sum2 = sub_group_reduce_add(*sum2);
+        if (get_sub_group_local_id() == 0) {
+            local_sums[get_sub_group_id()] = group_sum;
+            local_sums_squares[get_sub_group_id()] = group_sum2;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (local_id == 0) {
+            for (uint i = 1; i < get_num_sub_groups(); i++) {
+                group_sum += local_sums[i];
+                group_sum2 += local_sums_squares[i];
+            }
+            *sum = group_sum;
+            *sum2 = group_sum2;
+        }
+#else
+        local_sums[local_id] = *sum;
+        local_sums_squares[local_id] = *sum2;
 
         // synchronize to ensure all work-items have written to local memory
         barrier(CLK_LOCAL_MEM_FENCE);
 
         // reduction within the workgroup
-        for (uint stride = group_size / 2; stride > 0; stride /= 2) {
+        for (uint stride = get_local_size(0) / 2; stride > 0; stride /= 2) {
             if (local_id < stride) {
-                local_sums[local_id] += local_sums[local_id + stride];
-                local_sums_squares[local_id] += local_sums_squares[local_id + stride];
+                local_sums[local_id] = ACC_ADD(local_sums[local_id], local_sums[local_id + stride]);
+                local_sums_squares[local_id] = ACC_ADD(local_sums_squares[local_id],
+                                                       local_sums_squares[local_id + stride]);
             }
             barrier(CLK_LOCAL_MEM_FENCE); // ensure updates are visible to all work-items
         }
-
-        // write the results of this workgroup to the partial sums arrays
-        if (local_id == 0) {
-            partial_sums[group_id] = local_sums[0];
-            partial_sums_squares[group_id] = local_sums_squares[0];
-        }
+        *sum = local_sums[0];
+        *sum2 = local_sums_squares[0];
+#endif
     }
 
-    __kernel void merge_sort(__global float *arr, __global float *temp, const unsigned int width, const unsigned int size) {
-        int global_id = get_global_id(0);
-        int start = global_id * width * 2; // starting index for this merge
-        int mid = start + width;          // middle index
-        int end = min(start + 2 * width, size); // end index (clamped to size)
-
-        if (mid >= size) {
-            return; // nothing to merge
+    __kernel void vector_sums(
+        __global const real* input,
+        __global real_acc* partials,
+        __local real_acc* local_sums,
+        __local real_acc* local_sums_squares,
+        const ulong n) {
+
+        size_t global_id = get_global_id(0);
+        size_t global_size = get_global_size(0);
+#ifdef DOUBLE_SINGLE
+        // grid-stride loop in float-float arithmetic
+        real_acc sum = (real_acc) (0.0f, 0.0f), sum2 = (real_acc) (0.0f, 0.0f);
+        for (ulong i = global_id; i < n; i += global_size) {
+            real_acc value = ds_from_bits(input[i]);
+            sum = ds_add(sum, value);
+            sum2 = ds_add(sum2, ds_mul(value, value));
         }
-
-        int left = start;
-        int right = mid;
-        int index = start;
-
-        // merge two halves into the temp array
-        while (left < mid && right < end) {
-            if (arr[left] <= arr[right]) {
-                temp[index++] = arr[left++];
-            } else {
-                temp[index++] = arr[right++];
-            }
+#else
+        const ulong num_vectors = n / VEC_WIDTH;
+
+        // grid-stride loop over whole vectors - two independent accumulators hide the latency of the additions
+        real_vec sum_a = 0, sum_b = 0, sum2_a = 0, sum2_b = 0;
+        ulong i = global_id;
+        for (; i + global_size < num_vectors; i += 2 * global_size) {
+            real_vec a = VLOAD(i, input);
+            real_vec b = VLOAD(i + global_size, input);
+            sum_a += a;
+            sum2_a += a * a;
+            sum_b += b;
+            sum2_b += b * b;
         }
-
-        // copy remaining elements from the left half
-        while (left < mid) {
-            temp[index++] = arr[left++];
+        if (i < num_vectors) {
+            real_vec a = VLOAD(i, input);
+            sum_a += a;
+            sum2_a += a * a;
         }
+        real sum = vec_sum(sum_a + sum_b);
+        real sum2 = vec_sum(sum2_a + sum2_b);
 
-        // copy remaining elements from the right half
-        while (right < end) {
-            temp[index++] = arr[right++];
+        // elements after the last whole vector
+        for (ulong j = num_vectors * VEC_WIDTH + global_id; j < n; j += global_size) {
+            sum += input[j];
+            sum2 += input[j] * input[j];
         }
+#endif
 
-        // copy sorted data back to the original array
-        for (int i = start; i < end; i++) {
-            arr[i] = temp[i];
+        workgroup_sums(&sum, &sum2, local_sums, local_sums_squares);
+
+        // write the results of this workgroup - sums first, then the sums of squares
+        if (get_local_id(0) == 0) {
+            partials[get_group_id(0)] = sum;
+            partials[get_num_groups(0) + get_group_id(0)] = sum2;
         }
     }
 
-    __kernel void bitonic_sort_kernel(__global float *arr, const uint stage, const uint pass_of_stage) {
-        uint thread_id = get_global_id(0);
-        uint pair_distance = 1 << (stage - pass_of_stage); // distance between elements to compare
-        uint block_width = 2 * pair_distance; // width of the block being compared
-        uint temp;
-        bool compare_result;
-        uint left_id = (thread_id & (pair_distance - 1)) + (thread_id >> (stage - pass_of_stage)) * block_width;
-        uint right_id = left_id + pair_distance;
-
-        // get the elements to compare
-        float left_element = arr[left_id];
-        float right_element = arr[right_id];
-
-        uint same_direction_block_width = thread_id >> stage;
-        uint same_direction = same_direction_block_width & 0x1; // check if the block is in the same direction
-
-        // swap the elements if they are not in the same direction
-        temp = same_direction ? right_id : temp;
-        right_id = same_direction ? left_id : right_id;
-        left_id = same_direction ? temp : left_id;
-
-        compare_result = (left_element < right_element);
+    __kernel void reduce_partials(
+        __global const real_acc* partials,
+        const uint count,
+        __global real_acc* sums,
+        __local real_acc* local_sums,
+        __local real_acc* local_sums_squares) {
+
+        // second pass - a single workgroup reduces the partial sums of the workgroups of vector_sums
+        real_acc sum = 0, sum2 = 0;
+        for (uint i = get_local_id(0); i < count; i += get_local_size(0)) {
+            sum = ACC_ADD(sum, partials[i]);
+            sum2 = ACC_ADD(sum2, partials[count + i]);
+        }
 
-        // swap the elements if they are not in the correct order
-        float greater = compare_result ? right_element : left_element;
-        float lesser = compare_result ? left_element : right_element;
+        workgroup_sums(&sum, &sum2, local_sums, local_sums_squares);
 
-        arr[left_id] = lesser;
-        arr[right_id] = greater;
-    }
-)";
-#else
-constexpr auto kernel_source = R"(
-    __kernel void abs_diff_calc(__global double *arr, double median) {
-        int i = get_global_id(0);
-        arr[i] = fabs(arr[i] - median);
+        if (get_local_id(0) == 0) {
+            sums[0] = sum;
+            sums[1] = sum2;
+        }
     }
 
-    __kernel void vector_sums(
-        __global const double* input,
-        __global double* partial_sums,
-        __global double* partial_sums_squares,
-        __local double* local_sums,
-        __local double* local_sums_squares) {
-
-        uint global_id = get_global_id(0);
-        uint local_id = get_local_id(0);
-        uint group_size = get_local_size(0);
-        uint group_id = get_group_id(0);
+#ifndef DOUBLE_SINGLE
+    // bitonic sort of the local array of power of 2 length by the whole workgroup
+    inline void local_bitonic_sort(__local real *values, uint length) {
+        for (uint size = 2; size <= length; size <<= 1) {
+            for (uint distance = size >> 1; distance > 0; distance >>= 1) {
+                for (uint i = get_local_id(0); i < length; i += get_local_size(0)) {
+                    uint partner = i ^ distance;
+                    if (partner > i) {
+                        real a = values[i];
+                        real b = values[partner];
+                        bool ascending = (i & size) == 0;
+                        if ((a > b) == ascending) {
+                            values[i] = b;
+                            values[partner] = a;
+                        }
+                    }
+                }
+                barrier(CLK_LOCAL_MEM_FENCE);
+            }
+        }
+    }
 
-        // initialize local memory
-        double value = (global_id < get_global_size(0)) ? input[global_id] : 0.0;
-        local_sums[local_id] = value;
-        local_sums_squares[local_id] = value * value;
+    // one workgroup per segment - the segment is sorted in local memory (padded to padded_length with
+    // +infinity), the sums, the median and the MAD are computed without leaving the workgroup
+    __kernel void segmented_statistics(
+        __global const real *data,
+        __global const ulong *offsets,
+        __global real_acc *sums,
+        __global real *mads,
+        __local real *values,
+        __local real_acc *local_sums,
+        __local real_acc *local_sums_squares,
+        const uint padded_length) {
+
+        const size_t segment = get_group_id(0);
+        const ulong start = offsets[segment];
+        const uint n = (uint) (offsets[segment + 1] - start);
+        if (n > padded_length) {
+            return; // longer segments are computed by the host - the whole workgroup returns
+        }
 
-        // synchronize to ensure all work-items have written to local memory
+        // load the segment and sum it
+        real_acc sum = 0, sum2 = 0;
+        for (uint i = get_local_id(0); i < padded_length; i += get_local_size(0)) {
+            if (i < n) {
+                real value = data[start + i];
+                values[i] = value;
+                sum += value;
+                sum2 += value * value;
+            } else {
+                values[i] = INFINITY;
+            }
+        }
+        workgroup_sums(&sum, &sum2, local_sums, local_sums_squares);
         barrier(CLK_LOCAL_MEM_FENCE);
 
-        // reduction within the workgroup
-        for (uint stride = group_size / 2; stride > 0; stride /= 2) {
-            if (local_id < stride) {
-                local_sums[local_id] += local_sums[local_id + stride];
-                local_sums_squares[local_id] += local_sums_squares[local_id + stride];
-            }
-            barrier(CLK_LOCAL_MEM_FENCE); // ensure updates are visible to all work-items
+        local_bitonic_sort(values, padded_length);
+        real median = (values[n / 2] + values[(n - 1) / 2]) / 2;
+        barrier(CLK_LOCAL_MEM_FENCE); // all work-items read the median before it is overwritten
+
+        // the padding stays +infinity, so the absolute differences sort to the front
+        for (uint i = get_local_id(0); i < n; i += get_local_size(0)) {
+            values[i] = fabs(values[i] - median);
         }
+        barrier(CLK_LOCAL_MEM_FENCE);
+        local_bitonic_sort(values, padded_length);
 
-        // write the results of this workgroup to the partial sums arrays
-        if (local_id == 0) {
-            partial_sums[group_id] = local_sums[0];
-            partial_sums_squares[group_id] = local_sums_squares[0];
+        if (get_local_id(0) == 0) {
+            sums[2 * segment] = sum;
+            sums[2 * segment + 1] = sum2;
+            mads[segment] = (values[n / 2] + values[(n - 1) / 2]) / 2;
         }
     }
+#endif
 
-    __kernel void merge_sort(__global double *arr, __global double *temp, const unsigned int width, const unsigned int size) {
-        int global_id = get_global_id(0);
-        int start = global_id * width * 2; // starting index for this merge
-        int mid = start + width;          // middle index
-        int end = min(start + 2 * width, size); // end index (clamped to size)
+    __kernel void merge_sort(__global real *arr, __global real *temp, const ulong width, const ulong size) {
+        ulong global_id = get_global_id(0);
+        ulong start = global_id * width * 2; // starting index for this merge
+        ulong mid = start + width;          // middle index
+        ulong end = min(start + 2 * width, size); // end index (clamped to size)
 
         if (mid >= size) {
             return; // nothing to merge
         }
 
-        int left = start;
-        int right = mid;
-        int index = start;
+        ulong left = start;
+        ulong right = mid;
+        ulong index = start;
 
         // merge two halves into the temp array
         while (left < mid && right < end) {
-            if (arr[left] <= arr[right]) {
+            if (!REAL_LESS(arr[right], arr[left])) {
                 temp[index++] = arr[left++];
             } else {
                 temp[index++] = arr[right++];
@@ -207,43 +392,100 @@ constexpr auto kernel_source = R"(
         }
 
         // copy sorted data back to the original array
-        for (int i = start; i < end; i++) {
+        for (ulong i = start; i < end; i++) {
             arr[i] = temp[i];
         }
     }
 
-    __kernel void bitonic_sort_kernel(__global double *arr, const uint stage, const uint pass_of_stage) {
-        uint thread_id = get_global_id(0);
-        uint pair_distance = 1 << (stage - pass_of_stage); // distance between elements to compare
-        uint block_width = 2 * pair_distance; // width of the block being compared
-        uint temp;
-        bool compare_result;
-        uint left_id = (thread_id & (pair_distance - 1)) + (thread_id >> (stage - pass_of_stage)) * block_width;
-        uint right_id = left_id + pair_distance;
+    __kernel void bitonic_sort_kernel(__global real *arr, const ulong n, const uint stage, const uint pass_of_stage) {
+        ulong thread_id = get_global_id(0);
+        ulong pair_distance = 1ul << (stage - pass_of_stage); // distance between elements to compare
+        ulong block_width = 2 * pair_distance; // width of the block being compared
+        ulong offset = thread_id & (pair_distance - 1); // offset of the left element within its half-block
+        ulong left_id = offset + (thread_id >> (stage - pass_of_stage)) * block_width;
+
+        // the first pass of a stage compares the mirrored elements of the block (so all blocks are sorted
+        // in ascending order), the following passes compare the elements pair_distance apart
+        ulong right_id = (pass_of_stage == 0) ? (left_id | (block_width - 1)) - offset : left_id + pair_distance;
+
+        // elements past the end of the array are a virtual +infinity padding - they are never moved
+        if (right_id >= n) {
+            return;
+        }
 
         // get the elements to compare
-        double left_element = arr[left_id];
-        double right_element = arr[right_id];
+        real left_element = arr[left_id];
+        real right_element = arr[right_id];
+
+        // swap the elements if they are not in the correct order
+        if (REAL_LESS(right_element, left_element)) {
+            arr[left_id] = right_element;
+            arr[right_id] = left_element;
+        }
+    }
 
-        uint same_direction_block_width = thread_id >> stage;
-        uint same_direction = same_direction_block_width & 0x1; // check if the block is in the same direction
+    __kernel void radix_histogram(
+        __global const real_key *bits,
+        const ulong n,
+        const uint shift,
+        __global uint *histogram,
+        __local uint *local_histogram) {
 
-        // swap the elements if they are not in the same direction
-        temp = same_direction ? right_id : temp;
-        right_id = same_direction ? left_id : right_id;
-        left_id = same_direction ? temp : left_id;
+        uint local_id = get_local_id(0);
+        uint group_size = get_local_size(0);
 
-        compare_result = (left_element < right_element);
+        // clear the local histogram
+        for (uint i = local_id; i < RADIX_BUCKETS; i += group_size) {
+            local_histogram[i] = 0;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
 
-        // swap the elements if they are not in the correct order
-        double greater = compare_result ? right_element : left_element;
-        double lesser = compare_result ? left_element : right_element;
+        // count the digits of the keys - grid-stride loop
+        for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+            uint digit = (uint) ((to_ordered_key(bits[i]) >> shift) & (RADIX_BUCKETS - 1));
+            atomic_inc(&local_histogram[digit]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // merge the local histogram into the global one
+        for (uint i = local_id; i < RADIX_BUCKETS; i += group_size) {
+            if (local_histogram[i] != 0) {
+                atomic_add(&histogram[i], local_histogram[i]);
+            }
+        }
+    }
 
-        arr[left_id] = lesser;
-        arr[right_id] = greater;
+    __kernel void radix_filter(
+        __global const real_key *bits,
+        const ulong n,
+        const real_key prefix,
+        const real_key prefix_mask,
+        __global real_key *survivors,
+        __global uint *survivors_count) {
+
+        // keep only the keys that share the already selected digits - grid-stride loop
+        for (size_t i = get_global_id(0); i < n; i += get_global_size(0)) {
+            real_key value = bits[i];
+            if ((to_ordered_key(value) & prefix_mask) == prefix) {
+                survivors[atomic_inc(survivors_count)] = value;
+            }
+        }
     }
 )";
-#endif
+
+/**
+ * @brief Strategy used by the GPU to obtain the order statistics (median and MAD)
+ *
+ * @details
+ *  - Bitonic_sort: full bitonic sort of the array
+ *  - Merge_sort: full bottom-up merge sort of the array
+ *  - Radix_select: radix-select of the two middle elements without sorting
+ */
+enum class gpu_strategy {
+    Bitonic_sort,
+    Merge_sort,
+    Radix_select
+};
 
 /**
  * GPU_data_processing class used to compute the coefficient of variance and median absolute deviation.
@@ -251,13 +493,24 @@ constexpr auto kernel_source = R"(
  * appropriate computation can be used (CPU or GPU).
  * Basically, a static polymorphism is used here but without the ancestor class - not much in common
  * between the two classes.
+ * The class is instantiated for float and double in GPU_calc.cpp - the kernels are built for the precision.
+ * @tparam Real - element type (float or double)
  */
+template<typename Real>
 class GPU_data_processing {
 public:
     /**
      * @brief Constructor
+     * @param strategy - strategy used to obtain the median and MAD
      */
-    explicit GPU_data_processing();
+    explicit GPU_data_processing(gpu_strategy strategy = gpu_strategy::Bitonic_sort);
+
+    /**
+     * @brief Constructor
+     * @param device - OpenCL device to run the computations on (GPU or CPU device)
+     * @param strategy - strategy used to obtain the median and MAD
+     */
+    explicit GPU_data_processing(const cl::Device &device, gpu_strategy strategy = gpu_strategy::Bitonic_sort);
 
     /**
      * @brief Try to select the first GPU device available on the system
@@ -265,62 +518,250 @@ public:
      */
     static cl::Device try_select_first_gpu();
 
+    /**
+     * @brief Select the OpenCL device by its index - devices of all platforms and types in enumeration order
+     * @param index - index of the device
+     * @return Device
+     */
+    static cl::Device select_device(size_t index);
+
+    /**
+     * @brief Sort the vector and compute its sum and sum of squares (one sorted run of the hybrid computation)
+     * Columns longer than the largest chunk are sorted in chunks, the radix-select strategy sorts by bitonic sort
+     * @param arr - vector of reals - sorted (output)
+     * @param sum - sum of the vector (output)
+     * @param sum2 - sum of squares of the vector (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int sort_and_sum(std::vector<Real> &arr, Real &sum, Real &sum2);
+
     /**
      * @brief Compute the sum and sum of squares of the vector
      * Premise: the GPU buffer is already set
      * @param sum - sum of the vector
      * @param sum2 - sum of squares of the vector
-     * @param n - size of the vector without padding
+     * @param n - size of the vector
      */
-    void sum_vector(real &sum, real &sum2, size_t n);
+    void sum_vector(Real &sum, Real &sum2, size_t n);
 
     /**
      * @brief Sort the array using merge sort
+     * Premise: the GPU buffer is already set
      * @param arr - vector of reals
-     * @param n - size of the vector without padding
+     * @param n - size of the vector
      */
-    void merge_sort(std::vector<real> &arr, size_t n);
+    void merge_sort(std::vector<Real> &arr, size_t n);
 
     /**
      * @brief Sort the array using bitonic sort
      * Premise: the GPU buffer is already set
      * @param arr - vector of reals
-     * @param n - size of the vector without padding
+     * @param n - size of the vector
+     */
+    void bitonic_sort(std::vector<Real> &arr, size_t n);
+
+    /**
+     * @brief Find the k-th smallest element of the buffer using radix-select
+     * A histogram of the top RADIX_BITS of the order preserving keys is built on the GPU, the bucket
+     * containing rank k is chosen and only the keys of that bucket are refined by the next digit.
+     * Premise: the GPU buffer is already set
+     * @param k - rank of the element (0-based)
+     * @param n - size of the vector
+     * @return k-th smallest element
      */
-    void bitonic_sort(std::vector<real> &arr, size_t n);
+    Real radix_select(size_t k, size_t n);
+
+    /**
+     * @brief Find the median of the buffer using radix-select
+     * Premise: the GPU buffer is already set
+     * @param n - size of the vector
+     * @return median of the buffer
+     */
+    Real radix_median(size_t n);
 
     /**
      * @brief Compute the absolute differences from the median
      * Premise: the GPU buffer is already set
      * @param abs_diff - vector of absolute differences
      * @param median - median value
-     * @param n - size of the vector without padding
+     * @param n - size of the vector
      */
-    void abs_diff_calc(std::vector<real> &abs_diff, real median, size_t n);
+    void abs_diff_calc(std::vector<Real> &abs_diff, Real median, size_t n);
 
     /**
      * @brief Compute the coefficient of variance and median absolute deviation
      * @param vec - vector of reals
      * @param cv - coefficient of variance (output)
      * @param mad - median absolute deviation (output)
-     * @param is_vectorized - flag to indicate if vectorization is enabled
-     * @param policy - execution policy - parallel or sequential
+     * @param is_vectorized - flag to indicate if vectorization is enabled (host MAD of chunked columns)
+     * @param policy - execution policy - parallel or sequential (host MAD of chunked columns)
      * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
      */
-    int compute_CV_MAD(std::vector<real> &vec, real &cv, real &mad, bool is_vectorized,
+    int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, bool is_vectorized,
                        const execution_policy &policy);
 
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of several columns at once
+     * The columns are pipelined over three command queues - the upload of a column overlaps the computation
+     * of the previous one and its readback overlaps the computation of the next one.
+     * @param columns - vectors of reals (not modified)
+     * @param cv - coefficients of variance, one per column (output)
+     * @param mad - median absolute deviations, one per column (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int compute_CV_MAD_batch(const std::vector<column_view<Real>> &columns,
+                             std::vector<Real> &cv, std::vector<Real> &mad);
+
     /**
      * @brief Set the buffer for the GPU
-     * Pads the array to the nearest power of 2 and sets the buffer for the GPU
-     * @param arr - vector of reals
+     * Copies the array to a GPU buffer borrowed from the buffer pool - the elements themselves are not modified
+     * @param arr - view of the reals
+     */
+    void set_buffer(column_view<Real> arr);
+
+    /**
+     * @brief Return the GPU buffer set by set_buffer to the buffer pool
      */
-    void set_buffer(std::vector<real> &arr);
+    void release_buffer();
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of many short segments
+     * Segments of up to SEGMENT_MAX_LENGTH elements are processed by one launch - one workgroup per segment sorts
+     * it in local memory, longer segments are computed one by one
+     * @param data - flat buffer of all segments (not modified)
+     * @param offsets - start of each segment followed by the end of the last one
+     * @param cv - coefficient of variance of each segment (output)
+     * @param mad - median absolute deviation of each segment (output)
+     * @param policy - execution policy of the host fallback (double-single devices, long segments)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                 std::vector<Real> &cv, std::vector<Real> &mad, const execution_policy &policy);
+
+    /**
+     * @brief Set the largest number of elements sorted on the device at once
+     * Longer columns are sorted chunk by chunk (default is derived from the device memory)
+     * @param chunk_size - number of elements of one chunk
+     */
+    void set_max_chunk_size(size_t chunk_size);
+
+    /**
+     * @brief Device time of the commands enqueued since the last call, by the stage of the computation
+     * @return device time of the stages in seconds
+     */
+    gpu_profile take_profile();
 
 private:
+    using real_key = typename gpu_real_traits<Real>::key;
+
+    /**
+     * @brief Number of workgroups of the vector_sums kernel - number of partial sums
+     * Every work-item sums at least two vectors of kernel_vector_width elements, the grid is capped by SUM_MAX_GROUPS
+     * @param n - size of the vector
+     * @return number of workgroups
+     */
+    [[nodiscard]] size_t num_sum_workgroups(size_t n) const;
+
+    /**
+     * @brief Choose the workgroup sizes of vector_sums, bitonic_sort_kernel and abs_diff_calc
+     * The sizes are timed on a calibration buffer by the work_group_tuner and cached per device in a file
+     */
+    void tune_work_group_sizes();
+
+    /**
+     * @brief Sort a column too large for the device memory
+     * The column is split into chunks sorted on the device - the next chunk is uploaded while the current one
+     * is sorted and the sorted runs are read back in place and k-way merged on the host.
+     * @param arr - vector of reals - sorted (output)
+     * @param sum - sum of the vector (output)
+     * @param sum2 - sum of squares of the vector (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int chunked_sort(std::vector<Real> &arr, Real &sum, Real &sum2);
+
+    /**
+     * @brief Enqueue the computation of the sum and the sum of squares
+     * The partial sums of the workgroups are reduced by a second single-workgroup pass on the device
+     * @param command_queue - in-order queue to enqueue the kernels to
+     * @param buffer - buffer with the array
+     * @param n - size of the vector
+     * @param sums - buffer for the sum and the sum of squares (2 elements)
+     * @param wait_events - events to wait for before the first kernel starts
+     */
+    void enqueue_vector_sums(const cl::CommandQueue &command_queue, const cl::Buffer &buffer, size_t n,
+                             const cl::Buffer &sums, const std::vector<cl::Event> *wait_events = nullptr);
+
+    /**
+     * @brief Enqueue all passes of the bitonic sort
+     * @param command_queue - in-order queue to enqueue the passes to
+     * @param buffer - buffer with the array
+     * @param n - size of the vector
+     * @param wait_events - events to wait for before the first pass starts
+     */
+    void enqueue_bitonic_sort(const cl::CommandQueue &command_queue, const cl::Buffer &buffer, size_t n,
+                              const std::vector<cl::Event> *wait_events = nullptr);
+
+    /**
+     * @brief Enqueue all passes of the merge sort
+     * @param command_queue - in-order queue to enqueue the passes to
+     * @param buffer - buffer with the array
+     * @param temp - temporary buffer of the same size
+     * @param n - size of the vector
+     * @param wait_events - events to wait for before the first pass starts
+     */
+    void enqueue_merge_sort(const cl::CommandQueue &command_queue, const cl::Buffer &buffer, const cl::Buffer &temp,
+                            size_t n, const std::vector<cl::Event> *wait_events = nullptr);
+
+    /**
+     * @brief Compute the absolute differences from the median in place in the GPU buffer
+     * @param buffer - buffer with the array
+     * @param median - median value
+     * @param n - size of the vector
+     */
+    void enqueue_abs_diff(const cl::Buffer &buffer, Real median, size_t n);
+
+    /**
+     * @brief Convert the sum and sum of squares read back from the device
+     * The double-single fallback stores them as two (hi, lo) float pairs in the same 2 * sizeof(Real) bytes
+     * @param sums - 2 reals read back from the device
+     * @param sum - sum of the vector (output)
+     * @param sum2 - sum of squares of the vector (output)
+     */
+    void decode_sums(const Real *sums, Real &sum, Real &sum2) const;
+
+    /**
+     * @brief Map the order preserving key back to the real value (inverse of the kernel's to_ordered_key)
+     * @param key - order preserving key
+     * @return real value
+     */
+    static Real from_ordered_key(real_key key);
+
+    cl::Device device;
     cl::Context context;
-    cl::CommandQueue queue;
+    cl::CommandQueue queue; // computations (and transfers outside of the batch pipeline)
+    cl::CommandQueue upload_queue; // batch pipeline uploads
+    cl::CommandQueue download_queue; // batch pipeline readbacks
     cl::Program program;
-    cl::Buffer padded_buffer_arr;
-    size_t padded_size;
+    std::shared_ptr<buffer_pool> pool; // shared by the copies of the object
+    std::shared_ptr<gpu_profiler> profiler; // shared by the copies of the object
+    pooled_buffer buffer_arr;
+    pooled_buffer buffer_partials; // partial sums of vector_sums - used only by the in-order compute queue
+    size_t buffer_size;
+    size_t max_chunk_size; // largest number of elements sorted on the device at once
+    size_t sum_work_group_size = WORK_GROUP_SIZE; // tuned workgroup sizes
+    size_t bitonic_work_group_size = WORK_GROUP_SIZE;
+    size_t abs_diff_work_group_size = WORK_GROUP_SIZE;
+    size_t radix_work_group_size = WORK_GROUP_SIZE; // clamped to the limits of the radix-select kernels
+    cl::Kernel kernel_abs_diff;
+    cl::Kernel kernel_vector_sums;
+    cl::Kernel kernel_reduce_partials;
+    cl::Kernel kernel_merge_sort;
+    cl::Kernel kernel_bitonic_sort;
+    cl::Kernel kernel_radix_histogram;
+    cl::Kernel kernel_radix_filter;
+    cl::Kernel kernel_median_of_sorted;
+    cl::Kernel kernel_abs_diff_from_buffer;
+    cl::Kernel kernel_segmented_statistics;
+    gpu_strategy strategy;
+    bool double_single = false; // double build on a device without fp64 - float-float sums, integer key sort
 };
@@ -0,0 +1,132 @@
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#define MIN_SIZE_CLASS 4096 // smallest buffer allocated by the pool in bytes
+#define STAGING_CHUNK_SIZE (16u << 20) // largest transfer through one staging buffer in bytes
+#define MAX_STAGING_BYTES (8 * STAGING_CHUNK_SIZE) // budget of the borrowed and free staging buffers in bytes
+
+buffer_pool::buffer_pool(const cl::Context &context, const cl::CommandQueue &queue, size_t max_bytes)
+        : context(context), queue(queue), allocations(0) {
+    free_buffers.max_bytes = max_bytes;
+    free_staging.max_bytes = MAX_STAGING_BYTES;
+}
+
+size_t buffer_pool::size_class(size_t size) {
+    if (size <= MIN_SIZE_CLASS) {
+        return MIN_SIZE_CLASS;
+    }
+    // highest power of 2 not greater than size
+    size_t power = MIN_SIZE_CLASS;
+    while (power <= size / 2) {
+        power <<= 1;
+    }
+    // round up to the quarter of the power of 2
+    size_t step = power / 4;
+    return (size + step - 1) / step * step;
+}
+
+size_t buffer_pool::largest_class(size_t limit) {
+    if (limit <= MIN_SIZE_CLASS) {
+        return MIN_SIZE_CLASS;
+    }
+    // the classes between the highest power of 2 not greater than the limit and the next one are its quarters
+    size_t power = MIN_SIZE_CLASS;
+    while (power <= limit / 2) {
+        power <<= 1;
+    }
+    size_t step = power / 4;
+    return limit / step * step;
+}
+
+pooled_buffer buffer_pool::take(free_list &list, size_t size, cl_mem_flags flags) {
+    size_t cls = size_class(size);
+    list.borrowed += cls;
+    auto it = list.buffers.find(cls);
+    if (it != list.buffers.end()) { // reuse a released buffer
+        pooled_buffer buffer{it->second.back(), cls};
+        it->second.pop_back();
+        if (it->second.empty()) {
+            list.buffers.erase(it);
+        }
+        list.cached -= cls;
+        return buffer;
+    }
+    // free the smallest classes first - they are the cheapest to allocate again
+    while (!list.buffers.empty() && list.borrowed + list.cached > list.max_bytes) {
+        auto smallest = list.buffers.begin();
+        smallest->second.pop_back();
+        list.cached -= smallest->first;
+        if (smallest->second.empty()) {
+            list.buffers.erase(smallest);
+        }
+    }
+    ++allocations;
+    return pooled_buffer{cl::Buffer(context, flags, cls), cls};
+}
+
+void buffer_pool::give_back(free_list &list, const pooled_buffer &buffer) {
+    list.buffers[buffer.size_class].push_back(buffer.buffer);
+    list.borrowed -= buffer.size_class;
+    list.cached += buffer.size_class;
+}
+
+pooled_buffer buffer_pool::acquire(size_t size) {
+    return take(free_buffers, size, CL_MEM_READ_WRITE);
+}
+
+void buffer_pool::release(const pooled_buffer &buffer) {
+    give_back(free_buffers, buffer);
+}
+
+pooled_buffer buffer_pool::acquire_staging(size_t size) {
+    return take(free_staging, std::min<size_t>(size, STAGING_CHUNK_SIZE),
+                CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
+}
+
+void buffer_pool::release_staging(const pooled_buffer &buffer) {
+    give_back(free_staging, buffer);
+}
+
+void buffer_pool::upload(const cl::Buffer &dst, const void *src, size_t size, cl::Event *event) {
+    pooled_buffer staging = acquire_staging(size);
+    upload(queue, staging, dst, src, size, event);
+    // the queue is in-order - the next map of the staging buffer waits for the copy
+    release_staging(staging);
+}
+
+void buffer_pool::upload(const cl::CommandQueue &transfer_queue, const pooled_buffer &staging,
+                         const cl::Buffer &dst, const void *src, size_t size, cl::Event *event) {
+    // fill the pinned staging buffer and copy it to the device buffer chunk by chunk - the queue is in-order, so
+    // the map of the next chunk waits for the copy of the previous one
+    for (size_t offset = 0; offset < size; offset += STAGING_CHUNK_SIZE) {
+        const size_t bytes = std::min<size_t>(size - offset, STAGING_CHUNK_SIZE);
+        void *mapped = transfer_queue.enqueueMapBuffer(staging.buffer, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0,
+                                                       bytes);
+        std::memcpy(mapped, static_cast<const char *>(src) + offset, bytes);
+        transfer_queue.enqueueUnmapMemObject(staging.buffer, mapped);
+        transfer_queue.enqueueCopyBuffer(staging.buffer, dst, 0, offset, bytes, nullptr,
+                                         offset + bytes == size ? event : nullptr);
+    }
+}
+
+void buffer_pool::download(const cl::Buffer &src, void *dst, size_t size, cl::Event *event) {
+    pooled_buffer staging = acquire_staging(size);
+
+    // copy the device buffer to the pinned staging buffer and read it on the host chunk by chunk
+    for (size_t offset = 0; offset < size; offset += STAGING_CHUNK_SIZE) {
+        const size_t bytes = std::min<size_t>(size - offset, STAGING_CHUNK_SIZE);
+        queue.enqueueCopyBuffer(src, staging.buffer, offset, 0, bytes, nullptr,
+                                offset + bytes == size ? event : nullptr);
+        void *mapped = queue.enqueueMapBuffer(staging.buffer, CL_TRUE, CL_MAP_READ, 0, bytes);
+        std::memcpy(static_cast<char *>(dst) + offset, mapped, bytes);
+        queue.enqueueUnmapMemObject(staging.buffer, mapped);
+    }
+
+    release_staging(staging);
+}
+
+size_t buffer_pool::take_allocations() {
+    return std::exchange(allocations, 0);
+}
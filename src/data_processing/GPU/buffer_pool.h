@@ -0,0 +1,147 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstring>
+
+#include <CL/cl.hpp>
+
+/**
+ * @brief Device buffer borrowed from the buffer pool
+ */
+struct pooled_buffer {
+    cl::Buffer buffer;
+    size_t size_class = 0; // capacity of the buffer in bytes
+};
+
+/**
+ * Buffer pool of one OpenCL device - released buffers are kept and reused by the next request of the
+ * same size class, so repeated computations on columns of the same size do not allocate device memory.
+ * The borrowed and kept buffers are limited by a byte budget - a new allocation which would exceed it frees the
+ * smallest kept size classes first, so the classes left behind by growing columns (e.g. the prefixes of the
+ * incremental mode) do not pile up.
+ * Host <-> device transfers go through pinned staging buffers (CL_MEM_ALLOC_HOST_PTR + map/unmap) of at most
+ * one transfer chunk, which are pooled the same way - longer transfers reuse the staging buffer chunk by chunk.
+ */
+class buffer_pool {
+public:
+    /**
+     * @brief Constructor
+     * @param context - context of the device
+     * @param queue - queue used for the transfers through the staging buffers
+     * @param max_bytes - budget of the borrowed and kept device buffers in bytes (e.g. the memory of the device)
+     */
+    buffer_pool(const cl::Context &context, const cl::CommandQueue &queue, size_t max_bytes);
+
+    /**
+     * @brief Borrow a device buffer
+     * @param size - requested size in bytes
+     * @return buffer with capacity of at least size bytes
+     */
+    pooled_buffer acquire(size_t size);
+
+    /**
+     * @brief Return the buffer to the pool
+     * @param buffer - buffer borrowed by acquire
+     */
+    void release(const pooled_buffer &buffer);
+
+    /**
+     * @brief Borrow a pinned host-visible staging buffer for a transfer
+     * @param size - size of the transfer in bytes
+     * @return staging buffer with capacity of the transfer or of one transfer chunk, whichever is smaller
+     */
+    pooled_buffer acquire_staging(size_t size);
+
+    /**
+     * @brief Return the staging buffer to the pool
+     * @param buffer - buffer borrowed by acquire_staging
+     */
+    void release_staging(const pooled_buffer &buffer);
+
+    /**
+     * @brief Copy host memory to the device buffer through a pinned staging buffer (chunk by chunk)
+     * @param dst - device buffer
+     * @param src - host memory
+     * @param size - number of bytes to copy
+     * @param event - event of the copy to the device buffer (output, optional)
+     */
+    void upload(const cl::Buffer &dst, const void *src, size_t size, cl::Event *event = nullptr);
+
+    /**
+     * @brief Copy host memory to the device buffer through a borrowed staging buffer on the queue - the staging
+     * buffer may be released only after the copy (e.g. when the queue is finished)
+     * @param transfer_queue - in-order queue of the copies
+     * @param staging - staging buffer borrowed by acquire_staging for the size
+     * @param dst - device buffer
+     * @param src - host memory
+     * @param size - number of bytes to copy
+     * @param event - event of the copy of the last chunk to the device buffer (output, optional)
+     */
+    static void upload(const cl::CommandQueue &transfer_queue, const pooled_buffer &staging, const cl::Buffer &dst,
+                       const void *src, size_t size, cl::Event *event = nullptr);
+
+    /**
+     * @brief Copy the device buffer to host memory through a pinned staging buffer (chunk by chunk)
+     * @param src - device buffer
+     * @param dst - host memory
+     * @param size - number of bytes to copy
+     * @param event - event of the copy of the last chunk from the device buffer (output, optional)
+     */
+    void download(const cl::Buffer &src, void *dst, size_t size, cl::Event *event = nullptr);
+
+    /**
+     * @brief Take the number of device and staging buffers allocated since the last call - zero for a warm
+     * repetition of a computation
+     * @return number of allocations
+     */
+    size_t take_allocations();
+
+    /**
+     * @brief Round the size up to its size class - four classes per power of two, so at most 25 % is wasted
+     * @param size - size in bytes
+     * @return size class in bytes
+     */
+    static size_t size_class(size_t size);
+
+    /**
+     * @brief Largest size class not greater than the limit - requests of at most this size are allocated within it
+     * @param limit - limit in bytes (e.g. the largest allocation of the device)
+     * @return size class in bytes
+     */
+    static size_t largest_class(size_t limit);
+
+private:
+    /**
+     * @brief Free buffers of one kind with the budget of the borrowed and free buffers
+     */
+    struct free_list {
+        std::map<size_t, std::vector<cl::Buffer>> buffers; // free buffers by size class
+        size_t max_bytes = 0; // budget of the borrowed and free buffers in bytes
+        size_t borrowed = 0; // bytes of the borrowed buffers
+        size_t cached = 0; // bytes of the free buffers
+    };
+
+    /**
+     * @brief Take a buffer of the size class from the free list or allocate a new one - the smallest free buffers
+     * are freed first while the new one does not fit the budget
+     * @param list - free buffers
+     * @param size - requested size in bytes
+     * @param flags - memory flags of a newly allocated buffer
+     * @return buffer with capacity of at least size bytes
+     */
+    pooled_buffer take(free_list &list, size_t size, cl_mem_flags flags);
+
+    /**
+     * @brief Put the returned buffer to the free list
+     * @param list - free buffers
+     * @param buffer - returned buffer
+     */
+    static void give_back(free_list &list, const pooled_buffer &buffer);
+
+    cl::Context context;
+    cl::CommandQueue queue;
+    free_list free_buffers;
+    free_list free_staging;
+    size_t allocations;
+};
@@ -0,0 +1,39 @@
+#include "gpu_profiler.h"
+
+cl::Event *gpu_profiler::next(profile_stage stage) {
+    events.emplace_back(stage, cl::Event());
+    return &events.back().second;
+}
+
+gpu_profile gpu_profiler::take() {
+    gpu_profile profile;
+    for (auto &[stage, event]: events) {
+        event.wait();
+        auto start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        auto end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+        double seconds = static_cast<double>(end - start) * 1e-9; // nanoseconds
+        switch (stage) {
+            case profile_stage::Upload:
+                profile.upload += seconds;
+                break;
+            case profile_stage::Sort:
+                profile.sort += seconds;
+                break;
+            case profile_stage::Reduce:
+                profile.reduce += seconds;
+                break;
+            case profile_stage::Abs_diff:
+                profile.abs_diff += seconds;
+                break;
+            case profile_stage::Readback:
+                profile.readback += seconds;
+                break;
+        }
+    }
+    events.clear();
+    return profile;
+}
+
+void gpu_profiler::clear() {
+    events.clear();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include <CL/cl.hpp>
+
+/**
+ * @brief Stage of the GPU computation the device time is attributed to
+ */
+enum class profile_stage {
+    Upload,
+    Sort,
+    Reduce,
+    Abs_diff,
+    Readback
+};
+
+/**
+ * @brief Device time of the stages in seconds (CL_PROFILING_COMMAND_START to CL_PROFILING_COMMAND_END)
+ * Commands of the overlapped queues are added up - the stages may sum to more than the wall-clock time
+ */
+struct gpu_profile {
+    double upload = 0;
+    double sort = 0;
+    double reduce = 0;
+    double abs_diff = 0;
+    double readback = 0;
+    size_t allocations = 0; // buffers allocated by the buffer pool (zero for a warm repetition)
+};
+
+/**
+ * Collects the events of the commands enqueued to profiling enabled queues and adds up their device time
+ * by the stage of the computation.
+ */
+class gpu_profiler {
+public:
+    /**
+     * @brief Event of the next enqueued command - pass it as the event output of the enqueue call
+     * @param stage - stage the command belongs to
+     * @return event to be filled by the enqueue call
+     */
+    cl::Event *next(profile_stage stage);
+
+    /**
+     * @brief Wait for the recorded commands and return their device time - the recorded events are cleared
+     * @return device time of the stages
+     */
+    gpu_profile take();
+
+    /**
+     * @brief Drop the recorded events (calibration runs)
+     */
+    void clear();
+
+private:
+    std::vector<std::pair<profile_stage, cl::Event>> events;
+};
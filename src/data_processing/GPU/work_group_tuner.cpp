@@ -0,0 +1,97 @@
+#include "work_group_tuner.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+#define TUNING_REPETITIONS 3 // timed runs of every candidate (after one warm-up run)
+
+work_group_tuner::work_group_tuner(const cl::Device &device, const cl::CommandQueue &queue, std::string cache_path)
+        : device(device), queue(queue), cache_path(std::move(cache_path)) {
+    device_key = device.getInfo<CL_DEVICE_NAME>() + " " + device.getInfo<CL_DRIVER_VERSION>();
+    // the key must not break the format of the cache file
+    std::replace(device_key.begin(), device_key.end(), '\t', ' ');
+    std::replace(device_key.begin(), device_key.end(), '\n', ' ');
+    load();
+}
+
+std::vector<size_t> work_group_tuner::candidates(const cl::Kernel &kernel) const {
+    size_t limit = std::min(device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>(),
+                            kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+    size_t multiple = kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+
+    // the reductions need power of 2 sizes - start at the preferred multiple rounded up to a power of 2
+    size_t first = 1;
+    while (first < multiple && first * 2 <= limit) {
+        first <<= 1;
+    }
+    std::vector<size_t> sizes;
+    for (size_t size = first; size <= limit; size <<= 1) {
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+size_t work_group_tuner::tune(const std::string &kernel_name, const cl::Kernel &kernel,
+                              const std::function<void(size_t)> &run) {
+    auto cached = cache.find({device_key, kernel_name});
+    if (cached != cache.end()) {
+        return cached->second;
+    }
+
+    size_t best_size = 0;
+    double best_time = std::numeric_limits<double>::max();
+    for (size_t size: candidates(kernel)) {
+        // warm-up run - the first enqueue of a kernel may include lazy compilation
+        run(size);
+        queue.finish();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < TUNING_REPETITIONS; ++i) {
+            run(size);
+        }
+        queue.finish();
+        std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+
+        if (duration.count() < best_time) {
+            best_time = duration.count();
+            best_size = size;
+        }
+    }
+
+    std::cout << "Tuned work-group size of " << kernel_name << ": " << best_size << std::endl;
+    cache[{device_key, kernel_name}] = best_size;
+    save();
+    return best_size;
+}
+
+void work_group_tuner::load() {
+    std::ifstream file(cache_path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string device_name, kernel_name, size;
+        if (std::getline(fields, device_name, '\t') && std::getline(fields, kernel_name, '\t') &&
+            std::getline(fields, size)) {
+            try {
+                cache[{device_name, kernel_name}] = std::stoull(size);
+            } catch (const std::exception &) {
+                // skip malformed lines - the kernel is tuned again
+            }
+        }
+    }
+}
+
+void work_group_tuner::save() const {
+    std::ofstream file(cache_path);
+    if (!file) {
+        std::cerr << "Failed to write the work-group size cache " << cache_path << std::endl;
+        return;
+    }
+    for (const auto &[key, size]: cache) {
+        file << key.first << '\t' << key.second << '\t' << size << '\n';
+    }
+}
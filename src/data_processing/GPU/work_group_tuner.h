@@ -0,0 +1,57 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <CL/cl.hpp>
+
+/**
+ * Work-group size auto-tuner of one OpenCL device - candidate local sizes (powers of 2 from the preferred
+ * work-group size multiple up to the kernel limit) are timed on a calibration run and the fastest one is kept.
+ * The results are persisted per device and kernel in a small text cache file, so the tuning runs only once.
+ */
+class work_group_tuner {
+public:
+    /**
+     * @brief Constructor - loads the cache file if it exists
+     * @param device - tuned device
+     * @param queue - queue the calibration runs are enqueued to
+     * @param cache_path - path of the cache file
+     */
+    work_group_tuner(const cl::Device &device, const cl::CommandQueue &queue, std::string cache_path);
+
+    /**
+     * @brief Get the best local size of the kernel - from the cache or by timing the candidates
+     * @param kernel_name - name of the kernel (cache key)
+     * @param kernel - kernel to query the limits of
+     * @param run - enqueues the calibration run with the given local size
+     * @return best local size
+     */
+    size_t tune(const std::string &kernel_name, const cl::Kernel &kernel, const std::function<void(size_t)> &run);
+
+private:
+    /**
+     * @brief Candidate local sizes of the kernel on the device
+     * @param kernel - kernel to query the limits of
+     * @return powers of 2 allowed by the device and the kernel
+     */
+    [[nodiscard]] std::vector<size_t> candidates(const cl::Kernel &kernel) const;
+
+    /**
+     * @brief Load the cache file - lines "device<TAB>kernel<TAB>local size"
+     */
+    void load();
+
+    /**
+     * @brief Write the cache file
+     */
+    void save() const;
+
+    cl::Device device;
+    cl::CommandQueue queue;
+    std::string cache_path;
+    std::string device_key; // device name and driver version
+    std::map<std::pair<std::string, std::string>, size_t> cache; // (device, kernel) -> local size
+};
@@ -0,0 +1,514 @@
+#include "engine.h"
+
+#include <atomic>
+#include <stdexcept>
+
+#include "statistics.h"
+#include "counting.h"
+#include "external_sort.h"
+#include "hybrid_calc.h"
+
+#define EXTERNAL_DEFAULT_MEMORY (1ull << 30) // memory budget of cpu_external without --max_memory, bytes
+
+template<typename Real>
+int engine<Real>::compute_CV_MAD_batch(const std::vector<column_view<Real>> &columns,
+                                       std::vector<Real> &cv, std::vector<Real> &mad) {
+    cv.assign(columns.size(), 0);
+    mad.assign(columns.size(), 0);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        // the engines sort in place - every column is copied into the workspace
+        if (compute_CV_MAD(load_workspace(columns[i]), cv[i], mad[i]) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+template<typename Real>
+int engine<Real>::compute_CV_MAD_compressed(compressed_view column, Real &cv, Real &mad) {
+    std::vector<Real> &copy = workspace();
+    const bool parallel = capabilities() & engine_capability::Parallel;
+    widen_column(column, copy, execution_policy(parallel ? execution_policy::e_type::Parallel
+                                                         : execution_policy::e_type::Sequential));
+    return compute_CV_MAD(copy, cv, mad);
+}
+
+template<typename Real>
+std::vector<Real> &engine<Real>::workspace() {
+    static std::vector<Real> shared;
+    return shared;
+}
+
+template<typename Real>
+bool engine_registry<Real>::add(const std::string &key, const std::string &description, factory create) {
+    entries()[key] = {description, std::move(create)};
+    return true;
+}
+
+template<typename Real>
+std::unique_ptr<engine<Real>> engine_registry<Real>::create(const std::string &key, const engine_options &options) {
+    auto it = entries().find(key);
+    if (it == entries().end()) {
+        std::string keys;
+        for (const auto &pair: entries()) {
+            keys += (keys.empty() ? "" : ", ") + pair.first;
+        }
+        throw std::runtime_error("Unknown engine " + key + " - must be one of " + keys);
+    }
+    return it->second.create(options);
+}
+
+template<typename Real>
+std::map<std::string, std::string> engine_registry<Real>::list() {
+    std::map<std::string, std::string> result;
+    for (const auto &pair: entries()) {
+        result[pair.first] = pair.second.description;
+    }
+    return result;
+}
+
+template<typename Real>
+std::map<std::string, typename engine_registry<Real>::entry> &engine_registry<Real>::entries() {
+    // constructed on first use - the registrars run during static initialization
+    static std::map<std::string, entry> registered;
+    return registered;
+}
+
+template class engine<float>;
+
+template class engine<double>;
+
+template class engine_registry<float>;
+
+template class engine_registry<double>;
+
+namespace {
+
+    std::string host_type(execution_policy::e_type type, bool vectorized) {
+        return std::string(type == execution_policy::e_type::Parallel ? "parallel" : "sequential") + "_" +
+               (vectorized ? "vectorized" : "no_vectorized");
+    }
+
+    /**
+     * cpu_engine class - merge sort on the CPU with the policy and vectorization fixed at compile time
+     * @tparam Acc - accumulator of the sums (double for float storage with double accumulation)
+     */
+    template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+    class cpu_engine : public engine<Real> {
+    public:
+        [[nodiscard]] std::string name() const override {
+            return "CPU_" + host_type(Type, Vectorized) + (std::is_same_v<Real, Acc> ? "" : "_mixed");
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return (Type == execution_policy::e_type::Parallel ? engine_capability::Parallel : 0u) |
+                   (Vectorized ? engine_capability::Vectorized : 0u);
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            return CPU_data_processing::compute_CV_MAD_static<Real, Type, Vectorized, Acc>(vec, cv, mad);
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            return CPU_data_processing::compute_CV_MAD_segmented<Real, Acc>(data, offsets, cv, mad, policy);
+        }
+
+    private:
+        execution_policy policy{Type};
+    };
+
+    /**
+     * in_place_engine class - in-place quicksort on the CPU, the memory beyond the workspace is O(log n) instead of
+     * the halves of the merge sort
+     * @tparam Acc - accumulator of the sums
+     */
+    template<typename Real, execution_policy::e_type Type, bool Vectorized, typename Acc>
+    class in_place_engine : public engine<Real> {
+    public:
+        [[nodiscard]] std::string name() const override {
+            return "CPU_in_place_" + host_type(Type, Vectorized) + (std::is_same_v<Real, Acc> ? "" : "_mixed");
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return (Type == execution_policy::e_type::Parallel ? engine_capability::Parallel : 0u) |
+                   (Vectorized ? engine_capability::Vectorized : 0u) | engine_capability::In_place;
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            return CPU_data_processing::compute_CV_MAD_in_place_static<Real, Type, Vectorized, Acc>(vec, cv, mad);
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            return CPU_data_processing::compute_CV_MAD_segmented<Real, Acc>(data, offsets, cv, mad, policy);
+        }
+
+    private:
+        execution_policy policy{Type};
+    };
+
+    /**
+     * counting_engine class - quantized sensor data stored as 16-bit counts, the median and MAD found in a histogram
+     * instead of sorting. The columns are read through the view and quantized once - the counts are kept for the
+     * repetitions and the growing partitions of the column until release_columns. Columns not quantized by the scale
+     * are merge sorted.
+     * @tparam Acc - accumulator of the sums of the merge sort and of the reproducible and exact reductions
+     */
+    template<typename Real, execution_policy::e_type Type, typename Acc>
+    class counting_engine : public engine<Real> {
+    public:
+        explicit counting_engine(const engine_options &options) : scale(options.sensor_scale) {}
+
+        [[nodiscard]] std::string name() const override {
+            return std::string("CPU_counting_") + (Type == execution_policy::e_type::Parallel ? "parallel"
+                                                                                             : "sequential") +
+                   (std::is_same_v<Real, Acc> ? "" : "_mixed");
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return (Type == execution_policy::e_type::Parallel ? engine_capability::Parallel : 0u) |
+                   engine_capability::Streaming;
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            // the vector is a temporary copy - its counts are not kept
+            quantized_column column;
+            std::optional<double> column_scale = scale ? scale : detect_sensor_scale(vec.data(), vec.size());
+            if (column_scale && count(vec.data(), vec.size(), *column_scale, column, cv, mad)) {
+                return EXIT_SUCCESS;
+            }
+            std::cout << "Column is not quantized - merge sorted" << std::endl;
+            return CPU_data_processing::compute_CV_MAD_static<Real, Type, false, Acc>(vec, cv, mad);
+        }
+
+        int compute_CV_MAD_view(column_view<Real> column, Real &cv, Real &mad) override {
+            // the prefixes of a column start at the same element - they share its counts
+            counted_column &counted = counted_columns[column.data()];
+            if (!counted.scale) {
+                counted.scale = scale ? scale : detect_sensor_scale(column.data(), column.size());
+            }
+            if (counted.scale && !counted.failed) {
+                if (count(column.data(), column.size(), *counted.scale, counted.counts, cv, mad)) {
+                    return EXIT_SUCCESS;
+                }
+                counted.failed = true; // the longer prefixes are not quantized either
+                counted.counts = {};
+            }
+            std::cout << "Column is not quantized - merge sorted" << std::endl;
+            return CPU_data_processing::compute_CV_MAD_static<Real, Type, false, Acc>(this->load_workspace(column),
+                                                                                      cv, mad);
+        }
+
+        void release_columns() override {
+            counted_columns.clear();
+        }
+
+        int compute_CV_MAD_compressed(compressed_view column, Real &cv, Real &mad) override {
+            auto [count_time, count_ret] = measure_time([&]() {
+                return compute_CV_MAD_keys<Real, Type, Acc>(column, cv, mad);
+            });
+            if (count_ret == EXIT_SUCCESS) {
+                std::cout << "Counted " << storage_format_name(column.format()) << " keys in " << count_time
+                          << " seconds" << std::endl;
+            }
+            return count_ret;
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            check_segments(offsets, data.size());
+            std::optional<double> data_scale = scale ? scale : detect_sensor_scale(data.data(), data.size());
+            const size_t num_segments = offsets.size() - 1;
+            cv.assign(num_segments, 0);
+            mad.assign(num_segments, 0);
+            // the histogram of a segment has only the bins of its range - segments are counted one per task
+            std::atomic<bool> quantized{data_scale.has_value()};
+            if (quantized) {
+                static_for<Type>(0, num_segments, [&](size_t s) {
+                    if (compute_CV_MAD_counting<Real, execution_policy::e_type::Sequential, Acc>(
+                            data.data() + offsets[s], offsets[s + 1] - offsets[s], *data_scale, cv[s], mad[s]) !=
+                        EXIT_SUCCESS) {
+                        quantized = false;
+                    }
+                });
+            }
+            if (!quantized) {
+                std::cout << "Segments are not quantized - sorted" << std::endl;
+                return CPU_data_processing::compute_CV_MAD_segmented<Real, Acc>(data, offsets, cv, mad, policy);
+            }
+            return EXIT_SUCCESS;
+        }
+
+    private:
+        /**
+         * @brief Counts of the column and the result of its quantization
+         */
+        struct counted_column {
+            std::optional<double> scale; // value of one count, empty if not detected
+            quantized_column counts; // counts of the longest prefix computed so far
+            bool failed = false; // the column is not quantized by the scale
+        };
+
+        /**
+         * @brief Count the elements with the counts of the column
+         * @return true if the data are quantized by the scale
+         */
+        static bool count(const Real *data, size_t n, double column_scale, quantized_column &column, Real &cv,
+                          Real &mad) {
+            auto [count_time, count_ret] = measure_time([&]() {
+                return compute_CV_MAD_counting<Real, Type, Acc>(data, n, column_scale, column, cv, mad);
+            });
+            if (count_ret != EXIT_SUCCESS) {
+                return false;
+            }
+            std::cout << "Counted in " << count_time << " seconds (scale " << column_scale << ")" << std::endl;
+            return true;
+        }
+
+        std::optional<double> scale;
+        std::map<const Real *, counted_column> counted_columns; // counts by the first element of the column
+        execution_policy policy{Type};
+    };
+
+    /**
+     * external_engine class - external merge sort through temporary files with the memory of the sort bounded by
+     * --max_memory, the policy and vectorization of the sort of the runs taken from --parallel and --vectorized
+     * @tparam Acc - accumulator of the sums
+     */
+    template<typename Real, typename Acc>
+    class external_engine : public engine<Real> {
+    public:
+        explicit external_engine(const engine_options &options)
+                : max_memory(options.max_memory.value_or(EXTERNAL_DEFAULT_MEMORY)), policy(options.host_policy),
+                  vectorized(options.host_vectorized) {}
+
+        [[nodiscard]] std::string name() const override {
+            return "CPU_external_" + host_type(policy.get_type(), vectorized) +
+                   (std::is_same_v<Real, Acc> ? "" : "_mixed");
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return (policy.get_type() == execution_policy::e_type::Parallel ? engine_capability::Parallel : 0u) |
+                   (vectorized ? engine_capability::Vectorized : 0u) | engine_capability::Streaming;
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            return compute_CV_MAD_view(vec, cv, mad);
+        }
+
+        int compute_CV_MAD_view(column_view<Real> column, Real &cv, Real &mad) override {
+            return compute_CV_MAD_external<Real, Acc>(column, max_memory, cv, mad, vectorized, policy);
+        }
+
+        int compute_CV_MAD_compressed(compressed_view column, Real &cv, Real &mad) override {
+            // the runs are widened one at a time - the default path would widen the whole column into the workspace
+            return compute_CV_MAD_external<Real, Acc>(column, max_memory, cv, mad, vectorized, policy);
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            // the segments are short - sorted in memory
+            return CPU_data_processing::compute_CV_MAD_segmented<Real, Acc>(data, offsets, cv, mad, policy);
+        }
+
+    private:
+        size_t max_memory;
+        execution_policy policy;
+        bool vectorized;
+    };
+
+    template<typename Real>
+    cl::Device select_device(const std::optional<size_t> &index) {
+        return index ? GPU_data_processing<Real>::select_device(*index)
+                     : GPU_data_processing<Real>::try_select_first_gpu();
+    }
+
+    /**
+     * gpu_engine class - the whole column on one OpenCL device
+     */
+    template<typename Real>
+    class gpu_engine : public engine<Real> {
+    public:
+        explicit gpu_engine(const engine_options &options)
+                : device(select_device<Real>(options.cl_device), options.strategy), strategy(options.strategy),
+                  policy(options.host_policy), vectorized(options.host_vectorized) {
+            if (options.chunk_size) {
+                device.set_max_chunk_size(*options.chunk_size);
+            }
+        }
+
+        [[nodiscard]] std::string name() const override {
+            switch (strategy) {
+                case gpu_strategy::Merge_sort:
+                    return "GPU_merge";
+                case gpu_strategy::Radix_select:
+                    return "GPU_radix";
+                default:
+                    return "GPU";
+            }
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return engine_capability::OpenCL | engine_capability::Batch | engine_capability::Profiling;
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            return device.compute_CV_MAD(vec, cv, mad, vectorized, policy);
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            return device.compute_CV_MAD_segmented(data, offsets, cv, mad, policy);
+        }
+
+        int compute_CV_MAD_batch(const std::vector<column_view<Real>> &columns,
+                                 std::vector<Real> &cv, std::vector<Real> &mad) override {
+            return device.compute_CV_MAD_batch(columns, cv, mad);
+        }
+
+        std::optional<gpu_profile> take_profile() override {
+            return device.take_profile();
+        }
+
+    private:
+        GPU_data_processing<Real> device;
+        gpu_strategy strategy;
+        execution_policy policy;
+        bool vectorized;
+    };
+
+    /**
+     * hybrid_engine class - every column split between the OpenCL device and the CPU or a second OpenCL device
+     */
+    template<typename Real>
+    class hybrid_engine : public engine<Real> {
+    public:
+        explicit hybrid_engine(const engine_options &options)
+                : device(create_device(options)), second_cl_device(options.cl_device2.has_value()),
+                  policy(options.host_policy), vectorized(options.host_vectorized) {
+            if (options.chunk_size) {
+                device.set_max_chunk_size(*options.chunk_size);
+            }
+        }
+
+        [[nodiscard]] std::string name() const override {
+            return second_cl_device ? "Hybrid_OpenCL" : "Hybrid_" + host_type(policy.get_type(), vectorized);
+        }
+
+        [[nodiscard]] unsigned capabilities() const override {
+            return engine_capability::OpenCL |
+                   (policy.get_type() == execution_policy::e_type::Parallel ? engine_capability::Parallel : 0u) |
+                   (vectorized ? engine_capability::Vectorized : 0u);
+        }
+
+        int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) override {
+            return device.compute_CV_MAD(vec, cv, mad, vectorized, policy);
+        }
+
+        int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                     std::vector<Real> &cv, std::vector<Real> &mad) override {
+            return device.compute_CV_MAD_segmented(data, offsets, cv, mad, policy);
+        }
+
+    private:
+        static hybrid_data_processing<Real> create_device(const engine_options &options) {
+            std::optional<cl::Device> second_device;
+            if (options.cl_device2) {
+                second_device = GPU_data_processing<Real>::select_device(*options.cl_device2);
+            }
+            return {select_device<Real>(options.cl_device), second_device, options.strategy};
+        }
+
+        hybrid_data_processing<Real> device;
+        bool second_cl_device;
+        execution_policy policy;
+        bool vectorized;
+    };
+
+    template<typename Real, execution_policy::e_type Type, bool Vectorized>
+    std::unique_ptr<engine<Real>> create_cpu_engine(const engine_options &options) {
+        if (options.mixed_precision) {
+            return std::make_unique<cpu_engine<Real, Type, Vectorized, double>>();
+        }
+        return std::make_unique<cpu_engine<Real, Type, Vectorized, Real>>();
+    }
+
+    template<typename Real, execution_policy::e_type Type, bool Vectorized>
+    std::unique_ptr<engine<Real>> create_in_place_engine(const engine_options &options) {
+        if (options.mixed_precision) {
+            return std::make_unique<in_place_engine<Real, Type, Vectorized, double>>();
+        }
+        return std::make_unique<in_place_engine<Real, Type, Vectorized, Real>>();
+    }
+
+    template<typename Real, execution_policy::e_type Type>
+    std::unique_ptr<engine<Real>> create_counting_engine(const engine_options &options) {
+        if (options.mixed_precision) {
+            return std::make_unique<counting_engine<Real, Type, double>>(options);
+        }
+        return std::make_unique<counting_engine<Real, Type, Real>>(options);
+    }
+
+    template<typename Real>
+    std::unique_ptr<engine<Real>> create_external_engine(const engine_options &options) {
+        if (options.mixed_precision) {
+            return std::make_unique<external_engine<Real, double>>(options);
+        }
+        return std::make_unique<external_engine<Real, Real>>(options);
+    }
+
+    /**
+     * @brief The OpenCL kernels accumulate the sums in the element type - throws std::runtime_error for the mixed
+     * precision
+     */
+    void check_not_mixed(const engine_options &options) {
+        if (options.mixed_precision) {
+            throw std::runtime_error("--precision mixed is supported by the CPU engines only");
+        }
+    }
+
+    using e_type = execution_policy::e_type;
+
+    /**
+     * @brief Register the engines of one precision
+     * @return true (so the registration can initialize a static variable)
+     */
+    template<typename Real>
+    bool register_engines() {
+        using registry = engine_registry<Real>;
+        registry::add("cpu_seq", "CPU merge sort, sequential", create_cpu_engine<Real, e_type::Sequential, false>);
+        registry::add("cpu_seq_vec", "CPU merge sort, sequential with SIMD kernels",
+                      create_cpu_engine<Real, e_type::Sequential, true>);
+        registry::add("cpu_par", "CPU merge sort, parallel", create_cpu_engine<Real, e_type::Parallel, false>);
+        registry::add("cpu_par_vec", "CPU merge sort, parallel with SIMD kernels",
+                      create_cpu_engine<Real, e_type::Parallel, true>);
+        registry::add("cpu_inplace_seq", "CPU in-place quicksort, sequential",
+                      create_in_place_engine<Real, e_type::Sequential, false>);
+        registry::add("cpu_inplace_seq_vec", "CPU in-place quicksort, sequential with SIMD kernels",
+                      create_in_place_engine<Real, e_type::Sequential, true>);
+        registry::add("cpu_inplace_par", "CPU in-place quicksort, parallel",
+                      create_in_place_engine<Real, e_type::Parallel, false>);
+        registry::add("cpu_inplace_par_vec", "CPU in-place quicksort, parallel with SIMD kernels",
+                      create_in_place_engine<Real, e_type::Parallel, true>);
+        registry::add("cpu_count_seq", "CPU histogram of quantized sensor data (--sensor_scale), sequential",
+                      create_counting_engine<Real, e_type::Sequential>);
+        registry::add("cpu_count_par", "CPU histogram of quantized sensor data (--sensor_scale), parallel",
+                      create_counting_engine<Real, e_type::Parallel>);
+        registry::add("cpu_external", "CPU external merge sort through temporary files within --max_memory"
+                                      " (--parallel, --vectorized)", create_external_engine<Real>);
+        registry::add("gpu", "OpenCL device (--gpu_strategy, --cl_device, --gpu_chunk)",
+                      [](const engine_options &options) -> std::unique_ptr<engine<Real>> {
+                          check_not_mixed(options);
+                          return std::make_unique<gpu_engine<Real>>(options);
+                      });
+        registry::add("hybrid", "OpenCL device and the CPU or --cl_device2 (--parallel, --vectorized)",
+                      [](const engine_options &options) -> std::unique_ptr<engine<Real>> {
+                          check_not_mixed(options);
+                          return std::make_unique<hybrid_engine<Real>>(options);
+                      });
+        return true;
+    }
+
+    const bool registered[] = {register_engines<float>(), register_engines<double>()};
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "my_utils.h"
+#include "execution_policy.h"
+#include "compressed_column.h"
+#include "column_view.h"
+#include "GPU_calc.h"
+
+/**
+ * @brief Capabilities of an engine
+ *
+ * @details
+ *  - Parallel - the host part runs in parallel
+ *  - Vectorized - the host part uses the SIMD kernels
+ *  - OpenCL - the engine runs (a part of) the computation on an OpenCL device
+ *  - Batch - several columns are pipelined at once by compute_CV_MAD_batch
+ *  - Profiling - take_profile returns the device time of the OpenCL commands
+ *  - Streaming - compute_CV_MAD_view reads the column through the view, without the copy in the workspace
+ *  - In_place - the sort needs no memory beyond the workspace but the recursion (no scratch of the merges)
+ */
+struct engine_capability {
+    static constexpr unsigned Parallel = 1u << 0;
+    static constexpr unsigned Vectorized = 1u << 1;
+    static constexpr unsigned OpenCL = 1u << 2;
+    static constexpr unsigned Batch = 1u << 3;
+    static constexpr unsigned Profiling = 1u << 4;
+    static constexpr unsigned Streaming = 1u << 5;
+    static constexpr unsigned In_place = 1u << 6;
+};
+
+/**
+ * @brief Options used by the registry to create an engine - every engine takes what it needs
+ */
+struct engine_options {
+    gpu_strategy strategy = gpu_strategy::Bitonic_sort; // median strategy of the OpenCL engines
+    std::optional<size_t> cl_device; // index of the OpenCL device, the first GPU is used if empty
+    std::optional<size_t> cl_device2; // second OpenCL device of the hybrid engine, the CPU is used if empty
+    std::optional<size_t> chunk_size; // largest number of elements sorted on the OpenCL device at once
+    execution_policy::e_type host_policy = execution_policy::e_type::Sequential; // host part of the OpenCL engines
+    bool host_vectorized = false; // SIMD kernels in the host part of the OpenCL engines
+    bool mixed_precision = false; // float elements with the sums accumulated in double (CPU engines only)
+    std::optional<double> sensor_scale; // value of one ADC count of the counting engines, detected if empty
+    std::optional<size_t> max_memory; // memory budget of the sort in bytes - larger columns are sorted externally
+};
+
+/**
+ * engine class - common interface of all backends computing the coefficient of variance and median absolute
+ * deviation. The execution policy and vectorization of an engine are fixed when it is created.
+ * @tparam Real - element type (float or double)
+ */
+template<typename Real>
+class engine {
+public:
+    virtual ~engine() = default;
+
+    /**
+     * @brief Name of the computation written to the results (e.g. CPU_parallel_vectorized, GPU)
+     * @return name of the engine
+     */
+    [[nodiscard]] virtual std::string name() const = 0;
+
+    /**
+     * @brief Capabilities of the engine
+     * @return bitwise or of engine_capability flags
+     */
+    [[nodiscard]] virtual unsigned capabilities() const = 0;
+
+    /**
+     * @brief Check a capability of the engine
+     * @param capability - capability flag
+     * @return true if the engine has the capability
+     */
+    [[nodiscard]] bool has(unsigned capability) const {
+        return (capabilities() & capability) != 0;
+    }
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation
+     * @param vec - vector of reals (sorted in place)
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    virtual int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad) = 0;
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of a view of a column
+     * Engines without the Streaming capability copy the column into the workspace and call compute_CV_MAD
+     * @param column - view of the column (not modified)
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    virtual int compute_CV_MAD_view(column_view<Real> column, Real &cv, Real &mad) {
+        return compute_CV_MAD(load_workspace(column), cv, mad);
+    }
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of many short segments
+     * @param data - flat buffer of all segments (not modified)
+     * @param offsets - start of each segment followed by the end of the last one
+     * @param cv - coefficient of variance of each segment (output)
+     * @param mad - median absolute deviation of each segment (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    virtual int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                         std::vector<Real> &cv, std::vector<Real> &mad) = 0;
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of several columns
+     * Engines without the Batch capability compute the columns one by one
+     * @param columns - columns of reals (not modified)
+     * @param cv - coefficient of variance of each column (output)
+     * @param mad - median absolute deviation of each column (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    virtual int compute_CV_MAD_batch(const std::vector<column_view<Real>> &columns,
+                                     std::vector<Real> &cv, std::vector<Real> &mad);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of a column stored as 16-bit floats
+     * Engines without a compressed path widen the column and call compute_CV_MAD
+     * @param column - view of the compressed column (not modified)
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    virtual int compute_CV_MAD_compressed(compressed_view column, Real &cv, Real &mad);
+
+    /**
+     * @brief Drop the state the engine keeps for the columns it has computed (e.g. the counts of the counting
+     * engines) - called before the columns are released
+     */
+    virtual void release_columns() {}
+
+    /**
+     * @brief Take the device time accumulated since the last call
+     * @return device time of the OpenCL commands, empty for engines without the Profiling capability
+     */
+    virtual std::optional<gpu_profile> take_profile() {
+        return std::nullopt;
+    }
+
+    /**
+     * @brief Copy a column into the workspace - the workspace keeps its capacity, so it is allocated once for the
+     * longest column and reused by every repetition, partition and engine
+     * @param column - view of the column
+     * @return workspace holding the elements of the column (for compute_CV_MAD, which sorts it in place)
+     */
+    std::vector<Real> &load_workspace(column_view<Real> column) {
+        std::vector<Real> &copy = workspace();
+        copy.assign(column.begin(), column.end());
+        return copy;
+    }
+
+protected:
+    /**
+     * @brief Copy of the column sorted in place, shared by all engines of the precision - the engines compute one
+     * column at a time, so several engines alive at once (--all_variants, --auto) hold a single copy
+     * @return workspace
+     */
+    static std::vector<Real> &workspace();
+};
+
+/**
+ * engine_registry class - engines register a factory under a key, main creates them by the key
+ * without knowing the concrete types. Every precision has its own registry with the same keys.
+ * @tparam Real - element type of the engines (float or double)
+ */
+template<typename Real>
+class engine_registry {
+public:
+    using factory = std::function<std::unique_ptr<engine<Real>>(const engine_options &)>;
+
+    /**
+     * @brief Register an engine - called by the static registrars of the engine translation units
+     * @param key - key of the engine used by --engine
+     * @param description - one line description shown in the help
+     * @param create - factory of the engine
+     * @return true (so the registration can initialize a static variable)
+     */
+    static bool add(const std::string &key, const std::string &description, factory create);
+
+    /**
+     * @brief Create an engine
+     * @param key - key of the engine
+     * @param options - options of the engine
+     * @return the engine, throws std::runtime_error if the key is unknown
+     */
+    static std::unique_ptr<engine<Real>> create(const std::string &key, const engine_options &options);
+
+    /**
+     * @brief Keys and descriptions of all registered engines
+     * @return map of key to description
+     */
+    static std::map<std::string, std::string> list();
+
+private:
+    struct entry {
+        std::string description;
+        factory create;
+    };
+
+    static std::map<std::string, entry> &entries();
+};
@@ -0,0 +1,170 @@
+#include "engine_selector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "reduction.h"
+#include "thread_pool.h"
+
+#define CALIBRATION_REPETITIONS 3 // timed runs of every size, the median is used
+#define CALIBRATION_MIN_SIZE (1u << 10) // smallest calibration size
+#define CALIBRATION_MAX_SIZE (1u << 19) // largest calibration size
+#define CALIBRATION_SIZE_STEP 8 // ratio of two consecutive calibration sizes
+
+template<typename Real>
+engine_selector<Real>::engine_selector(const std::vector<std::string> &keys, const engine_options &options,
+                                       std::string cache_path) : cache_path(std::move(cache_path)) {
+    // the deterministic reductions cost more - every mode has its own models
+    machine_key = std::string(options.mixed_precision ? "mixed" : precision_name<Real>()) + ", " +
+                  reduction_mode_name(selected_reduction_mode()) + " sums, " +
+                  std::to_string(thread_pool::instance().num_threads()) + " threads, OpenCL device " +
+                  (options.cl_device ? std::to_string(*options.cl_device) : "default");
+    load();
+
+    bool calibrated = false;
+    for (const auto &key: keys) {
+        try {
+            engines[key] = engine_registry<Real>::create(key, options);
+        } catch (const std::exception &e) {
+            std::cerr << "Engine " << key << " skipped by --auto: " << e.what() << std::endl;
+            continue;
+        }
+        engine<Real> &device = *engines[key];
+        auto cached = cache.find({machine_key, device.name()});
+        if (cached != cache.end()) {
+            models[key] = cached->second;
+            continue;
+        }
+        std::cout << "Calibrating " << device.name() << std::endl;
+        models[key] = calibrate(device);
+        cache[{machine_key, device.name()}] = models[key];
+        calibrated = true;
+    }
+    if (engines.empty()) {
+        throw std::runtime_error("No engine available for --auto");
+    }
+    if (calibrated) {
+        save();
+    }
+}
+
+template<typename Real>
+engine<Real> &engine_selector<Real>::select(size_t n) {
+    std::string best_key;
+    double best_time = std::numeric_limits<double>::max();
+    for (const auto &pair: engines) {
+        double time = predict(pair.first, n);
+        if (time < best_time) {
+            best_time = time;
+            best_key = pair.first;
+        }
+    }
+    std::cout << "Selected " << engines.at(best_key)->name() << " (predicted " << best_time << " seconds)"
+              << std::endl;
+    return *engines.at(best_key);
+}
+
+template<typename Real>
+double engine_selector<Real>::predict(const std::string &key, size_t n) const {
+    const cost_model &model = models.at(key);
+    auto x = static_cast<double>(n);
+    return model.a + model.b * x * std::log2(std::max(x, 2.0));
+}
+
+template<typename Real>
+typename engine_selector<Real>::cost_model engine_selector<Real>::calibrate(engine<Real> &device) {
+    std::mt19937 generator(42);
+    std::normal_distribution<double> distribution(0.0, 1.0);
+    std::vector<Real> data(CALIBRATION_MAX_SIZE);
+    for (auto &value: data) {
+        value = static_cast<Real>(distribution(generator));
+    }
+
+    // warm-up run - first runs include lazy initialization of the thread pool and the kernels
+    {
+        Real cv = 0;
+        Real mad = 0;
+        device.compute_CV_MAD(device.load_workspace(column_view<Real>(data.data(), CALIBRATION_MIN_SIZE)), cv, mad);
+    }
+
+    // weighted least squares of t = a + b * x with x = n * log2(n) - the weights 1 / t^2 fit the relative error,
+    // so the overhead measured on the small sizes is not lost in the large ones
+    double sw = 0, sx = 0, st = 0, sxx = 0, sxt = 0;
+    for (size_t n = CALIBRATION_MIN_SIZE; n <= CALIBRATION_MAX_SIZE; n *= CALIBRATION_SIZE_STEP) {
+        std::vector<double> times;
+        for (int i = 0; i < CALIBRATION_REPETITIONS; ++i) {
+            std::vector<Real> &copy = device.load_workspace(column_view<Real>(data.data(), n));
+            Real cv = 0;
+            Real mad = 0;
+            auto [time, ret] = measure_time([&]() { return device.compute_CV_MAD(copy, cv, mad); });
+            times.push_back(ret == EXIT_SUCCESS ? time : std::numeric_limits<double>::max());
+        }
+        std::sort(times.begin(), times.end());
+        double t = std::max(times[times.size() / 2], 1e-9);
+        double x = static_cast<double>(n) * std::log2(static_cast<double>(n));
+        double w = 1.0 / (t * t);
+        sw += w;
+        sx += w * x;
+        st += w * t;
+        sxx += w * x * x;
+        sxt += w * x * t;
+    }
+    // the calibration runs must not show up in the profile of the first column
+    device.take_profile();
+
+    cost_model model;
+    model.b = (sw * sxt - sx * st) / (sw * sxx - sx * sx);
+    model.a = (st - model.b * sx) / sw;
+    // both terms are costs - refit with the other one only if the fit made one negative
+    if (model.b < 0) {
+        model.b = 0;
+        model.a = st / sw;
+    } else if (model.a < 0) {
+        model.a = 0;
+        model.b = sxt / sxx;
+    }
+    std::cout << "Cost model of " << device.name() << ": " << model.a << " + " << model.b << " * n * log2(n) seconds"
+              << std::endl;
+    return model;
+}
+
+template<typename Real>
+void engine_selector<Real>::load() {
+    std::ifstream file(cache_path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string machine, engine_name, a, b;
+        if (std::getline(fields, machine, '\t') && std::getline(fields, engine_name, '\t') &&
+            std::getline(fields, a, '\t') && std::getline(fields, b)) {
+            try {
+                cache[{machine, engine_name}] = {std::stod(a), std::stod(b)};
+            } catch (const std::exception &) {
+                // skip malformed lines - the engine is calibrated again
+            }
+        }
+    }
+}
+
+template<typename Real>
+void engine_selector<Real>::save() const {
+    std::ofstream file(cache_path);
+    if (!file) {
+        std::cerr << "Failed to write the engine cost model cache " << cache_path << std::endl;
+        return;
+    }
+    file.precision(17);
+    for (const auto &[key, model]: cache) {
+        file << key.first << '\t' << key.second << '\t' << model.a << '\t' << model.b << '\n';
+    }
+}
+
+template class engine_selector<float>;
+
+template class engine_selector<double>;
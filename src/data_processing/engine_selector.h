@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+/**
+ * engine_selector class - picks the engine predicted to be the fastest for the number of elements.
+ * Every candidate engine is timed on calibration data of a few sizes at startup and a cost model
+ * t(n) = a + b * n * log2(n) is fitted to the times (a - fixed overhead such as transfers and kernel launches,
+ * b - cost of the sort). The models are persisted per machine in a small text cache file, so the calibration
+ * runs only once.
+ * @tparam Real - element type of the engines (float or double)
+ */
+template<typename Real>
+class engine_selector {
+public:
+    /**
+     * @brief Constructor - creates the candidate engines and loads or calibrates their cost models
+     * Engines that cannot be created (e.g. no OpenCL device) are skipped
+     * @param keys - registry keys of the candidate engines
+     * @param options - options of the engines
+     * @param cache_path - path of the cache file
+     */
+    engine_selector(const std::vector<std::string> &keys, const engine_options &options, std::string cache_path);
+
+    /**
+     * @brief Get the engine with the lowest predicted time
+     * @param n - number of elements
+     * @return the engine
+     */
+    engine<Real> &select(size_t n);
+
+    /**
+     * @brief Predicted time of the engine
+     * @param key - registry key of the engine
+     * @param n - number of elements
+     * @return predicted time in seconds
+     */
+    [[nodiscard]] double predict(const std::string &key, size_t n) const;
+
+private:
+    /**
+     * @brief Cost model of one engine - t(n) = a + b * n * log2(n)
+     */
+    struct cost_model {
+        double a = 0;
+        double b = 0;
+    };
+
+    /**
+     * @brief Time the engine on the calibration sizes and fit its cost model
+     * @param device - calibrated engine
+     * @return fitted cost model
+     */
+    static cost_model calibrate(engine<Real> &device);
+
+    /**
+     * @brief Load the cache file - lines "machine<TAB>engine<TAB>a<TAB>b"
+     */
+    void load();
+
+    /**
+     * @brief Write the cache file
+     */
+    void save() const;
+
+    std::string cache_path;
+    std::string machine_key; // precision, number of hardware threads and the OpenCL device index
+    std::map<std::string, std::unique_ptr<engine<Real>>> engines; // registry key -> engine
+    std::map<std::string, cost_model> models; // registry key -> cost model of this machine
+    std::map<std::pair<std::string, std::string>, cost_model> cache; // (machine, engine name) -> cost model
+};
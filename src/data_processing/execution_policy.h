@@ -1,18 +1,18 @@
 #pragma once
 
 #include <tuple>
-#include <variant>
-#include <execution>
 #include <functional>
-#include <map>
+#include <type_traits>
+
+#include "thread_pool.h"
 
 
 /**
  * @brief Execution policy for parallelism
  *
  * @details
- *  - Sequential: std::execution::seq
- *  - Parallel: std::execution::par
+ *  - Sequential: plain loops on the calling thread
+ *  - Parallel: loops split between the workers of the shared thread pool (static_for, policy_for)
  */
 class execution_policy {
 public:
@@ -20,21 +20,85 @@ public:
         Sequential,
         Parallel
     };
-    const std::map<e_type, std::variant<std::execution::sequenced_policy, std::execution::parallel_policy>> policy_map = {
-            {e_type::Sequential, std::execution::seq},
-            {e_type::Parallel,   std::execution::par}
-    };
 
     explicit execution_policy(e_type type) : type_(type) {}
 
     /**
-     * @brief Get the execution policy as a variant
-     * @return std::variant<std::execution::sequenced_policy or std::execution::parallel_policy>
+     * @brief Get the type of the execution policy
+     * @return e_type
      */
-    [[nodiscard]] std::variant<std::execution::sequenced_policy, std::execution::parallel_policy> get_policy() const {
-        return policy_map.at(type_);
+    [[nodiscard]] e_type get_type() const {
+        return type_;
     }
 
 private:
     e_type type_;
-};
\ No newline at end of file
+};
+
+/**
+ * @brief Call the function for every index of the range - on the thread pool if the policy fixed at compile time
+ * is parallel, in a plain loop otherwise
+ * @tparam Type - execution policy type
+ * @param begin - first index
+ * @param end - index after the last one
+ * @param func - function taking the index
+ */
+template<execution_policy::e_type Type, typename Func>
+void static_for(size_t begin, size_t end, Func &&func) {
+    if constexpr (Type == execution_policy::e_type::Parallel) {
+        thread_pool::instance().parallel_for(begin, end, std::forward<Func>(func));
+    } else {
+        for (size_t i = begin; i < end; ++i) {
+            func(i);
+        }
+    }
+}
+
+/**
+ * @brief Call the function for every index of the range with the policy chosen at runtime
+ * @param policy - execution policy - parallel or sequential
+ * @param begin - first index
+ * @param end - index after the last one
+ * @param func - function taking the index
+ */
+template<typename Func>
+void policy_for(const execution_policy &policy, size_t begin, size_t end, Func &&func) {
+    if (policy.get_type() == execution_policy::e_type::Parallel) {
+        static_for<execution_policy::e_type::Parallel>(begin, end, std::forward<Func>(func));
+    } else {
+        static_for<execution_policy::e_type::Sequential>(begin, end, std::forward<Func>(func));
+    }
+}
+
+/**
+ * @brief Number of threads executing the loops of the policy fixed at compile time
+ * @tparam Type - execution policy type
+ * @return size of the thread pool if parallel, 1 otherwise
+ */
+template<execution_policy::e_type Type>
+size_t static_num_threads() {
+    if constexpr (Type == execution_policy::e_type::Parallel) {
+        return thread_pool::instance().num_threads();
+    } else {
+        return 1;
+    }
+}
+
+/**
+ * @brief Call the function with the runtime policy and vectorization turned into compile time constants,
+ * so the branching happens once and not in the inner loops
+ * @param policy - execution policy - parallel or sequential
+ * @param is_vectorized - flag to indicate if vectorization is enabled
+ * @param func - generic callable taking std::integral_constant of e_type and of bool
+ * @return result of the function
+ */
+template<typename Func>
+auto dispatch_static(const execution_policy &policy, bool is_vectorized, Func &&func) {
+    using e_type = execution_policy::e_type;
+    using parallel = std::integral_constant<e_type, e_type::Parallel>;
+    using sequential = std::integral_constant<e_type, e_type::Sequential>;
+    if (policy.get_type() == e_type::Parallel) {
+        return is_vectorized ? func(parallel(), std::true_type()) : func(parallel(), std::false_type());
+    }
+    return is_vectorized ? func(sequential(), std::true_type()) : func(sequential(), std::false_type());
+}
\ No newline at end of file
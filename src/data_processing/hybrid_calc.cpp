@@ -0,0 +1,113 @@
+#include "hybrid_calc.h"
+
+#include <chrono>
+#include <thread>
+
+#define MIN_SPLIT_FRACTION 0.02 // each side keeps at least this part so its throughput stays measured
+
+template<typename Real>
+hybrid_data_processing<Real>::hybrid_data_processing(const cl::Device &device,
+                                                     const std::optional<cl::Device> &second_device,
+                                                     gpu_strategy strategy)
+        : first(device, strategy), split(std::make_shared<split_state>()) {
+    if (second_device) {
+        second.emplace(*second_device, strategy);
+    }
+}
+
+template<typename Real>
+void hybrid_data_processing<Real>::set_max_chunk_size(size_t chunk_size) {
+    first.set_max_chunk_size(chunk_size);
+    if (second) {
+        second->set_max_chunk_size(chunk_size);
+    }
+}
+
+template<typename Real>
+int hybrid_data_processing<Real>::compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                                           std::vector<Real> &cv, std::vector<Real> &mad,
+                                                           const execution_policy &policy) {
+    int ret = first.compute_CV_MAD_segmented(data, offsets, cv, mad, policy);
+    first.take_profile();
+    return ret;
+}
+
+template<typename Real>
+int hybrid_data_processing<Real>::compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, bool is_vectorized,
+                                                 const execution_policy &policy) {
+    const size_t n = vec.size();
+    if (n == 0) {
+        return EXIT_FAILURE;
+    }
+
+    // the deterministic sums do not depend on the split - reduced on the host from the whole column
+    const bool deterministic = selected_reduction_mode() != reduction_mode::Fast;
+    Real host_sum = 0, host_sum2 = 0;
+    if (deterministic) {
+        reduce_sums(vec.data(), n, host_sum, host_sum2, policy);
+    }
+
+    // split the column in proportion to the throughput of the sides
+    const auto split_at = static_cast<size_t>(static_cast<double>(n) * split->first_fraction);
+    std::vector<Real> first_part(vec.begin(), vec.begin() + static_cast<std::ptrdiff_t>(split_at));
+    std::vector<Real> second_part(vec.begin() + static_cast<std::ptrdiff_t>(split_at), vec.end());
+
+    // the second side runs in its own thread, the first one in the calling thread
+    Real second_sum = 0, second_sum2 = 0;
+    int second_ret = EXIT_SUCCESS;
+    double second_time = 0;
+    std::thread second_thread([&]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        if (second) {
+            second_ret = second->sort_and_sum(second_part, second_sum, second_sum2);
+        } else if (!second_part.empty()) {
+            second_ret = mergeSort(second_part, second_sum, second_sum2, is_vectorized, policy);
+        }
+        second_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    });
+
+    Real first_sum = 0, first_sum2 = 0;
+    auto [first_time, first_ret] = measure_time([&]() {
+        return first.sort_and_sum(first_part, first_sum, first_sum2);
+    });
+    second_thread.join();
+
+    // the hybrid results have no per-stage breakdown - drop the recorded device events
+    first.take_profile();
+    if (second) {
+        second->take_profile();
+    }
+
+    if (first_ret != EXIT_SUCCESS || second_ret != EXIT_SUCCESS) {
+        std::cerr << "Failed to sort data" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Sorted " << first_part.size() << " elements on the OpenCL device in " << first_time
+              << " seconds and " << second_part.size() << " elements on the " << (second ? "second device" : "CPU")
+              << " in " << second_time << " seconds" << std::endl;
+
+    // rebalance the next split by the measured throughput (elements per second)
+    if (!first_part.empty() && !second_part.empty() && first_time > 0 && second_time > 0) {
+        double first_throughput = static_cast<double>(first_part.size()) / first_time;
+        double second_throughput = static_cast<double>(second_part.size()) / second_time;
+        split->first_fraction = std::clamp(first_throughput / (first_throughput + second_throughput),
+                                           MIN_SPLIT_FRACTION, 1.0 - MIN_SPLIT_FRACTION);
+    }
+
+    // merge the sorted runs back to the column
+    std::merge(first_part.begin(), first_part.end(), second_part.begin(), second_part.end(), vec.begin());
+    if (!std::is_sorted(vec.begin(), vec.end())) {
+        std::cerr << "Failed to sort data" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Real sum = deterministic ? host_sum : first_sum + second_sum;
+    Real sum2 = deterministic ? host_sum2 : first_sum2 + second_sum2;
+    cv = CV(sum, sum2, n);
+    mad = MAD(vec, n, is_vectorized, policy);
+    return EXIT_SUCCESS;
+}
+
+template class hybrid_data_processing<float>;
+
+template class hybrid_data_processing<double>;
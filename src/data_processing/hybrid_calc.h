@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "my_utils.h"
+#include "execution_policy.h"
+#include "statistics.h"
+#include "GPU_calc.h"
+
+/**
+ * hybrid_data_processing class used to compute the coefficient of variance and median absolute deviation
+ * of one column on two devices at once. The column is split between the OpenCL device and the second side -
+ * the CPU merge sort or another OpenCL device - in proportion to the throughput measured on the previous
+ * column. Both sides sort their part and compute its sum and sum of squares, the sorted runs are merged
+ * on the host for the median and MAD.
+ * The class is instantiated for float and double in hybrid_calc.cpp.
+ * @tparam Real - element type (float or double)
+ */
+template<typename Real>
+class hybrid_data_processing {
+public:
+    /**
+     * @brief Constructor
+     * @param device - OpenCL device of the first side
+     * @param second_device - OpenCL device of the second side, the CPU merge sort is used if empty
+     * @param strategy - strategy used by the OpenCL sides to sort their part (radix-select sorts by bitonic sort)
+     */
+    hybrid_data_processing(const cl::Device &device, const std::optional<cl::Device> &second_device,
+                           gpu_strategy strategy = gpu_strategy::Bitonic_sort);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation
+     * @param vec - vector of reals
+     * @param cv - coefficient of variance (output)
+     * @param mad - median absolute deviation (output)
+     * @param is_vectorized - flag to indicate if vectorization is enabled (CPU side and host MAD)
+     * @param policy - execution policy - parallel or sequential (CPU side and host MAD)
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int compute_CV_MAD(std::vector<Real> &vec, Real &cv, Real &mad, bool is_vectorized,
+                       const execution_policy &policy);
+
+    /**
+     * @brief Compute the coefficient of variance and median absolute deviation of many short segments
+     * Short segments are not worth splitting - all of them are computed by the first OpenCL device
+     * @param data - flat buffer of all segments (not modified)
+     * @param offsets - start of each segment followed by the end of the last one
+     * @param cv - coefficient of variance of each segment (output)
+     * @param mad - median absolute deviation of each segment (output)
+     * @param policy - execution policy of the host fallback
+     * @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise
+     */
+    int compute_CV_MAD_segmented(column_view<Real> data, const std::vector<size_t> &offsets,
+                                 std::vector<Real> &cv, std::vector<Real> &mad, const execution_policy &policy);
+
+    /**
+     * @brief Set the largest number of elements sorted on the OpenCL devices at once
+     * @param chunk_size - number of elements of one chunk
+     */
+    void set_max_chunk_size(size_t chunk_size);
+
+private:
+    /**
+     * @brief Measured throughput of both sides - shared by the copies of the object
+     */
+    struct split_state {
+        double first_fraction = 0.5; // part of the column processed by the first side
+    };
+
+    GPU_data_processing<Real> first;
+    std::optional<GPU_data_processing<Real>> second; // CPU merge sort if empty
+    std::shared_ptr<split_state> split;
+};
@@ -1,16 +1,26 @@
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <map>
-#include <execution>
 #include <filesystem>
 #include <fstream>
+#include <optional>
+#include <sstream>
 
 #include "data_loader.h"
 #include "execution_policy.h"
-#include "device_type.h"
+#include "engine.h"
+#include "engine_selector.h"
+#include "compressed_column.h"
+#include "sorted_prefix.h"
+#include "external_sort.h"
+#include "reduction.h"
+#include "simd_kernels.h"
 #include "svg_ploter.h"
 #include "my_utils.h"
 
+#define ENGINE_MODEL_CACHE "engine_models.cache" // cache file of the calibrated cost models of --auto
+
 arg_parser set_args(const char *program_name) {
     arg_parser parser;
     parser.add_argument("--help", "Show help message", false, false);
@@ -19,20 +29,84 @@ arg_parser set_args(const char *program_name) {
     parser.add_argument("--repetitions", "Number of repetitions for the experiment", false, true, "1");
     parser.add_argument("--num_partitions", "Number of partitions for the data", false, true, "1");
     parser.add_argument("--gpu", "Device type - CPU or GPU", false, false);
+    parser.add_argument("--gpu_strategy", "GPU median strategy - bitonic, merge or radix (radix-select)", false,
+                        true, "bitonic");
+    parser.add_argument("--gpu_batch", "Pipeline the x, y and z columns on the GPU at once (time per column is"
+                                       " the batch time divided by the number of columns)", false, false);
+    parser.add_argument("--gpu_chunk", "Largest number of elements sorted on the GPU at once - longer columns are"
+                                       " sorted in chunks and merged on the CPU (default derived from device memory)",
+                        false, true);
+    parser.add_argument("--hybrid", "Split every column between the OpenCL device and the CPU (or --cl_device2)"
+                                    " in proportion to their measured throughput", false, false);
+    parser.add_argument("--cl_device", "Index of the OpenCL device used by --gpu and --hybrid (default first GPU)",
+                        false, true);
+    parser.add_argument("--cl_device2", "Index of the OpenCL device used instead of the CPU by --hybrid", false,
+                        true);
+    parser.add_argument("--incremental", "Evaluate the growing prefixes of --num_partitions incrementally - sort only"
+                                         " the new slice of every prefix and merge it into the sorted previous"
+                                         " prefix (CPU merge sort with --parallel and --vectorized)", false, false);
+    parser.add_argument("--segment_length", "Compute CV and MAD of every segment of the given number of elements"
+                                            " (e.g. 1-minute epochs) by the batched segmented API", false, true);
     parser.add_argument("--parallel", "Execution policy - parallel or sequential", false, false);
-    parser.add_argument("--vectorized", "AVX2 vectorization", false, false);
+    parser.add_argument("--vectorized", "SIMD vectorization (instruction set by --simd)", false, false);
+    parser.add_argument("--threads", "Number of threads of the parallel computations (default number of hardware"
+                                     " threads)", false, true);
+    parser.add_argument("--simd", "Instruction set of the vectorized kernels - auto, avx512, avx2, sse4.2 or scalar",
+                        false, true, "auto");
+    parser.add_argument("--precision", "Element type of the data and the computations - float, double or mixed (float"
+                                       " data with the sums accumulated in double, CPU engines only)", false, true,
+                        "double");
+    parser.add_argument("--reduction", "Reduction of the sums of CV - fast (fused with the sort), reproducible (the same"
+                                       " bits for any number of threads, instruction set and engine) or exact"
+                                       " (correctly rounded)", false, true, "fast");
+    parser.add_argument("--sensor_scale", "Value of one ADC count of the quantized sensor data of the counting"
+                                          " engines (cpu_count_seq, cpu_count_par) - auto (detected from every"
+                                          " column) or a number", false, true, "auto");
+    parser.add_argument("--storage", "Storage of the loaded columns - native (the element type), half or bfloat16"
+                                     " (16-bit floats widened by the SIMD kernels, the counting engines count them"
+                                     " directly)", false, true, "native");
+    parser.add_argument("--max_memory", "Memory budget of the sort in MiB - columns whose merge sort needs more are"
+                                        " sorted externally through temporary files (engine cpu_external)", false,
+                        true);
+    parser.add_argument("--numa", "Spread the threads over the NUMA nodes and move every part of a column to the"
+                                  " node processing it", false, false);
     parser.add_argument("--all_variants", "Run all variants of the algorithm", false, false);
+    std::string engines;
+    // both precisions register the same engines
+    for (const auto &pair: engine_registry<double>::list()) {
+        engines += "\n    " + pair.first + " - " + pair.second;
+    }
+    parser.add_argument("--auto", "Route every column to the engine predicted to be the fastest by a cost model"
+                                  " calibrated at startup (cached in engine_models.cache)", false, false);
+    parser.add_argument("--engine", "Engine used instead of --gpu, --hybrid, --parallel and --vectorized:" + engines,
+                        false, true);
 
 
     auto &group = parser.add_mutually_exclusive_group();
     group.add_argument("--gpu");
     group.add_argument("--vectorized");
     group.add_argument("--all_variants");
+    group.add_argument("--auto");
 
     auto &group2 = parser.add_mutually_exclusive_group();
     group2.add_argument("--parallel");
     group2.add_argument("--all_variants");
+    group2.add_argument("--auto");
+
+    auto &group4 = parser.add_mutually_exclusive_group();
+    group4.add_argument("--segment_length");
+    group4.add_argument("--gpu_batch");
+    group4.add_argument("--all_variants");
+    group4.add_argument("--auto");
+    group4.add_argument("--incremental");
 
+    auto &group3 = parser.add_mutually_exclusive_group();
+    group3.add_argument("--hybrid");
+    group3.add_argument("--gpu");
+    group3.add_argument("--all_variants");
+    group3.add_argument("--engine");
+    group3.add_argument("--auto");
+    group3.add_argument("--incremental");
 
     parser.set_usage("Example usage: " + std::string(program_name) +
                      " --input data/ACC_001.csv --repetitions 10 --num_partitions 4 --gpu");
@@ -74,6 +148,80 @@ void check_output(const std::string &out_dir) {
     }
 }
 
+gpu_strategy check_gpu_strategy(const std::string &value) {
+    const std::map<std::string, gpu_strategy> strategies = {
+            {"bitonic", gpu_strategy::Bitonic_sort},
+            {"merge",   gpu_strategy::Merge_sort},
+            {"radix",   gpu_strategy::Radix_select}
+    };
+    if (strategies.find(value) == strategies.end()) {
+        throw std::runtime_error("--gpu_strategy must be one of bitonic, merge, radix");
+    }
+    return strategies.at(value);
+}
+
+std::optional<simd_isa> check_simd_isa(const std::string &value) {
+    const std::map<std::string, simd_isa> isas = {
+            {"avx512", simd_isa::AVX512},
+            {"avx2",   simd_isa::AVX2},
+            {"sse4.2", simd_isa::SSE42},
+            {"scalar", simd_isa::Scalar}
+    };
+    if (value == "auto") { // widest instruction set supported by the processor
+        return std::nullopt;
+    }
+    if (isas.find(value) == isas.end()) {
+        throw std::runtime_error("--simd must be one of auto, avx512, avx2, sse4.2, scalar");
+    }
+    return isas.at(value);
+}
+
+reduction_mode check_reduction_mode(const std::string &value) {
+    const std::map<std::string, reduction_mode> modes = {
+            {"fast",         reduction_mode::Fast},
+            {"reproducible", reduction_mode::Reproducible},
+            {"exact",        reduction_mode::Exact}
+    };
+    if (modes.find(value) == modes.end()) {
+        throw std::runtime_error("--reduction must be one of fast, reproducible, exact");
+    }
+    return modes.at(value);
+}
+
+storage_format check_storage_format(const std::string &value) {
+    const std::map<std::string, storage_format> formats = {
+            {"native",   storage_format::Native},
+            {"half",     storage_format::Half},
+            {"bfloat16", storage_format::BFloat16}
+    };
+    if (formats.find(value) == formats.end()) {
+        throw std::runtime_error("--storage must be one of native, half, bfloat16");
+    }
+    return formats.at(value);
+}
+
+void check_precision(const std::string &value) {
+    if (value != "float" && value != "double" && value != "mixed") {
+        throw std::runtime_error("--precision must be one of float, double, mixed");
+    }
+}
+
+std::optional<double> check_sensor_scale(const std::string &value) {
+    if (value == "auto") {
+        return std::nullopt;
+    }
+    double scale = 0;
+    try {
+        scale = std::stod(value);
+    } catch (const std::exception &) {
+        // reported below
+    }
+    if (!(scale > 0) || !std::isfinite(scale)) {
+        throw std::runtime_error("--sensor_scale must be auto or a positive number");
+    }
+    return scale;
+}
+
 size_t check_numeric(const std::string &value, const std::string &name) {
     if (!std::all_of(value.begin(), value.end(), ::isdigit)) {
         throw std::runtime_error(name + " must be a positive integer");
@@ -84,34 +232,521 @@ size_t check_numeric(const std::string &value, const std::string &name) {
     return std::stoul(value);
 }
 
-double do_comp(std::vector<real> &data_vec, real &CV, real &MAD, bool vec, const execution_policy &policy,
-               const device_type &device, size_t repetitions) {
-    std::vector<real> times;
+std::optional<size_t> check_index(const std::string &value, const std::string &name) {
+    if (value.empty()) {
+        return std::nullopt;
+    }
+    if (!std::all_of(value.begin(), value.end(), ::isdigit)) {
+        throw std::runtime_error(name + " must be a non-negative integer");
+    }
+    return std::stoul(value);
+}
+
+void add_profile(std::optional<gpu_profile> &total, const gpu_profile &profile) {
+    if (!total) {
+        total.emplace();
+    }
+    total->upload += profile.upload;
+    total->sort += profile.sort;
+    total->reduce += profile.reduce;
+    total->abs_diff += profile.abs_diff;
+    total->readback += profile.readback;
+    total->allocations += profile.allocations;
+}
+
+std::string profile_columns(const std::optional<gpu_profile> &profile, size_t repetitions) {
+    if (!profile) { // no device profile - CPU and hybrid computations
+        return ",,,,,";
+    }
+    // mean device time of the repetitions
+    auto r = static_cast<double>(repetitions);
+    return "," + std::to_string(profile->upload / r) + "," + std::to_string(profile->sort / r) + "," +
+           std::to_string(profile->reduce / r) + "," + std::to_string(profile->abs_diff / r) + "," +
+           std::to_string(profile->readback / r);
+}
+
+std::string numa_columns(const std::optional<numa_pages> &pages, size_t repetitions) {
+    if (!pages) { // NUMA mode off or no per-column placement
+        return ",,";
+    }
+    // mean page counts of the repetitions
+    return "," + std::to_string(pages->local / repetitions) + "," + std::to_string(pages->remote / repetitions);
+}
+
+std::string storage_column(const compressed_view *packed) {
+    if (!packed) { // native storage
+        return ",";
+    }
+    std::ostringstream column;
+    column << "," << packed->max_error();
+    return column.str();
+}
+
+template<typename Real>
+double do_comp(column_view<Real> data_vec, const compressed_view *packed, Real &CV, Real &MAD,
+               engine<Real> &device, size_t repetitions, std::optional<gpu_profile> &profile,
+               std::optional<numa_pages> &pages) {
+    std::vector<double> times;
+    profile.reset();
+    pages.reset();
+    const thread_pool &pool = thread_pool::instance();
     for (size_t i = 0; i < repetitions; ++i) {
-        auto data_vec_copy = std::vector<real>(data_vec);
-        std::visit([&](auto &&device) {
-            auto [stat_time, stat_ret] = measure_time(
-                    [&](std::vector<real> &data_vec_copy, real &cv, real &mad, bool is_vectorized,
-                        const execution_policy &policy) {
-                        return device.compute_CV_MAD(data_vec_copy, cv, mad, is_vectorized, policy);
-                    }, data_vec_copy, CV, MAD, vec, std::cref(policy));
-
-            if (stat_ret == EXIT_SUCCESS) {
-                std::cout << "Coefficient of variance: " << CV << std::endl;
-                std::cout << "Median absolute deviation: " << MAD << std::endl;
-                std::cout << "Computed in " << stat_time << " seconds" << std::endl;
-                times.push_back(stat_time);
-            } else {
-                std::cerr << "Failed to compute statistics" << std::endl;
+        // the engines sort in place - the column is copied into the workspace shared by the engines, the compressed
+        // column is not modified and not copied at all, the streaming engines (external, counting) read the view
+        std::vector<Real> *workspace = packed || device.has(engine_capability::Streaming)
+                                       ? nullptr : &device.load_workspace(data_vec);
+        if (pool.numa() && workspace) {
+            // the copy is touched by this thread - move its parts to the nodes that sort them
+            pool.place(*workspace);
+            numa_pages copy_pages = pool.count_pages(*workspace);
+            if (!pages) {
+                pages.emplace();
             }
+            pages->local += copy_pages.local;
+            pages->remote += copy_pages.remote;
+        }
+        auto [stat_time, stat_ret] = measure_time([&]() {
+            if (packed) {
+                return device.compute_CV_MAD_compressed(*packed, CV, MAD);
+            }
+            return workspace ? device.compute_CV_MAD(*workspace, CV, MAD)
+                             : device.compute_CV_MAD_view(data_vec, CV, MAD);
+        });
+
+        if (stat_ret == EXIT_SUCCESS) {
+            std::cout << "Coefficient of variance: " << CV << std::endl;
+            std::cout << "Median absolute deviation: " << MAD << std::endl;
+            std::cout << "Computed in " << stat_time << " seconds" << std::endl;
+            times.push_back(stat_time);
+        } else {
+            std::cerr << "Failed to compute statistics" << std::endl;
+        }
+
+        // device time of the OpenCL commands - separates the kernels from the transfers
+        if (auto device_profile = device.take_profile()) {
+            std::cout << "Device time: upload " << device_profile->upload << " s, sort " << device_profile->sort
+                      << " s, reduce " << device_profile->reduce << " s, abs diff " << device_profile->abs_diff
+                      << " s, readback " << device_profile->readback << " s, buffer allocations "
+                      << device_profile->allocations << std::endl;
+            add_profile(profile, *device_profile);
+        }
+    }
+    // return the median time
+    std::sort(times.begin(), times.end());
+    return (times[times.size() / 2] + times[(times.size() - 1) / 2]) / 2.0;
+}
+
+template<typename Real>
+double do_comp_segmented(column_view<Real> data_vec, const std::vector<size_t> &offsets,
+                         std::vector<Real> &CVs, std::vector<Real> &MADs, engine<Real> &device, size_t repetitions,
+                         std::optional<gpu_profile> &profile) {
+    std::vector<double> times;
+    profile.reset();
+    for (size_t i = 0; i < repetitions; ++i) {
+        auto [stat_time, stat_ret] = measure_time([&]() {
+            return device.compute_CV_MAD_segmented(data_vec, offsets, CVs, MADs);
+        });
+
+        if (stat_ret == EXIT_SUCCESS) {
+            std::cout << "Computed " << offsets.size() - 1 << " segments in " << stat_time << " seconds"
+                      << std::endl;
+            times.push_back(stat_time);
+        } else {
+            std::cerr << "Failed to compute statistics" << std::endl;
+        }
+
+        if (auto device_profile = device.take_profile()) {
+            add_profile(profile, *device_profile);
+        }
+    }
+    // return the median time
+    std::sort(times.begin(), times.end());
+    return (times[times.size() / 2] + times[(times.size() - 1) / 2]) / 2.0;
+}
+
+template<typename Real>
+double do_comp_batch(const std::vector<column_view<Real>> &columns,
+                     std::vector<Real> &CVs, std::vector<Real> &MADs, engine<Real> &device, size_t repetitions,
+                     std::optional<gpu_profile> &profile) {
+    std::vector<double> times;
+    profile.reset();
+    for (size_t i = 0; i < repetitions; ++i) {
+        auto [stat_time, stat_ret] = measure_time([&]() {
+            return device.compute_CV_MAD_batch(columns, CVs, MADs);
+        });
+        if (auto device_profile = device.take_profile()) {
+            std::cout << "Buffer allocations: " << device_profile->allocations << std::endl;
+            add_profile(profile, *device_profile);
+        }
+
+        if (stat_ret == EXIT_SUCCESS) {
+            std::cout << "Computed " << columns.size() << " columns in " << stat_time << " seconds" << std::endl;
+            times.push_back(stat_time);
+        } else {
+            std::cerr << "Failed to compute statistics" << std::endl;
+        }
+    }
+    // return the median time
+    std::sort(times.begin(), times.end());
+    return (times[times.size() / 2] + times[(times.size() - 1) / 2]) / 2.0;
+}
+
+template<typename Real, typename Acc>
+double do_comp_incremental(sorted_prefix<Real, Acc> &prefix, column_view<Real> column, size_t end, Real &CV,
+                           Real &MAD, size_t repetitions) {
+    std::vector<double> times;
+    sorted_prefix<Real, Acc> extended = prefix;
+    for (size_t i = 0; i < repetitions; ++i) {
+        // every repetition extends the same previous prefix
+        extended = prefix;
+        auto [stat_time, stat_ret] = measure_time([&]() {
+            return extended.extend(column, end) == EXIT_SUCCESS ? extended.compute_CV_MAD(CV, MAD) : EXIT_FAILURE;
+        });
 
-        }, device.get_device());
+        if (stat_ret == EXIT_SUCCESS) {
+            std::cout << "Coefficient of variance: " << CV << std::endl;
+            std::cout << "Median absolute deviation: " << MAD << std::endl;
+            std::cout << "Computed in " << stat_time << " seconds" << std::endl;
+            times.push_back(stat_time);
+        } else {
+            std::cerr << "Failed to compute statistics" << std::endl;
+        }
     }
+    prefix = std::move(extended);
     // return the median time
     std::sort(times.begin(), times.end());
     return (times[times.size() / 2] + times[(times.size() - 1) / 2]) / 2.0;
 }
 
+/**
+ * @brief Parsed options of the computations
+ */
+struct run_config {
+    std::string output;
+    size_t repetitions;
+    size_t num_partitions;
+    bool par;
+    bool vec;
+    bool all_variants;
+    bool gpu_batch;
+    bool auto_select;
+    std::string engine_name;
+    engine_options options;
+    size_t segment_length;
+    storage_format storage = storage_format::Native;
+    bool incremental = false;
+    bool engine_named = false; // the engine given by --engine - not replaced by the external merge sort
+};
+
+/**
+ * @brief Evaluate the growing prefixes of the columns incrementally - every prefix sorts only its new slice
+ * @tparam Real - element type of the data and the computations (float or double)
+ * @tparam Acc - accumulator of the sums
+ * @param columns - loaded columns (not modified)
+ * @param packed_columns - compressed columns of --storage (empty with native storage)
+ * @param config - parsed options
+ * @param results_file - results of the prefixes (output)
+ */
+template<typename Real, typename Acc>
+void run_incremental(const std::map<std::string, column_view<Real>> &columns,
+                     const std::map<std::string, compressed_column> &packed_columns, const run_config &config,
+                     std::ofstream &results_file) {
+    const execution_policy policy(config.par ? execution_policy::e_type::Parallel
+                                             : execution_policy::e_type::Sequential);
+    std::map<std::string, sorted_prefix<Real, Acc>> prefixes;
+    for (const auto &pair: columns) {
+        prefixes.try_emplace(pair.first, config.vec, policy);
+    }
+    const size_t data_size = columns.begin()->second.size();
+    size_t partition_size = data_size / config.num_partitions;
+    size_t partition_end = partition_size;
+    for (size_t i = 0; i < config.num_partitions; ++i) {
+        for (const auto &[name, column]: columns) {
+            sorted_prefix<Real, Acc> &prefix = prefixes.at(name);
+            std::cout << "\nColumn " << name << " :" << partition_end << " elements (" << partition_end - prefix.size()
+                      << " new)" << std::endl;
+            std::cout << "=============================" << std::endl;
+            std::cout << "Running " << prefix.name() << std::endl;
+            Real CV = 0;
+            Real MAD = 0;
+            auto med_time = do_comp_incremental(prefix, column, partition_end, CV, MAD, config.repetitions);
+            std::optional<compressed_view> packed;
+            if (!packed_columns.empty()) {
+                packed = packed_columns.at(name);
+            }
+            results_file << name << "," << partition_end << "," << prefix.name() << "," << CV << "," << MAD << ","
+                         << med_time << profile_columns(std::nullopt, config.repetitions)
+                         << numa_columns(std::nullopt, config.repetitions)
+                         << storage_column(packed ? &*packed : nullptr) << "\n";
+        }
+        partition_end = (i == config.num_partitions - 2) ? data_size : partition_end + partition_size;
+    }
+}
+
+/**
+ * @brief Run the computations on all files
+ * @tparam Real - element type of the data and the computations (float or double)
+ * @param files - input files
+ * @param config - parsed options
+ */
+template<typename Real>
+void run(const std::vector<std::string> &files, run_config config) {
+    std::cout << "Running computations on " << files.size() << " files"
+              << " with " << config.repetitions << " repetitions"
+              << " and " << config.num_partitions << " partitions"
+              << " in " << (config.options.mixed_precision ? "mixed" : precision_name<Real>()) << " precision"
+              << std::endl;
+    if (selected_reduction_mode() != reduction_mode::Fast) {
+        std::cout << "Sums reduced in " << reduction_mode_name(selected_reduction_mode()) << " mode" << std::endl;
+    }
+    if (config.storage != storage_format::Native) {
+        std::cout << "Columns stored as " << storage_format_name(config.storage) << std::endl;
+    }
+    if (config.vec || config.all_variants || config.auto_select) {
+        std::cout << "SIMD kernels: " << simd_isa_name(selected_simd_isa()) << std::endl;
+    }
+    execution_policy policy((config.par || config.all_variants) ? execution_policy::e_type::Parallel
+                                                                : execution_policy::e_type::Sequential);
+    // create the engines once - the GPU keeps its kernels and buffer pool across columns and repetitions
+    std::vector<std::unique_ptr<engine<Real>>> engines;
+    std::optional<engine_selector<Real>> selector;
+    if (config.auto_select) {
+        config.options.host_policy = execution_policy::e_type::Parallel;
+        selector.emplace(std::vector<std::string>{"cpu_seq", "cpu_seq_vec", "cpu_par", "cpu_par_vec", "gpu"},
+                         config.options, ENGINE_MODEL_CACHE);
+    } else if (config.all_variants) {
+        config.options.strategy = gpu_strategy::Bitonic_sort;
+        config.options.host_policy = execution_policy::e_type::Parallel;
+        for (const auto &key: {"cpu_seq_vec", "cpu_seq", "cpu_par_vec", "cpu_par", "gpu"}) {
+            engines.push_back(engine_registry<Real>::create(key, config.options));
+        }
+    } else {
+        engines.push_back(engine_registry<Real>::create(config.engine_name, config.options));
+    }
+    // columns whose merge sort does not fit --max_memory are sorted externally
+    std::unique_ptr<engine<Real>> external;
+    if (config.options.max_memory) {
+        external = engine_registry<Real>::create("cpu_external", config.options);
+    }
+    if (config.gpu_batch && !engines.front()->has(engine_capability::Batch)) {
+        throw std::runtime_error("--gpu_batch requires an engine computing several columns at once (--gpu)");
+    }
+    for (const auto &file: files) {
+        std::cout << "File " << file;
+        // create output file for results
+        std::string out_file = config.output + "/" + std::filesystem::path(file).stem().string() + "_results.csv";
+        std::ofstream results_file(out_file);
+        if (!results_file.is_open()) {
+            throw std::runtime_error("Failed to open output file");
+        }
+        results_file << "column,num_elements,comp_type,CV,MAD,time,upload,sort,reduce,abs_diff,readback,"
+                        "numa_local,numa_remote,storage_error\n";
+        // CV and MAD of every segment
+        std::ofstream segments_file;
+        if (config.segment_length > 0) {
+            std::string segments_out = config.output + "/" + std::filesystem::path(file).stem().string() +
+                                       "_segments.csv";
+            segments_file.open(segments_out);
+            if (!segments_file.is_open()) {
+                throw std::runtime_error("Failed to open output file");
+            }
+            segments_file << "column,start,num_elements,CV,MAD\n";
+        }
+
+        // load data from file
+        struct data<Real> data;
+        auto [load_time, load_ret] = measure_time(
+                [&](const std::string &filename, struct data<Real> &data, const execution_policy &policy) {
+                    return load_data(filename, data, policy);
+                }, file, data, std::cref(policy));
+
+        if (load_ret == EXIT_SUCCESS) {
+            std::cout << " loaded in " << load_time << " seconds" << std::endl;
+            if (thread_pool::instance().numa()) {
+                for (auto *column: {&data.x, &data.y, &data.z}) {
+                    thread_pool::instance().place(*column);
+                }
+            }
+        } else {
+            std::cerr << "Failed to load data" << std::endl;
+        }
+        size_t data_size = data.x.size();
+        // the loaded columns are kept only compressed - the widened columns are released
+        std::map<std::string, compressed_column> packed_columns;
+        if (config.storage != storage_format::Native) {
+            for (auto [column_name, column]: {std::pair{"x", &data.x}, std::pair{"y", &data.y},
+                                              std::pair{"z", &data.z}}) {
+                compressed_column &packed = packed_columns[column_name];
+                compress_column(*column, config.storage, packed, policy);
+                std::vector<Real>().swap(*column);
+                std::cout << "Column " << column_name << " compressed - element error <= " << packed.max_error
+                          << ", median error <= " << packed.max_error << ", MAD error <= " << 2 * packed.max_error
+                          << std::endl;
+            }
+        }
+        if (config.incremental) {
+            // the prefixes are merge sorted from the widened columns
+            for (const auto &[column_name, packed]: packed_columns) {
+                widen_column(packed, column_name == "x" ? data.x : column_name == "y" ? data.y : data.z, policy);
+            }
+            std::map<std::string, column_view<Real>> columns = {
+                    {"x", data.x},
+                    {"y", data.y},
+                    {"z", data.z}
+            };
+            if (config.options.mixed_precision) {
+                run_incremental<Real, double>(columns, packed_columns, config, results_file);
+            } else {
+                run_incremental<Real, Real>(columns, packed_columns, config, results_file);
+            }
+            results_file.close();
+            continue;
+        }
+        size_t partition_size = data_size / config.num_partitions;
+        size_t partition_end = partition_size;
+        for (size_t i = 0; i < config.num_partitions; ++i) {
+            // the partitions are views of the prefixes of the loaded and compressed columns - the engines copy
+            // a column at most once per computation into their workspace
+            std::map<std::string, column_view<Real>> data_map = {
+                    {"x", column_view<Real>(data.x).prefix(partition_end)},
+                    {"y", column_view<Real>(data.y).prefix(partition_end)},
+                    {"z", column_view<Real>(data.z).prefix(partition_end)}
+            };
+            std::map<std::string, compressed_view> packed_parts;
+            for (const auto &[column_name, packed]: packed_columns) {
+                packed_parts[column_name] = compressed_view(packed).prefix(partition_end);
+            }
+            partition_end = (i == config.num_partitions - 2) ? data_size : partition_end + partition_size;
+            // the paths without a compressed variant widen the compressed columns
+            std::map<std::string, std::vector<Real>> widened_parts;
+            auto widen_part = [&](const std::string &column_name) {
+                if (!packed_parts.empty()) {
+                    widen_column(packed_parts.at(column_name), widened_parts[column_name], policy);
+                    data_map.at(column_name) = widened_parts[column_name];
+                }
+            };
+            auto packed_part = [&](const std::string &column_name) -> const compressed_view * {
+                return packed_parts.empty() ? nullptr : &packed_parts.at(column_name);
+            };
+            if (config.gpu_batch) {
+                for (const auto &pair: data_map) {
+                    widen_part(pair.first);
+                }
+                std::cout << "\nColumns x, y, z :" << data_map.at("x").size() << " elements" << std::endl;
+                std::cout << "=============================" << std::endl;
+                std::cout << "Running on GPU in batch mode" << std::endl;
+                std::vector<column_view<Real>> columns = {data_map.at("x"), data_map.at("y"), data_map.at("z")};
+                std::vector<Real> CVs;
+                std::vector<Real> MADs;
+                std::optional<gpu_profile> profile;
+                auto med_time = do_comp_batch(columns, CVs, MADs, *engines.front(), config.repetitions, profile);
+                // the device time of the batch is split evenly between the columns like the wall time
+                std::optional<gpu_profile> column_profile = profile;
+                if (column_profile) {
+                    double c = static_cast<double>(columns.size());
+                    *column_profile = {profile->upload / c, profile->sort / c, profile->reduce / c,
+                                       profile->abs_diff / c, profile->readback / c, profile->allocations};
+                }
+                size_t column_id = 0;
+                for (const auto &pair: data_map) {
+                    std::cout << "Column " << pair.first << " - coefficient of variance: " << CVs[column_id]
+                              << ", median absolute deviation: " << MADs[column_id] << std::endl;
+                    results_file << pair.first << "," << pair.second.size() << ",GPU_batch,"
+                                 << CVs[column_id] << "," << MADs[column_id] << ","
+                                 << med_time / static_cast<double>(columns.size())
+                                 << profile_columns(column_profile, config.repetitions)
+                                 << numa_columns(std::nullopt, config.repetitions)
+                                 << storage_column(packed_part(pair.first)) << "\n";
+                    ++column_id;
+                }
+                continue;
+            }
+            for (const auto &pair: data_map) {
+                const std::string &name = pair.first;
+                const column_view<Real> &data_vec = pair.second; // updated by widen_part
+
+                std::cout << "\nColumn " << name << " :";
+
+                size_t n = packed_parts.empty() ? data_vec.size() : packed_parts.at(name).size();
+
+                std::cout << n << " elements" << std::endl;
+                std::cout << "=============================" << std::endl;
+                // the engine of the column - chosen by the cost model with --auto, the external merge sort if the
+                // merge sort of the column does not fit --max_memory (an engine named by --engine or sorting in
+                // place is kept)
+                engine<Real> &chosen = selector ? selector->select(n) : *engines.front();
+                const bool spill = external && !config.engine_named && !chosen.has(engine_capability::In_place) &&
+                                   !fits_memory<Real>(n, *config.options.max_memory);
+                engine<Real> &device = spill ? *external : chosen;
+
+                if (config.segment_length > 0) {
+                    widen_part(name);
+                    std::vector<size_t> offsets;
+                    for (size_t start = 0; start < n; start += config.segment_length) {
+                        offsets.push_back(start);
+                    }
+                    offsets.push_back(n);
+                    std::cout << "Running " << offsets.size() - 1 << " segments of " << config.segment_length
+                              << " elements on " << device.name() << std::endl;
+                    std::vector<Real> CVs;
+                    std::vector<Real> MADs;
+                    std::optional<gpu_profile> profile;
+                    auto med_time = do_comp_segmented(data_vec, offsets, CVs, MADs, device, config.repetitions,
+                                                      profile);
+                    for (size_t s = 0; s + 1 < offsets.size(); ++s) {
+                        segments_file << name << "," << offsets[s] << "," << offsets[s + 1] - offsets[s] << ","
+                                      << CVs[s] << "," << MADs[s] << "\n";
+                    }
+                    results_file << name << "," << n << "," << device.name() << "_segmented,,," << med_time
+                                 << profile_columns(profile, config.repetitions)
+                                 << numa_columns(std::nullopt, config.repetitions)
+                                 << storage_column(packed_part(name)) << "\n";
+                    continue;
+                }
+
+                if (config.all_variants) {
+                    std::cout << "Running all variants" << std::endl;
+                    for (auto &variant: engines) {
+                        Real CV = 0;
+                        Real MAD = 0;
+                        std::cout << "Running " << variant->name() << std::endl;
+                        std::optional<gpu_profile> profile;
+                        std::optional<numa_pages> pages;
+                        auto med_time = do_comp(data_vec, packed_part(name), CV, MAD, *variant,
+                                                config.repetitions, profile, pages);
+                        results_file << name << "," << n << "," << variant->name() << "," << CV << "," << MAD
+                                     << "," << med_time << profile_columns(profile, config.repetitions)
+                                     << numa_columns(pages, config.repetitions)
+                                     << storage_column(packed_part(name)) << "\n";
+                    }
+                } else {
+                    Real CV = 0;
+                    Real MAD = 0;
+                    std::cout << "Running " << device.name() << std::endl;
+                    std::optional<gpu_profile> profile;
+                    std::optional<numa_pages> pages;
+                    auto med_time = do_comp(data_vec, packed_part(name), CV, MAD, device, config.repetitions,
+                                            profile, pages);
+                    const std::string comp_type = device.name();
+                    results_file << name << "," << n << "," << comp_type << "," << CV << "," << MAD << ","
+                                 << med_time << profile_columns(profile, config.repetitions)
+                                 << numa_columns(pages, config.repetitions)
+                                 << storage_column(packed_part(name)) << "\n";
+                }
+            }
+        }
+        results_file.close();
+        // the columns of the file are released at the end of the iteration - the engines drop their state of them
+        for (auto &variant: engines) {
+            variant->release_columns();
+        }
+        // if all variants are run, plot the results
+        if (config.all_variants) {
+            std::string out_dir = config.output + "/" + std::filesystem::path(file).stem().string();
+            plot_results(out_file, out_dir);
+        }
+    }
+}
 
 int main(int argc, char *argv[]) {
     arg_parser parser = set_args(argv[0]);
@@ -124,122 +759,63 @@ int main(int argc, char *argv[]) {
         check_output(output);
         const size_t repetitions = check_numeric(parser.get("--repetitions"), "--repetitions");
         size_t num_partitions = check_numeric(parser.get("--num_partitions"), "--num_partitions");
+        thread_pool::set_numa(parser.get("--numa") == "true");
+        if (!parser.get("--threads").empty()) {
+            thread_pool::set_num_threads(check_numeric(parser.get("--threads"), "--threads"));
+        }
+        if (auto isa = check_simd_isa(parser.get("--simd"))) {
+            set_simd_isa(*isa);
+        }
+        set_reduction_mode(check_reduction_mode(parser.get("--reduction")));
         bool gpu = parser.get("--gpu") == "true";
         bool par = parser.get("--parallel") == "true";
         bool vec = parser.get("--vectorized") == "true";
         bool all_variants = parser.get("--all_variants") == "true";
+        bool gpu_batch = parser.get("--gpu_batch") == "true";
+        bool hybrid = parser.get("--hybrid") == "true";
+        bool auto_select = parser.get("--auto") == "true";
+        // the legacy flags select one of the registered engines
+        std::string engine_name = parser.get("--engine");
+        if (engine_name.empty()) {
+            engine_name = gpu ? "gpu" : hybrid ? "hybrid" :
+                          std::string(par ? "cpu_par" : "cpu_seq") + (vec ? "_vec" : "");
+        }
+        engine_options options;
+        options.strategy = check_gpu_strategy(parser.get("--gpu_strategy"));
+        options.cl_device = check_index(parser.get("--cl_device"), "--cl_device");
+        options.cl_device2 = check_index(parser.get("--cl_device2"), "--cl_device2");
+        if (options.cl_device2 && engine_name != "hybrid") {
+            throw std::runtime_error("--cl_device2 requires --hybrid");
+        }
+        if (!parser.get("--gpu_chunk").empty()) {
+            options.chunk_size = check_numeric(parser.get("--gpu_chunk"), "--gpu_chunk");
+        }
+        options.host_policy = par ? execution_policy::e_type::Parallel : execution_policy::e_type::Sequential;
+        options.host_vectorized = vec;
+        options.sensor_scale = check_sensor_scale(parser.get("--sensor_scale"));
+        if (!parser.get("--max_memory").empty()) {
+            options.max_memory = check_numeric(parser.get("--max_memory"), "--max_memory") << 20;
+        }
+        size_t segment_length = 0;
+        if (!parser.get("--segment_length").empty()) {
+            segment_length = check_numeric(parser.get("--segment_length"), "--segment_length");
+        }
 
 
-        std::cout << "Running computations on " << files.size() << " files"
-                  << " with " << repetitions << " repetitions"
-                  << " and " << num_partitions << " partitions" << std::endl;
-        execution_policy policy(
-                (par || all_variants) ? execution_policy::e_type::Parallel : execution_policy::e_type::Sequential);
-        for (const auto &file: files) {
-            std::cout << "File " << file;
-            // create output file for results
-            std::string out_file = output + "/" + std::filesystem::path(file).stem().string() + "_results.csv";
-            std::ofstream results_file(out_file);
-            if (!results_file.is_open()) {
-                throw std::runtime_error("Failed to open output file");
-            }
-            results_file << "column,num_elements,comp_type,CV,MAD,time\n";
-
-            // load data from file
-            struct data data;
-            auto [load_time, load_ret] = measure_time(
-                    [&](const std::string &filename, struct data &data, const execution_policy &policy) {
-                        return load_data(filename, data, policy);
-                    }, file, data, std::cref(policy));
-
-            if (load_ret == EXIT_SUCCESS) {
-                std::cout << " loaded in " << load_time << " seconds" << std::endl;
-            } else {
-                std::cerr << "Failed to load data" << std::endl;
-            }
-            size_t data_size = data.x.size();
-            size_t partition_size = data_size / num_partitions;
-            size_t partition_end = partition_size;
-            for (size_t i = 0; i < num_partitions; ++i) {
-                auto copy_x = std::vector<real>(data.x.begin(),
-                                                data.x.begin() + static_cast<int>(partition_end));
-                auto copy_y = std::vector<real>(data.y.begin(),
-                                                data.y.begin() + static_cast<int>(partition_end));
-                auto copy_z = std::vector<real>(data.z.begin(),
-                                                data.z.begin() + static_cast<int>(partition_end));
-                partition_end = (i == num_partitions - 2) ? data_size : partition_end + partition_size;
-                std::map<std::string, std::reference_wrapper<std::vector<real>>> data_map = {
-                        {"x", copy_x},
-                        {"y", copy_y},
-                        {"z", copy_z}
-                };
-                for (const auto &pair: data_map) {
-                    const std::string &name = pair.first;
-                    std::vector<real> &data_vec = pair.second;
-
-                    std::cout << "\nColumn " << name << " :";
-
-                    size_t n = data_vec.size();
-
-                    std::cout << n << " elements" << std::endl;
-                    std::cout << "=============================" << std::endl;
-
-                    if (all_variants) {
-                        std::cout << "Running all variants" << std::endl;
-                        //cpu
-                        device_type device(device_type::d_type::CPU);
-                        auto policies = {execution_policy::e_type::Sequential, execution_policy::e_type::Parallel};
-                        auto vectorizations = {true, false};
-                        for (auto ex_policy: policies) {
-                            for (auto vectorized: vectorizations) {
-                                real CV = 0;
-                                real MAD = 0;
-                                std::cout << "Running on CPU in "
-                                          << (ex_policy == execution_policy::e_type::Parallel ? "parallel"
-                                                                                              : "sequential")
-                                          << " with " << (vectorized ? "vectorization" : "no vectorization")
-                                          << std::endl;
-                                auto med_time = do_comp(data_vec, CV, MAD, vectorized, execution_policy(ex_policy),
-                                                        device, repetitions);
-                                results_file << name << "," << n << ",CPU_"
-                                             << (ex_policy == execution_policy::e_type::Parallel ? "parallel"
-                                                                                                 : "sequential") << "_"
-                                             << (vectorized ? "vectorized" : "no_vectorized") << "," << CV << "," << MAD
-                                             << "," << med_time << "\n";
-                            }
-                        }
-                        //gpu
-                        real CV = 0;
-                        real MAD = 0;
-                        device_type device_gpu(device_type::d_type::GPU);
-                        std::cout << "Running on GPU" << std::endl;
-                        auto med_time = do_comp(data_vec, CV, MAD, vec, policy, device_gpu, repetitions);
-                        results_file << name << "," << n << ",GPU," << CV << "," << MAD << "," << med_time << "\n";
-                    } else {
-                        real CV = 0;
-                        real MAD = 0;
-                        device_type device(gpu ? device_type::d_type::GPU : device_type::d_type::CPU);
-                        std::cout << "Running on " << (gpu ? "GPU" : "CPU") << std::endl;
-                        if (!gpu) {
-                            std::cout << "Running in " << (par ? "parallel" : "sequential") << " mode with "
-                                      << (vec ? "vectorization" : "no vectorization") << std::endl;
-                        }
-                        auto med_time = do_comp(data_vec, CV, MAD, vec, policy, device, repetitions);
-                        std::string comp_type = gpu ? "GPU" : "CPU_" + std::string(par ? "parallel" : "sequential") +
-                                                              "_" + std::string(vec ? "vectorized" : "no_vectorized");
-                        results_file << name << "," << n << "," << comp_type << "," << CV << "," << MAD << ","
-                                     << med_time << "\n";
-                    }
-                }
-            }
-            results_file.close();
-            // if all variants are run, plot the results
-            if (all_variants) {
-                std::string out_dir = output + "/" + std::filesystem::path(file).stem().string();
-                plot_results(out_file, out_dir);
-            }
+        run_config config{output, repetitions, num_partitions, par, vec, all_variants, gpu_batch, auto_select,
+                          engine_name, options, segment_length};
+        const std::string &precision = parser.get("--precision");
+        check_precision(precision);
+        // the mixed precision stores the data as float
+        config.options.mixed_precision = precision == "mixed";
+        config.storage = check_storage_format(parser.get("--storage"));
+        config.incremental = parser.get("--incremental") == "true";
+        config.engine_named = !parser.get("--engine").empty();
+        if (precision != "double") {
+            run<float>(files, config);
+        } else {
+            run<double>(files, config);
         }
-
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
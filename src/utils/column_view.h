@@ -0,0 +1,58 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * column_view class - read-only view of consecutive elements (a whole column or a prefix of it) standing in for
+ * std::span of C++20. It converts implicitly from std::vector, so the computations taking a view accept the vectors
+ * without a copy.
+ * @tparam Real - element type (float or double)
+ */
+template<typename Real>
+class column_view {
+public:
+    column_view() = default;
+
+    column_view(const Real *data, size_t size) : data_(data), size_(size) {}
+
+    column_view(const std::vector<Real> &column) : data_(column.data()), size_(column.size()) {} // NOLINT
+
+    [[nodiscard]] const Real *data() const {
+        return data_;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+
+    [[nodiscard]] const Real *begin() const {
+        return data_;
+    }
+
+    [[nodiscard]] const Real *end() const {
+        return data_ + size_;
+    }
+
+    const Real &operator[](size_t i) const {
+        return data_[i];
+    }
+
+    /**
+     * @brief View of the first elements
+     * @param n - number of elements (at most the size of the view)
+     * @return view of the first n elements
+     */
+    [[nodiscard]] column_view prefix(size_t n) const {
+        return {data_, std::min(n, size_)};
+    }
+
+private:
+    const Real *data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,63 @@
+#include "half.h"
+
+#define FLOAT_INFINITY 0x7f800000u // bits of the float infinity
+#define HALF_INFINITY 0x7c00u // bits of the half infinity
+#define HALF_OVERFLOW 0x477ff000u // 65520 - halfway between the largest half and 2^16, rounds to infinity
+#define HALF_MIN_NORMAL 0x38800000u // 2^-14 - smallest normal half
+#define HALF_UNDERFLOW 0x33000000u // 2^-25 - half of the smallest subnormal half, smaller values round to zero
+
+const char *storage_format_name(storage_format format) {
+    switch (format) {
+        case storage_format::Half:
+            return "half";
+        case storage_format::BFloat16:
+            return "bfloat16";
+        default:
+            return "native";
+    }
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= FLOAT_INFINITY) { // infinity stays infinity, NaN stays quiet NaN
+        return static_cast<uint16_t>(sign | HALF_INFINITY | (magnitude > FLOAT_INFINITY ? 0x200 : 0));
+    }
+    if (magnitude >= HALF_OVERFLOW) {
+        return static_cast<uint16_t>(sign | HALF_INFINITY);
+    }
+    if (magnitude < HALF_UNDERFLOW) {
+        return sign;
+    }
+    uint32_t result, rest, halfway;
+    if (magnitude < HALF_MIN_NORMAL) {
+        // subnormal half - the mantissa with the implicit bit shifted to multiples of 2^-24
+        uint32_t exponent = magnitude >> 23;
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        result = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    } else {
+        // normal half - the exponent rebiased from 127 to 15, 13 bits of the mantissa rounded off
+        result = (magnitude - 0x38000000) >> 13;
+        rest = magnitude & 0x1fff;
+        halfway = 0x1000;
+    }
+    // a carry out of the mantissa increments the exponent, which is the correct rounding as well
+    if (rest > halfway || (rest == halfway && (result & 1))) {
+        ++result;
+    }
+    return static_cast<uint16_t>(sign | result);
+}
+
+uint16_t float_to_bfloat16(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffff) > FLOAT_INFINITY) { // NaN must not round to infinity
+        return static_cast<uint16_t>((bits >> 16) | 0x40);
+    }
+    return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
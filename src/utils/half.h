@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Storage of the loaded columns
+ *
+ * @details
+ *  - Native - the element type of the computations (float or double)
+ *  - Half - IEEE 754 binary16 (11 bits of mantissa, up to 65504)
+ *  - BFloat16 - upper half of a float (8 bits of mantissa, the range of float)
+ */
+enum class storage_format {
+    Native,
+    Half,
+    BFloat16
+};
+
+/**
+ * @brief Name of the storage format
+ * @param format - storage format
+ * @return name (native, half, bfloat16)
+ */
+const char *storage_format_name(storage_format format);
+
+/**
+ * @brief Round a float to the nearest half (ties to even) - values above the range become infinities
+ * @param value - float
+ * @return bits of the half
+ */
+uint16_t float_to_half(float value);
+
+/**
+ * @brief Round a float to the nearest bfloat16 (ties to even)
+ * @param value - float
+ * @return bits of the bfloat16
+ */
+uint16_t float_to_bfloat16(float value);
+
+/**
+ * @brief Widen a half to float (exact)
+ * @param bits - bits of the half
+ * @return float
+ */
+inline float half_to_float(uint16_t bits) {
+    uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1f;
+    uint32_t mantissa = bits & 0x3ff;
+    if (exponent == 0) { // zero and subnormal numbers - multiples of 2^-24
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    uint32_t result = exponent == 0x1f ? sign | 0x7f800000 | (mantissa << 13) // infinity and NaN
+                                       : sign | ((exponent + 112) << 23) | (mantissa << 13); // rebias 15 to 127
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Widen a bfloat16 to float (exact)
+ * @param bits - bits of the bfloat16
+ * @return float
+ */
+inline float bfloat16_to_float(uint16_t bits) {
+    uint32_t result = static_cast<uint32_t>(bits) << 16;
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Key of a 16-bit float ordered like the values - the sign bit is flipped for the positive numbers, all bits
+ * for the negative ones
+ * @param bits - bits of the half or bfloat16
+ * @return key
+ */
+inline uint16_t order_key(uint16_t bits) {
+    return static_cast<uint16_t>(bits & 0x8000 ? ~bits : bits | 0x8000);
+}
+
+/**
+ * @brief Bits of the 16-bit float of an order key
+ * @param key - key of order_key
+ * @return bits of the half or bfloat16
+ */
+inline uint16_t key_bits(uint16_t key) {
+    return static_cast<uint16_t>(key & 0x8000 ? key & 0x7fff : ~key);
+}
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <functional>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 #include <variant>
-#include <execution>
 #include <map>
 #include <unordered_map>
 #include <stdexcept>
@@ -23,31 +24,30 @@
 #undef max
 #endif
 
-#ifdef _FLOAT
-using real = float;
-#define LOAD _mm256_loadu_ps
-#define STORE _mm256_storeu_ps
-#define SETZERO _mm256_setzero_ps
-#define ADD _mm256_add_ps
-#define SUB _mm256_sub_ps
-#define MUL _mm256_mul_ps
-#define ANDNOT _mm256_andnot_ps
-#define STRIDE __m256
-#define SET1 _mm256_set1_ps
-#define str_to_real std::strtof
-#else
-using real = double;
-#define LOAD _mm256_loadu_pd
-#define STORE _mm256_storeu_pd
-#define SETZERO _mm256_setzero_pd
-#define ADD _mm256_add_pd
-#define SUB _mm256_sub_pd
-#define MUL _mm256_mul_pd
-#define ANDNOT _mm256_andnot_pd
-#define STRIDE __m256d
-#define SET1 _mm256_set1_pd
-#define str_to_real std::strtod
-#endif
+/**
+ * @brief Parse a real number of the given precision
+ * @tparam Real - float or double
+ * @param str - string to parse
+ * @return parsed value
+ */
+template<typename Real>
+Real str_to_real(const char *str) {
+    if constexpr (std::is_same_v<Real, float>) {
+        return std::strtof(str, nullptr);
+    } else {
+        return std::strtod(str, nullptr);
+    }
+}
+
+/**
+ * @brief Name of the precision
+ * @tparam Real - float or double
+ * @return float or double
+ */
+template<typename Real>
+const char *precision_name() {
+    return std::is_same_v<Real, float> ? "float" : "double";
+}
 
 /**
  * @brief Measure the time taken by a function to execute
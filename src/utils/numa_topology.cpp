@@ -0,0 +1,214 @@
+#include "numa_topology.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#define MAX_NUMA_NODES 64 // nodes addressable by the node masks of the system calls
+#define POLICY_DEFAULT 0 // MPOL_DEFAULT of the Linux memory policy
+#define POLICY_BIND 2 // MPOL_BIND
+#define POLICY_MOVE (1u << 1) // MPOL_MF_MOVE - migrate the pages of the range not on the node
+
+namespace {
+#ifdef __linux__
+    /**
+     * @brief Parse a Linux cpu list such as "0-3,8-11"
+     */
+    std::vector<size_t> parse_cpu_list(const std::string &list) {
+        std::vector<size_t> cpus;
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            try {
+                size_t dash = range.find('-');
+                size_t first = std::stoul(range.substr(0, dash));
+                size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                for (size_t cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            } catch (const std::exception &) {
+                // skip malformed ranges
+            }
+        }
+        return cpus;
+    }
+#endif
+}
+
+numa_topology::numa_topology() {
+#ifdef _WIN32
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest)) {
+        for (USHORT node = 0; node <= highest; ++node) {
+            GROUP_AFFINITY affinity{};
+            if (!GetNumaNodeProcessorMaskEx(node, &affinity) || affinity.Mask == 0) {
+                continue;
+            }
+            numa_node entry{node, {}};
+            for (size_t bit = 0; bit < 8 * sizeof(KAFFINITY); ++bit) {
+                if (affinity.Mask & (static_cast<KAFFINITY>(1) << bit)) {
+                    entry.cpus.push_back(affinity.Group * 8 * sizeof(KAFFINITY) + bit);
+                }
+            }
+            nodes_.push_back(entry);
+        }
+    }
+#elif defined(__linux__)
+    for (size_t node = 0; node < MAX_NUMA_NODES; ++node) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!file || !std::getline(file, list)) {
+            continue;
+        }
+        auto cpus = parse_cpu_list(list);
+        if (!cpus.empty()) { // memory-only nodes have no threads to process their data
+            nodes_.push_back({node, cpus});
+        }
+    }
+#endif
+    if (nodes_.empty()) { // no NUMA information - one node with all processors
+        numa_node entry{0, {}};
+        for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            entry.cpus.push_back(cpu);
+        }
+        nodes_.push_back(entry);
+    }
+
+    // processors of the affinity mask of the process - the threads are pinned only to these
+#ifdef _WIN32
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    GROUP_AFFINITY group{};
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) &&
+        GetThreadGroupAffinity(GetCurrentThread(), &group)) {
+        // the mask covers the processor group of the process only
+        for (size_t bit = 0; bit < 8 * sizeof(DWORD_PTR); ++bit) {
+            if (process_mask & (static_cast<DWORD_PTR>(1) << bit)) {
+                usable_cpus_.push_back(group.Group * 8 * sizeof(KAFFINITY) + bit);
+            }
+        }
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(getpid(), sizeof(set), &set) == 0) {
+        for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                usable_cpus_.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (usable_cpus_.empty()) { // no affinity information - all processors
+        for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) {
+            usable_cpus_.push_back(cpu);
+        }
+    }
+}
+
+const numa_topology &numa_topology::instance() {
+    static numa_topology topology;
+    return topology;
+}
+
+void numa_topology::pin_to_cpu(size_t cpu) {
+    pin_to_node({0, {cpu}});
+}
+
+void numa_topology::pin_to_node(const numa_node &node) {
+    // only the processors of the affinity mask - the others do not exist or the process may not run on them
+    const auto &usable = instance().usable_cpus();
+    std::vector<size_t> cpus;
+    for (size_t cpu: node.cpus) {
+        if (std::binary_search(usable.begin(), usable.end(), cpu)) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty()) {
+        return;
+    }
+#ifdef _WIN32
+    // the usable processors are in the group of the process, so their position in it is the bit of the mask
+    DWORD_PTR mask = 0;
+    for (size_t cpu: cpus) {
+        mask |= static_cast<DWORD_PTR>(1) << (cpu % (8 * sizeof(DWORD_PTR)));
+    }
+    SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t cpu: cpus) {
+        CPU_SET(cpu, &set);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+size_t numa_topology::page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#elif defined(__linux__)
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 4096;
+#endif
+}
+
+bool numa_topology::move_to_node(void *begin, size_t bytes, size_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    // only the whole pages of the range - the partial ones are shared with the neighbouring ranges
+    const auto page = static_cast<uintptr_t>(page_size());
+    auto first = (reinterpret_cast<uintptr_t>(begin) + page - 1) & ~(page - 1);
+    auto last = (reinterpret_cast<uintptr_t>(begin) + bytes) & ~(page - 1);
+    if (last <= first || node >= MAX_NUMA_NODES) {
+        return false;
+    }
+    unsigned long mask = 1ul << node;
+    // bind with migration, then drop the policy - the memory may be reused by other allocations later
+    long ret = syscall(SYS_mbind, first, last - first, POLICY_BIND, &mask, MAX_NUMA_NODES + 1, POLICY_MOVE);
+    syscall(SYS_mbind, first, last - first, POLICY_DEFAULT, nullptr, 0, 0);
+    return ret == 0;
+#else
+    (void) begin;
+    (void) bytes;
+    (void) node;
+    return false;
+#endif
+}
+
+std::vector<int> numa_topology::page_nodes(const void *begin, size_t bytes) {
+#if defined(__linux__) && defined(SYS_move_pages)
+    const auto page = static_cast<uintptr_t>(page_size());
+    auto first = (reinterpret_cast<uintptr_t>(begin) + page - 1) & ~(page - 1);
+    auto last = (reinterpret_cast<uintptr_t>(begin) + bytes) & ~(page - 1);
+    std::vector<void *> pages;
+    for (auto address = first; address < last; address += page) {
+        pages.push_back(reinterpret_cast<void *>(address));
+    }
+    // move_pages without target nodes only reports the node of every page
+    std::vector<int> status(pages.size(), -1);
+    if (!pages.empty() && syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) {
+        std::fill(status.begin(), status.end(), -1);
+    }
+    return status;
+#else
+    (void) begin;
+    (void) bytes;
+    return {};
+#endif
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief NUMA node - memory with its logical processors
+ */
+struct numa_node {
+    size_t id; // node number of the operating system
+    std::vector<size_t> cpus; // logical processors of the node
+};
+
+/**
+ * numa_topology class - NUMA nodes of the machine and the calls placing threads and memory on them.
+ * The nodes are read from /sys/devices/system/node on Linux and from the NUMA API on Windows, one node with all
+ * processors is reported elsewhere. Memory placement uses the raw mbind and move_pages system calls (no libnuma),
+ * so it is available on Linux only - the calls report failure on other systems.
+ */
+class numa_topology {
+public:
+    /**
+     * @brief Get the topology - discovered on the first call
+     * @return the topology
+     */
+    static const numa_topology &instance();
+
+    /**
+     * @brief NUMA nodes of the machine
+     * @return nodes ordered by their number
+     */
+    [[nodiscard]] const std::vector<numa_node> &nodes() const {
+        return nodes_;
+    }
+
+    /**
+     * @brief Logical processors the process may run on (its affinity mask)
+     * @return processors ordered by their number
+     */
+    [[nodiscard]] const std::vector<size_t> &usable_cpus() const {
+        return usable_cpus_;
+    }
+
+    /**
+     * @brief Restrict the calling thread to one logical processor
+     * @param cpu - logical processor (one of usable_cpus)
+     */
+    static void pin_to_cpu(size_t cpu);
+
+    /**
+     * @brief Restrict the calling thread to the usable processors of the node - the thread stays unpinned if the node
+     * has none
+     * @param node - NUMA node
+     */
+    static void pin_to_node(const numa_node &node);
+
+    /**
+     * @brief Migrate the whole pages of the memory range to the node
+     * @param begin - start of the range
+     * @param bytes - size of the range
+     * @param node - node number of the operating system
+     * @return true if the pages were moved
+     */
+    static bool move_to_node(void *begin, size_t bytes, size_t node);
+
+    /**
+     * @brief Nodes the whole pages of the memory range reside on
+     * @param begin - start of the range
+     * @param bytes - size of the range
+     * @return node number of every page, -1 if it cannot be queried (empty on systems without the query)
+     */
+    static std::vector<int> page_nodes(const void *begin, size_t bytes);
+
+    /**
+     * @brief Size of a memory page
+     * @return page size in bytes
+     */
+    static size_t page_size();
+
+private:
+    numa_topology();
+
+    std::vector<numa_node> nodes_;
+    std::vector<size_t> usable_cpus_;
+};
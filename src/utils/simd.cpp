@@ -0,0 +1,107 @@
+#include "simd.h"
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#define CPUID_SSE42 (1u << 20) // leaf 1, ecx
+#define CPUID_OSXSAVE (1u << 27) // leaf 1, ecx - xgetbv available
+#define CPUID_AVX (1u << 28) // leaf 1, ecx
+#define CPUID_F16C (1u << 29) // leaf 1, ecx - half conversions of the compressed storage
+#define CPUID_AVX2 (1u << 5) // leaf 7, ebx
+#define CPUID_AVX512F (1u << 16) // leaf 7, ebx
+#define XCR0_AVX 0x6u // xmm and ymm registers saved by the operating system
+#define XCR0_AVX512 0xe0u // opmask and zmm registers saved by the operating system
+
+namespace {
+    /**
+     * @brief Execute cpuid
+     * @return false if the leaf is not supported
+     */
+    bool cpuid(unsigned leaf, unsigned subleaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (static_cast<unsigned>(info[0]) < leaf) {
+            return false;
+        }
+        __cpuidex(info, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; ++i) {
+            regs[i] = static_cast<uint32_t>(info[i]);
+        }
+        return true;
+#elif defined(__x86_64__) || defined(__i386__)
+        unsigned a, b, c, d;
+        if (!__get_cpuid_count(leaf, subleaf, &a, &b, &c, &d)) {
+            return false;
+        }
+        regs[0] = a;
+        regs[1] = b;
+        regs[2] = c;
+        regs[3] = d;
+        return true;
+#else
+        (void) leaf;
+        (void) subleaf;
+        (void) regs;
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Register state saved by the operating system on context switches (xgetbv 0)
+     */
+    uint64_t xcr0() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#else
+        return 0;
+#endif
+    }
+}
+
+simd_isa detect_simd_isa() {
+    uint32_t leaf1[4], leaf7[4];
+    if (!cpuid(1, 0, leaf1)) {
+        return simd_isa::Scalar;
+    }
+    if (!cpuid(7, 0, leaf7)) {
+        leaf7[1] = 0;
+    }
+    // the wide registers are usable only if the operating system saves them
+    uint64_t state = (leaf1[2] & CPUID_OSXSAVE) ? xcr0() : 0;
+    // the AVX2 and AVX-512 kernels widen halfs by F16C - present on every processor with AVX2
+    bool avx = (leaf1[2] & CPUID_AVX) && (leaf1[2] & CPUID_F16C) && (state & XCR0_AVX) == XCR0_AVX;
+
+    if (avx && (leaf7[1] & CPUID_AVX512F) && (state & XCR0_AVX512) == XCR0_AVX512) {
+        return simd_isa::AVX512;
+    }
+    if (avx && (leaf7[1] & CPUID_AVX2)) {
+        return simd_isa::AVX2;
+    }
+    if (leaf1[2] & CPUID_SSE42) {
+        return simd_isa::SSE42;
+    }
+    return simd_isa::Scalar;
+}
+
+const char *simd_isa_name(simd_isa isa) {
+    switch (isa) {
+        case simd_isa::AVX512:
+            return "avx512";
+        case simd_isa::AVX2:
+            return "avx2";
+        case simd_isa::SSE42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE4_2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Instruction set of the SIMD kernels - ordered from the narrowest
+ */
+enum class simd_isa {
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+/**
+ * @brief Widest instruction set supported by the processor and the operating system (cpuid and xgetbv)
+ * @return instruction set
+ */
+simd_isa detect_simd_isa();
+
+/**
+ * @brief Name of the instruction set
+ * @param isa - instruction set
+ * @return name (scalar, sse4.2, avx2, avx512)
+ */
+const char *simd_isa_name(simd_isa isa);
+
+/**
+ * Typed SIMD operations on Real (float or double) of one instruction set - vec is the register type, width the
+ * number of elements in it. A specialization is defined only in translation units compiled for its instruction set
+ * (the kernel translation units of src/data_processing/CPU), so the wide instructions cannot leak into the code
+ * running on older processors. The double specializations also load floats widened to double (load_widen) for the
+ * float storage with double accumulation. The AVX2 and AVX-512 specializations (has_16bit_loads) widen halfs by F16C
+ * and bfloat16s by a shift (load_half, load_bfloat16) for the compressed column storage.
+ */
+template<simd_isa ISA, typename Real>
+struct simd;
+
+/**
+ * @brief Horizontal sum of a register - the lanes are stored and added in order
+ * @tparam S - simd specialization
+ */
+template<typename S, typename Real>
+Real reduce_lanes(typename S::vec v) {
+    Real lanes[S::width];
+    S::store(lanes, v);
+    Real sum = 0;
+    for (Real lane: lanes) {
+        sum += lane;
+    }
+    return sum;
+}
+
+template<typename Real>
+struct simd<simd_isa::Scalar, Real> {
+    using vec = Real;
+    static constexpr size_t width = 1;
+    static constexpr bool has_16bit_loads = false;
+
+    static vec load(const Real *p) { return *p; }
+
+    static vec load_widen(const float *p) { return static_cast<Real>(*p); }
+
+    static void store(Real *p, vec v) { *p = v; }
+
+    static vec zero() { return 0; }
+
+    static vec set1(Real value) { return value; }
+
+    static vec add(vec a, vec b) { return a + b; }
+
+    static vec sub(vec a, vec b) { return a - b; }
+
+    static vec mul(vec a, vec b) { return a * b; }
+
+    static vec abs(vec a) { return a < 0 ? -a : a; }
+
+    static Real reduce_add(vec v) { return v; }
+};
+
+#if defined(__SSE4_2__) || defined(_M_X64)
+template<>
+struct simd<simd_isa::SSE42, float> {
+    using vec = __m128;
+    static constexpr size_t width = 4;
+    static constexpr bool has_16bit_loads = false;
+
+    static vec load(const float *p) { return _mm_loadu_ps(p); }
+
+    static void store(float *p, vec v) { _mm_storeu_ps(p, v); }
+
+    static vec zero() { return _mm_setzero_ps(); }
+
+    static vec set1(float value) { return _mm_set1_ps(value); }
+
+    static vec add(vec a, vec b) { return _mm_add_ps(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm_sub_ps(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm_mul_ps(a, b); }
+
+    static vec abs(vec a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); } // clear the sign bit
+
+    static float reduce_add(vec v) { return reduce_lanes<simd, float>(v); }
+};
+
+template<>
+struct simd<simd_isa::SSE42, double> {
+    using vec = __m128d;
+    static constexpr size_t width = 2;
+    static constexpr bool has_16bit_loads = false;
+
+    static vec load(const double *p) { return _mm_loadu_pd(p); }
+
+    static vec load_widen(const float *p) {
+        return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+    }
+
+    static void store(double *p, vec v) { _mm_storeu_pd(p, v); }
+
+    static vec zero() { return _mm_setzero_pd(); }
+
+    static vec set1(double value) { return _mm_set1_pd(value); }
+
+    static vec add(vec a, vec b) { return _mm_add_pd(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm_sub_pd(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm_mul_pd(a, b); }
+
+    static vec abs(vec a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); } // clear the sign bit
+
+    static double reduce_add(vec v) { return reduce_lanes<simd, double>(v); }
+};
+#endif
+
+#ifdef __AVX2__
+template<>
+struct simd<simd_isa::AVX2, float> {
+    using vec = __m256;
+    static constexpr size_t width = 8;
+    static constexpr bool has_16bit_loads = true;
+
+    static vec load(const float *p) { return _mm256_loadu_ps(p); }
+
+    static vec load_half(const uint16_t *p) {
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+    }
+
+    static vec load_bfloat16(const uint16_t *p) {
+        __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16));
+    }
+
+    static void store(float *p, vec v) { _mm256_storeu_ps(p, v); }
+
+    static vec zero() { return _mm256_setzero_ps(); }
+
+    static vec set1(float value) { return _mm256_set1_ps(value); }
+
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+
+    static vec abs(vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); } // clear the sign bit
+
+    static float reduce_add(vec v) { return reduce_lanes<simd, float>(v); }
+};
+
+template<>
+struct simd<simd_isa::AVX2, double> {
+    using vec = __m256d;
+    static constexpr size_t width = 4;
+    static constexpr bool has_16bit_loads = true;
+
+    static vec load(const double *p) { return _mm256_loadu_pd(p); }
+
+    static vec load_widen(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+
+    static vec load_half(const uint16_t *p) {
+        return _mm256_cvtps_pd(_mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+    }
+
+    static vec load_bfloat16(const uint16_t *p) {
+        __m128i bits = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+        return _mm256_cvtps_pd(_mm_castsi128_ps(_mm_slli_epi32(bits, 16)));
+    }
+
+    static void store(double *p, vec v) { _mm256_storeu_pd(p, v); }
+
+    static vec zero() { return _mm256_setzero_pd(); }
+
+    static vec set1(double value) { return _mm256_set1_pd(value); }
+
+    static vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+
+    static vec abs(vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); } // clear the sign bit
+
+    static double reduce_add(vec v) { return reduce_lanes<simd, double>(v); }
+};
+#endif
+
+#ifdef __AVX512F__
+template<>
+struct simd<simd_isa::AVX512, float> {
+    using vec = __m512;
+    static constexpr size_t width = 16;
+    static constexpr bool has_16bit_loads = true;
+
+    static vec load(const float *p) { return _mm512_loadu_ps(p); }
+
+    static vec load_half(const uint16_t *p) {
+        return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+    }
+
+    static vec load_bfloat16(const uint16_t *p) {
+        __m512i bits = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(bits, 16));
+    }
+
+    static void store(float *p, vec v) { _mm512_storeu_ps(p, v); }
+
+    static vec zero() { return _mm512_setzero_ps(); }
+
+    static vec set1(float value) { return _mm512_set1_ps(value); }
+
+    static vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+
+    static vec abs(vec a) { return _mm512_abs_ps(a); }
+
+    static float reduce_add(vec v) { return _mm512_reduce_add_ps(v); }
+};
+
+template<>
+struct simd<simd_isa::AVX512, double> {
+    using vec = __m512d;
+    static constexpr size_t width = 8;
+    static constexpr bool has_16bit_loads = true;
+
+    static vec load(const double *p) { return _mm512_loadu_pd(p); }
+
+    static vec load_widen(const float *p) { return _mm512_cvtps_pd(_mm256_loadu_ps(p)); }
+
+    static vec load_half(const uint16_t *p) {
+        return _mm512_cvtps_pd(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+    }
+
+    static vec load_bfloat16(const uint16_t *p) {
+        __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        return _mm512_cvtps_pd(_mm256_castsi256_ps(_mm256_slli_epi32(bits, 16)));
+    }
+
+    static void store(double *p, vec v) { _mm512_storeu_pd(p, v); }
+
+    static vec zero() { return _mm512_setzero_pd(); }
+
+    static vec set1(double value) { return _mm512_set1_pd(value); }
+
+    static vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+
+    static vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+
+    static vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+
+    static vec abs(vec a) { return _mm512_abs_pd(a); }
+
+    static double reduce_add(vec v) { return _mm512_reduce_add_pd(v); }
+};
+#endif
@@ -0,0 +1,300 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#define DEQUE_CAPACITY 4096 // tasks of one worker - the split depth is logarithmic, so it is never reached in practice
+#define TASKS_PER_THREAD 4 // blocks per thread of a loop without an explicit grain - room for load balancing
+#define IDLE_SPINS 64 // failed searches for a task before a worker goes to sleep
+#define IDLE_SLEEP std::chrono::microseconds(500) // longest sleep of an idle worker
+
+namespace {
+    size_t requested_threads = 0; // 0 - number of hardware threads
+    bool requested_numa = false;
+    std::atomic<bool> started{false};
+    thread_local long worker_index = -1; // index of the worker of the current thread, -1 outside the pool
+}
+
+work_stealing_deque::work_stealing_deque(size_t capacity)
+        : buffer(capacity), mask(static_cast<int64_t>(capacity) - 1) {}
+
+bool work_stealing_deque::push(pool_task *task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t > mask) { // full
+        return false;
+    }
+    buffer[static_cast<size_t>(b & mask)].store(task, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+pool_task *work_stealing_deque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) { // empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    pool_task *task = buffer[static_cast<size_t>(b & mask)].load(std::memory_order_acquire);
+    if (t == b) { // last task - race with the thieves
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+pool_task *work_stealing_deque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) { // empty
+        return nullptr;
+    }
+    pool_task *task = buffer[static_cast<size_t>(t & mask)].load(std::memory_order_acquire);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+void thread_pool::set_num_threads(size_t num_threads) {
+    if (started.load()) {
+        throw std::runtime_error("The number of threads must be set before the thread pool is used");
+    }
+    requested_threads = num_threads;
+}
+
+void thread_pool::set_numa(bool enabled) {
+    if (started.load()) {
+        throw std::runtime_error("The NUMA mode must be set before the thread pool is used");
+    }
+    requested_numa = enabled;
+}
+
+thread_pool &thread_pool::instance() {
+    static thread_pool pool(requested_threads > 0 ? requested_threads
+                                                  : std::max<size_t>(1, std::thread::hardware_concurrency()),
+                            requested_numa);
+    return pool;
+}
+
+thread_pool::thread_pool(size_t num_threads, bool numa_mode) : numa_mode(numa_mode) {
+    started = true;
+    // the calling thread executes tasks too while it waits - one thread less is started
+    const size_t num_workers = num_threads - 1;
+    // every node of the pool needs a worker - more nodes than workers are not used
+    size_t num_nodes = numa_mode ? std::min(numa_topology::instance().nodes().size(), num_workers) : 1;
+    num_nodes = std::max<size_t>(num_nodes, 1);
+    node_workers.assign(num_nodes, 0);
+    for (size_t i = 0; i < num_workers; ++i) {
+        // contiguous blocks of workers per node
+        worker_nodes.push_back(i * num_nodes / num_workers);
+        ++node_workers[worker_nodes.back()];
+        deques.push_back(std::make_unique<work_stealing_deque>(DEQUE_CAPACITY));
+    }
+    for (size_t node = 0; node < num_nodes; ++node) {
+        shared_queues.push_back(std::make_unique<node_queue>());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers.emplace_back(&thread_pool::worker_loop, this, i);
+    }
+}
+
+thread_pool::~thread_pool() {
+    stop = true;
+    sleep_cv.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void thread_pool::worker_loop(size_t index) {
+    worker_index = static_cast<long>(index);
+    if (numa_mode) {
+        numa_topology::pin_to_node(numa_topology::instance().nodes()[worker_nodes[index]]);
+    } else {
+        // core 0 is left to the main thread, the workers above the usable processors (--threads above their count)
+        // stay unpinned rather than sharing a processor
+        const auto &cpus = numa_topology::instance().usable_cpus();
+        if (index + 1 < cpus.size()) {
+            numa_topology::pin_to_cpu(cpus[index + 1]);
+        }
+    }
+
+    size_t idle = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (pool_task *task = find_task()) {
+            execute(task);
+            idle = 0;
+        } else if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            ++sleeping;
+            sleep_cv.wait_for(lock, IDLE_SLEEP);
+            --sleeping;
+            idle = 0;
+        }
+    }
+}
+
+void thread_pool::for_blocks(size_t begin, size_t end, size_t grain,
+                             const std::function<void(size_t, size_t)> &body) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain == 0) {
+        grain = std::max<size_t>(1, (end - begin) / (num_threads() * TASKS_PER_THREAD));
+    }
+    if (workers.empty() || end - begin <= grain) { // nothing to split
+        body(begin, end);
+        return;
+    }
+    std::atomic<size_t> pending{0};
+    if (worker_index < 0 && num_nodes() > 1) {
+        // one part per node queued to its workers - nested loops of the workers stay on their node
+        for (size_t node = 0; node < num_nodes(); ++node) {
+            auto [node_begin, node_end] = node_range(node, begin, end);
+            if (node_begin < node_end) {
+                pending.fetch_add(1, std::memory_order_relaxed);
+                push(new pool_task{&body, node_begin, node_end, grain, &pending}, node);
+            }
+        }
+    } else {
+        run_range(begin, end, grain, body, pending);
+    }
+    wait(pending);
+}
+
+std::pair<size_t, size_t> thread_pool::node_range(size_t node, size_t begin, size_t end) const {
+    // prefix sums of the workers - the parts follow the order of the nodes
+    size_t before = 0;
+    for (size_t i = 0; i < node; ++i) {
+        before += node_workers[i];
+    }
+    size_t total = std::max<size_t>(workers.size(), 1);
+    size_t n = end - begin;
+    return {begin + n * before / total, begin + n * (before + node_workers[node]) / total};
+}
+
+void thread_pool::place_range(void *data, size_t count, size_t element_size) const {
+    if (num_nodes() < 2) {
+        return;
+    }
+    const auto &nodes = numa_topology::instance().nodes();
+    for (size_t node = 0; node < num_nodes(); ++node) {
+        auto [node_begin, node_end] = node_range(node, 0, count);
+        numa_topology::move_to_node(static_cast<char *>(data) + node_begin * element_size,
+                                    (node_end - node_begin) * element_size, nodes[node].id);
+    }
+}
+
+numa_pages thread_pool::count_range(const void *data, size_t count, size_t element_size) const {
+    numa_pages pages;
+    const auto &nodes = numa_topology::instance().nodes();
+    for (size_t node = 0; node < num_nodes(); ++node) {
+        auto [node_begin, node_end] = node_range(node, 0, count);
+        for (int page_node: numa_topology::page_nodes(static_cast<const char *>(data) + node_begin * element_size,
+                                                      (node_end - node_begin) * element_size)) {
+            if (page_node < 0) {
+                continue;
+            }
+            // without the NUMA split every node processes the pages
+            if (num_nodes() < 2 || static_cast<size_t>(page_node) == nodes[node].id) {
+                ++pages.local;
+            } else {
+                ++pages.remote;
+            }
+        }
+    }
+    return pages;
+}
+
+void thread_pool::run_range(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body,
+                            std::atomic<size_t> &pending) {
+    while (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        pending.fetch_add(1, std::memory_order_relaxed);
+        push(new pool_task{&body, mid, end, grain, &pending});
+        end = mid;
+    }
+    body(begin, end);
+}
+
+void thread_pool::execute(pool_task *task) {
+    run_range(task->begin, task->end, task->grain, *task->body, *task->pending);
+    // the loop may return as soon as the counter drops - the task must not be touched after it
+    std::atomic<size_t> *pending = task->pending;
+    delete task;
+    pending->fetch_sub(1, std::memory_order_release);
+}
+
+void thread_pool::push(pool_task *task, size_t node) {
+    if (worker_index < 0 || !deques[static_cast<size_t>(worker_index)]->push(task)) {
+        if (worker_index >= 0) {
+            node = worker_nodes[static_cast<size_t>(worker_index)];
+        }
+        std::lock_guard<std::mutex> lock(shared_queues[node]->mutex);
+        shared_queues[node]->tasks.push_back(task);
+    }
+    if (sleeping.load(std::memory_order_relaxed) > 0) {
+        sleep_cv.notify_one();
+    }
+}
+
+pool_task *thread_pool::pop_queue(size_t node) {
+    std::lock_guard<std::mutex> lock(shared_queues[node]->mutex);
+    if (shared_queues[node]->tasks.empty()) {
+        return nullptr;
+    }
+    pool_task *task = shared_queues[node]->tasks.front();
+    shared_queues[node]->tasks.pop_front();
+    return task;
+}
+
+pool_task *thread_pool::find_task() {
+    // threads outside the pool belong to no node - they search the nodes in order
+    size_t own_node = 0;
+    if (worker_index >= 0) {
+        own_node = worker_nodes[static_cast<size_t>(worker_index)];
+        if (pool_task *task = deques[static_cast<size_t>(worker_index)]->pop()) {
+            return task;
+        }
+    }
+    // the own node first, then the other ones - stealing across nodes only when the own node is out of work
+    for (size_t n = 0; n < num_nodes(); ++n) {
+        size_t node = (own_node + n) % num_nodes();
+        if (pool_task *task = pop_queue(node)) {
+            return task;
+        }
+        // steal from the workers of the node, starting after the own one to spread the thieves
+        size_t start = worker_index >= 0 ? static_cast<size_t>(worker_index) + 1 : 0;
+        for (size_t i = 0; i < deques.size(); ++i) {
+            size_t victim = (start + i) % deques.size();
+            if (static_cast<long>(victim) == worker_index || worker_nodes[victim] != node) {
+                continue;
+            }
+            if (pool_task *task = deques[victim]->steal()) {
+                return task;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void thread_pool::wait(const std::atomic<size_t> &pending) {
+    while (pending.load(std::memory_order_acquire) != 0) {
+        if (pool_task *task = find_task()) {
+            execute(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
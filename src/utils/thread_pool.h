@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "numa_topology.h"
+
+/**
+ * @brief Range of a parallel loop waiting to be executed by the thread pool
+ */
+struct pool_task {
+    const std::function<void(size_t, size_t)> *body; // loop body called on a block of indices
+    size_t begin;
+    size_t end;
+    size_t grain; // blocks of at most grain indices are not split any more
+    std::atomic<size_t> *pending; // tasks of the loop not finished yet
+};
+
+/**
+ * @brief Pages of an array on the node processing them and on the other nodes
+ */
+struct numa_pages {
+    size_t local = 0;
+    size_t remote = 0;
+};
+
+/**
+ * Chase-Lev work-stealing deque of a fixed capacity - the owner thread pushes and pops at the bottom,
+ * other threads steal from the top
+ */
+class work_stealing_deque {
+public:
+    /**
+     * @brief Constructor
+     * @param capacity - largest number of tasks, power of 2
+     */
+    explicit work_stealing_deque(size_t capacity);
+
+    /**
+     * @brief Push a task to the bottom - owner thread only
+     * @param task - task
+     * @return false if the deque is full
+     */
+    bool push(pool_task *task);
+
+    /**
+     * @brief Pop the newest task from the bottom - owner thread only
+     * @return task or nullptr if the deque is empty
+     */
+    pool_task *pop();
+
+    /**
+     * @brief Steal the oldest task from the top - any thread
+     * @return task or nullptr if the deque is empty or the steal lost a race
+     */
+    pool_task *steal();
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::vector<std::atomic<pool_task *>> buffer;
+    int64_t mask;
+};
+
+/**
+ * thread_pool class - persistent work-stealing pool shared by the loader, sort and statistics modules.
+ * Parallel loops are split recursively into halves, one half is pushed to the deque of the current thread and
+ * the other one is executed right away. Threads waiting for a loop to finish execute other tasks meanwhile,
+ * so nested loops reuse the workers instead of spawning new threads. Threads outside the pool (main thread)
+ * submit to a shared queue and help with the work of their loop until it finishes.
+ *
+ * In the NUMA mode the workers are spread over the nodes and pinned to the processors of their node. Loops started
+ * outside the pool are split into one contiguous part per node (node_range) queued to the workers of that node,
+ * who steal from each other before they steal from the other nodes. Arrays placed by place() with the same split
+ * are then processed by the threads of the node they reside on.
+ */
+class thread_pool {
+public:
+    /**
+     * @brief Set the number of threads of the pool - must be called before the first use of the pool
+     * @param num_threads - number of threads including the calling thread
+     */
+    static void set_num_threads(size_t num_threads);
+
+    /**
+     * @brief Enable the NUMA mode - must be called before the first use of the pool
+     * @param enabled - spread the workers over the NUMA nodes
+     */
+    static void set_numa(bool enabled);
+
+    /**
+     * @brief Get the pool - started on the first call
+     * @return the pool
+     */
+    static thread_pool &instance();
+
+    thread_pool(const thread_pool &) = delete;
+
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    ~thread_pool();
+
+    /**
+     * @brief Number of threads executing the loops (workers and the calling thread)
+     * @return number of threads
+     */
+    [[nodiscard]] size_t num_threads() const {
+        return workers.size() + 1;
+    }
+
+    /**
+     * @brief Check the NUMA mode
+     * @return true if the workers are spread over the NUMA nodes
+     */
+    [[nodiscard]] bool numa() const {
+        return numa_mode;
+    }
+
+    /**
+     * @brief Number of nodes the loops are split between - 1 without the NUMA mode
+     * @return number of nodes with at least one worker
+     */
+    [[nodiscard]] size_t num_nodes() const {
+        return shared_queues.size();
+    }
+
+    /**
+     * @brief Part of the range processed by the workers of the node - proportional to their number
+     * @param node - node index of the pool
+     * @param begin - first index
+     * @param end - index after the last one
+     * @return first index and the index after the last one of the part
+     */
+    [[nodiscard]] std::pair<size_t, size_t> node_range(size_t node, size_t begin, size_t end) const;
+
+    /**
+     * @brief Move the part of the array processed by every node to the memory of that node
+     * @param arr - array
+     */
+    template<typename T>
+    void place(std::vector<T> &arr) const {
+        place_range(arr.data(), arr.size(), sizeof(T));
+    }
+
+    /**
+     * @brief Count the pages of the array on the node processing them and on the other nodes
+     * @param arr - array
+     * @return pages on the processing node and the other ones
+     */
+    template<typename T>
+    [[nodiscard]] numa_pages count_pages(const std::vector<T> &arr) const {
+        return count_range(arr.data(), arr.size(), sizeof(T));
+    }
+
+    /**
+     * @brief Call the function for every index of the range in parallel
+     * @param begin - first index
+     * @param end - index after the last one
+     * @param func - function taking the index
+     * @param grain - largest block of indices executed as one task, derived from the number of threads if 0
+     */
+    template<typename Func>
+    void parallel_for(size_t begin, size_t end, Func &&func, size_t grain = 0) {
+        for_blocks(begin, end, grain, [&func](size_t block_begin, size_t block_end) {
+            for (size_t i = block_begin; i < block_end; ++i) {
+                func(i);
+            }
+        });
+    }
+
+    /**
+     * @brief Call the body for blocks of indices covering the range in parallel, returns when all are done
+     * @param begin - first index
+     * @param end - index after the last one
+     * @param grain - largest block of indices executed as one task, derived from the number of threads if 0
+     * @param body - function taking the first index and the index after the last one of a block
+     */
+    void for_blocks(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+private:
+    /**
+     * @brief Tasks queued to the workers of one node by the threads outside the pool
+     */
+    struct node_queue {
+        std::deque<pool_task *> tasks;
+        std::mutex mutex;
+    };
+
+    thread_pool(size_t num_threads, bool numa_mode);
+
+    void place_range(void *data, size_t count, size_t element_size) const;
+
+    [[nodiscard]] numa_pages count_range(const void *data, size_t count, size_t element_size) const;
+
+    void worker_loop(size_t index);
+
+    /**
+     * @brief Split the range in halves - the upper halves are pushed as tasks, the last block is executed
+     */
+    void run_range(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body,
+                   std::atomic<size_t> &pending);
+
+    void execute(pool_task *task);
+
+    /**
+     * @brief Push the task to the deque of the current worker, or to the queue of the node outside the pool
+     */
+    void push(pool_task *task, size_t node = 0);
+
+    pool_task *pop_queue(size_t node);
+
+    /**
+     * @brief Find a task - own deque, then the queue of the own node, then steal from the workers of the own node,
+     * then from the other nodes
+     * @return task or nullptr
+     */
+    pool_task *find_task();
+
+    /**
+     * @brief Execute other tasks until the loop is finished
+     */
+    void wait(const std::atomic<size_t> &pending);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<work_stealing_deque>> deques; // one per worker
+    std::vector<size_t> worker_nodes; // node index of every worker
+    std::vector<size_t> node_workers; // number of workers of every node
+    std::vector<std::unique_ptr<node_queue>> shared_queues; // one per node
+    bool numa_mode;
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<size_t> sleeping{0};
+    std::atomic<bool> stop{false};
+};